@@ -0,0 +1,127 @@
+/**
+ * Program      adcSamplerBench.cpp
+ *
+ * Purpose      Runs the AdcSampler on the ESP32 within the windows of a
+ *              StartStopTimer: the window actions start and stop the sampling,
+ *              the callback takes one record per firing and prints it. 3 cycles
+ *              of 20 s windows every 40 s, one firing per second, 20 kHz,
+ *              decimation 16. Checked are the achieved sample rate (within 10 %
+ *              of the set one), that no samples are taken between the windows
+ *              and that each firing has its record, failures are printed as
+ *              lines starting with "# fail".
+ *
+ * Build        pio run -e sampler_bench -t upload -t monitor
+ *              The camera is not used, the sampler needs I2S0. On the ESP32-CAM
+ *              the ADC1 pins are camera lines, GPIO 34 (Y8) reads the sensor
+ *              only with the camera held in power down (GPIO 32 high). On other
+ *              ESP32 boards connect the sensor to GPIO 34.
+ *
+ * Output       CSV lines (cycle,firing,samples,rate_hz,min,max,mean,rms,ac_rms),
+ *              at the end the totals
+*/
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "StartStopTimer.hpp"
+#include "AdcSampler.hpp"
+
+const adc1_channel_t CHANNEL     = ADC1_CHANNEL_6;   // GPIO 34
+const uint8_t        CAM_PWDN    = 32;
+const uint32_t       RATE_HZ     = 20000;
+const uint32_t       DECIMATION  = 16;
+const uint32_t       NBR_CYCLES  = 3;
+const time_t         WINDOW_SEC  = 20;
+const time_t         PERIOD_SEC  = 40;
+
+StartStopTimer timer;
+AdcSampler     sampler;
+int64_t        lastUs;
+uint32_t       records      = 0;
+uint32_t       failures     = 0;
+uint32_t       closedCount  = 0;    // samples at the close of the window
+uint32_t       leaked       = 0;    // samples taken between the windows
+
+void openWindow()
+{
+  leaked += sampler.getNbrOfSamples() - closedCount;
+  lastUs  = esp_timer_get_time();
+  sampler.start();
+}
+
+void closeWindow()
+{
+  sampler.stop();
+  delay(50);        // the last read of the reader task ends
+  closedCount = sampler.getNbrOfSamples();
+}
+
+/**
+ * The first firing of a window comes right after the start of the
+ * sampling, its record may be empty
+*/
+void takeRecord()
+{
+  SampleRecord rec;
+  int64_t      nowUs = esp_timer_get_time();
+  bool         first = timer.getFiringCount() % timer.getFiringsPerCycle() == 1;
+  bool         got   = sampler.takeRecord(rec);
+  float        rate  = 1e6f * rec.count / (nowUs - lastUs);
+
+  lastUs = nowUs;
+  if (! got && ! first)
+  {
+    Serial.printf("# fail: no record at firing %u\n", timer.getFiringCount());
+    failures++;
+    return;
+  }
+  records++;
+  Serial.printf("%u,%u,%u,%.0f,%.1f,%.1f,%.2f,%.2f,%.2f\n", timer.getSchedule().getCycle(), timer.getFiringCount(),
+                rec.count, rate, rec.min, rec.max, rec.mean, rec.rms, rec.acRms);
+  if (! first && fabsf(rate - RATE_HZ) > RATE_HZ / 10)
+  {
+    Serial.printf("# fail: rate %.0f Hz\n", rate);
+    failures++;
+  }
+}
+
+void setup()
+{
+  time_t now;
+
+  Serial.begin(115200);
+  delay(1000);
+  pinMode(CAM_PWDN, OUTPUT);
+  digitalWrite(CAM_PWDN, HIGH);
+  if (! sampler.init(CHANNEL, RATE_HZ, DECIMATION))
+  {
+    Serial.println("# fail: sampler not initialized");
+    return;
+  }
+
+  now = time(nullptr);
+  timer.init(takeRecord, 4096, 2);
+  timer.setWindowActions(openWindow, closeWindow);
+  timer.setCycleStart(now + 5);
+  timer.setCycleStop(now + 5 + WINDOW_SEC);
+  timer.setTaskInterval(1);
+  timer.setCyclePeriod(PERIOD_SEC);
+  timer.setNbrOfCycles(NBR_CYCLES);
+  timer.resume();
+
+  Serial.println("cycle,firing,samples,rate_hz,min,max,mean,rms,ac_rms");
+  while (timer.getTaskHandle()) delay(100);     // until the last window has closed
+  if (leaked)
+  {
+    Serial.printf("# fail: %u samples between the windows\n", leaked);
+    failures++;
+  }
+  if (records != timer.getFiringCount()) failures++;
+  Serial.printf("# %u records of %u firings, %u samples, %u read errors, %u failures\n", records,
+                timer.getFiringCount(), sampler.getNbrOfSamples(), sampler.getNbrOfErrors(), failures);
+  Serial.println("# done");
+}
+
+void loop()
+{
+  vTaskDelete(nullptr);
+}
@@ -0,0 +1,119 @@
+/**
+ * Program      eventBusBench.cpp
+ * 
+ * Purpose      Host benchmark of the EventBus: events published per second
+ *              with 0, 1, 2, 4, 8 and 16 subscribers of the event type. The
+ *              handlers add the value of the event to their own counter, so
+ *              the time is that of the bus and the calls. With 16 subscribers
+ *              it is also measured with the half of them muted and with 2 and
+ *              4 publishing threads (the shared sequence number and counters
+ *              are atomics). Each result is the best of 5 runs of at least
+ *              100 ms. The handlers must have seen every event, else the exit
+ *              code is 1.
+ * 
+ * Build        pio run -e event_bus_bench -t exec
+ * 
+ * Output       CSV lines (subscribers,muted,publishers,events,ns_per_event,
+ *              events_per_s,deliveries_per_s)
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "EventBus.hpp"
+
+const int      RUNS     = 5;
+const uint32_t BATCH    = 100000;
+const uint16_t EV_FIRED = 3;
+
+static thread_local uint64_t sums[EventBus::MAX_SUBSCRIBERS];
+
+static void addValue(const Event &event, void *ctx)
+{
+    sums[reinterpret_cast<intptr_t>(ctx)] += event.value;
+}
+
+/**
+ * Publish BATCH events per thread until at least 100 ms have passed.
+ * Returns the events published and their deliveries.
+*/
+static void publishBatches(EventBus &bus, int publishers, uint64_t &events, uint64_t &deliveries, double &ns)
+{
+    std::vector<std::thread> threads;
+    std::vector<uint64_t>    delivered(publishers);
+    std::vector<uint64_t>    seen(publishers);
+    int                      batches = 0;
+
+    events     = 0;
+    deliveries = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    do
+    {
+        threads.clear();
+        for (int p = 0; p < publishers; p++)
+        {
+            threads.emplace_back([&bus, &delivered, &seen, p]()
+            {
+                uint64_t n = 0;
+                for (auto &s : sums) s = 0;
+                for (uint32_t i = 0; i < BATCH; i++) n += bus.publish(EV_FIRED, p, 1, i);
+                delivered[p] = n;
+                seen[p] = 0;
+                for (auto s : sums) seen[p] += s;
+            });
+        }
+        for (auto &t : threads) t.join();
+        for (int p = 0; p < publishers; p++)
+        {
+            if (seen[p] != delivered[p]) fprintf(stderr, "handlers saw %llu of %llu events\n",
+                                                 static_cast<unsigned long long>(seen[p]),
+                                                 static_cast<unsigned long long>(delivered[p]));
+            deliveries += delivered[p];
+        }
+        events += static_cast<uint64_t>(publishers) * BATCH;
+        batches++;
+        ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    } while (ns < 1e8 || batches < 2);
+}
+
+static bool run(int subscribers, int muted, int publishers)
+{
+    EventBus bus;
+    double   best = 1e30;
+    uint64_t bestEvents = 0;
+    uint64_t bestDeliveries = 0;
+
+    for (int s = 0; s < subscribers; s++) bus.subscribe(1 << EV_FIRED, addValue, reinterpret_cast<void *>(s));
+    bus.seal();
+    for (int s = 0; s < muted; s++) bus.setMuted(s, true);
+
+    for (int r = 0; r < RUNS; r++)
+    {
+        uint64_t events, deliveries;
+        double   ns;
+        publishBatches(bus, publishers, events, deliveries, ns);
+        if (ns / events < best)
+        {
+            best           = ns / events;
+            bestEvents     = events;
+            bestDeliveries = deliveries;
+        }
+    }
+    printf("%d,%d,%d,%llu,%.2f,%.0f,%.0f\n", subscribers, muted, publishers, static_cast<unsigned long long>(bestEvents),
+           best, 1e9 / best, 1e9 / best * bestDeliveries / bestEvents);
+    return bestDeliveries == bestEvents * (subscribers - muted);
+}
+
+int main()
+{
+    bool ok = true;
+
+    printf("subscribers,muted,publishers,events,ns_per_event,events_per_s,deliveries_per_s\n");
+    for (int n : { 0, 1, 2, 4, 8, 16 }) ok = run(n, 0, 1) && ok;
+    ok = run(16, 8, 1) && ok;
+    ok = run(16, 0, 2) && ok;
+    ok = run(16, 0, 4) && ok;
+    if (! ok) printf("# events lost\n");
+    return ok ? 0 : 1;
+}
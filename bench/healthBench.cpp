@@ -0,0 +1,70 @@
+/**
+ * Program      healthBench.cpp
+ * 
+ * Purpose      Host benchmark and simulation of the write health monitor.
+ *                - overhead: time per added sample
+ *                - simulation: write latencies of a card which is healthy for
+ *                  2000 writes (lognormal around 3 ms, 1% garbage collection
+ *                  spikes of 30 ms) and then wears out: the spikes get more
+ *                  frequent and longer until the card fails (write latency
+ *                  above 2 s) at write 6000. Reports the health over the writes
+ *                  and when the monitor switched to the degraded mode.
+ * 
+ * Build        pio run -e health_bench -t exec
+ * 
+ * Output       CSV lines (write,p50_us,p99_us,trend,health,degraded)
+ *              and the summary lines beginning with #
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "WriteHealth.hpp"
+
+const int HEALTHY = 2000;
+const int FAILURE = 6000;
+
+int main()
+{
+    std::mt19937 rng(1);
+    std::lognormal_distribution<float> normal(logf(3000.0f), 0.3f);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    WriteHealth health;
+    int rc = 0;
+
+    // overhead
+    std::vector<uint32_t> samples(1 << 20);
+    for (auto &s : samples) s = normal(rng);
+    health.init();
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < 8; r++)
+        for (uint32_t s : samples) health.add(s);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    printf("# overhead: %.1f ns per sample\n", ns / (8.0 * samples.size()));
+
+    // simulation
+    health.init();
+    int degradedAt = -1;
+    printf("write,p50_us,p99_us,trend,health,degraded\n");
+    for (int w = 0; w < FAILURE; w++)
+    {
+        float wear   = w < HEALTHY ? 0.0f : static_cast<float>(w - HEALTHY) / (FAILURE - HEALTHY);
+        float pSpike = 0.01f + 0.1f * wear;
+        float spike  = 30000.0f * powf(60.0f, wear);   // 30 ms up to 1.8 s
+        float us     = normal(rng);
+        if (uniform(rng) < pSpike) us += spike * (0.5f + uniform(rng));
+        health.add(static_cast<uint32_t>(us));
+
+        if (health.isDegraded() && degradedAt < 0) degradedAt = w;
+        if (w % 250 == 249)
+        {
+            printf("%d,%u,%u,%.3f,%.2f,%d\n", w + 1, health.getQuantile(0.5f), health.getQuantile(0.99f),
+                   health.getTrend(), health.getHealth(), health.isDegraded());
+        }
+    }
+    printf("# degraded at write %d, %d writes before the failure\n", degradedAt, FAILURE - degradedAt);
+    if (degradedAt < HEALTHY) rc = 1;     // false alarm or no alarm at all
+    return rc;
+}
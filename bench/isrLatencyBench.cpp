@@ -0,0 +1,151 @@
+/**
+ * Program      isrLatencyBench.cpp
+ * 
+ * Purpose      Measures on the ESP32 how fast StartStopTimer::triggerFromISR()
+ *              gets the callback running. GPIO 13 is an input and output at once,
+ *              the benchmark raises it and its own edge interrupt triggers the
+ *              timer. Times are taken with esp_timer at the edge, in the ISR and
+ *              at the start of the callback. Scenarios:
+ *                - low_idle:  timer task at priority 1, nothing else running
+ *                - low_busy:  timer task at priority 1, a busy task of the same
+ *                             priority on each core (the callback waits for its
+ *                             time slice)
+ *                - high_busy: timer task at priority 5 with the same busy tasks
+ *                             (the ISR yields to the timer task at once)
+ *              The schedule of the timer starts only in a day, the callback runs
+ *              for the triggers alone.
+ * 
+ * Build        pio run -e isr_bench -t upload -t monitor
+ *              Nothing must be connected to GPIO 13.
+ * 
+ * Output       CSV lines (scenario,triggers,missed,edge_to_isr_us,isr_to_callback_mean_us,
+ *              isr_to_callback_p50_us,isr_to_callback_p99_us,isr_to_callback_max_us)
+*/
+
+#include <Arduino.h>
+#include <algorithm>
+#include <driver/gpio.h>
+#include <esp_timer.h>
+#include "StartStopTimer.hpp"
+
+const gpio_num_t PIN             = GPIO_NUM_13;
+const uint32_t   NBR_OF_TRIGGERS = 500;
+
+StartStopTimer   *timer;
+SemaphoreHandle_t called;
+volatile int64_t  isrUs;
+volatile int64_t  callbackUs;
+volatile bool     loadRunning = false;
+int32_t           edgeToIsr[NBR_OF_TRIGGERS];
+int32_t           isrToCallback[NBR_OF_TRIGGERS];
+
+void IRAM_ATTR onEdge(void *)
+{
+  isrUs = esp_timer_get_time();
+  timer->triggerFromISR();
+}
+
+void triggered()
+{
+  callbackUs = esp_timer_get_time();
+  xSemaphoreGive(called);
+}
+
+/**
+ * Busy for 20 ms, then one tick off, so the idle task (watchdog) gets its turn
+*/
+void busyLoad(void *)
+{
+  while (loadRunning)
+  {
+    int64_t end = esp_timer_get_time() + 20000;
+    while (esp_timer_get_time() < end) {}
+    vTaskDelay(1);
+  }
+  vTaskDelete(nullptr);
+}
+
+void runScenario(const char name[], UBaseType_t priority, bool busy)
+{
+  time_t   now         = time(nullptr);
+  uint32_t n           = 0;
+  uint32_t missed      = 0;
+  int64_t  sumEdge     = 0;
+  int64_t  sumCallback = 0;
+
+  timer = new StartStopTimer();
+  timer->init(triggered, 4096, priority);
+  timer->setCycleStart(now + 86400);
+  timer->setCycleStop(now + 2 * 86400);
+  timer->resume();
+  loadRunning = busy;
+  if (busy)
+  {
+    xTaskCreatePinnedToCore(busyLoad, "busy0", 2048, nullptr, 1, nullptr, 0);
+    xTaskCreatePinnedToCore(busyLoad, "busy1", 2048, nullptr, 1, nullptr, 1);
+  }
+  delay(100);
+
+  for (uint32_t i = 0; i < NBR_OF_TRIGGERS; i++)
+  {
+    int64_t edgeUs = esp_timer_get_time();
+    gpio_set_level(PIN, 1);
+    if (xSemaphoreTake(called, pdMS_TO_TICKS(100)) == pdTRUE)
+    {
+      edgeToIsr[n]     = isrUs - edgeUs;
+      isrToCallback[n] = callbackUs - isrUs;
+      sumEdge     += edgeToIsr[n];
+      sumCallback += isrToCallback[n];
+      n++;
+    }
+    else
+    {
+      missed++;
+    }
+    gpio_set_level(PIN, 0);
+    delay(5 + esp_random() % 10);
+  }
+  loadRunning = false;
+  delay(100);
+  timer->deleteTask();
+  delete timer;
+
+  std::sort(isrToCallback, isrToCallback + n);
+  if (n == 0)
+  {
+    n = 1;
+    edgeToIsr[0] = isrToCallback[0] = 0;
+  }
+  Serial.printf("%s,%u,%u,%.1f,%.1f,%d,%d,%d\n", name, NBR_OF_TRIGGERS, missed, 
+                static_cast<float>(sumEdge) / n, static_cast<float>(sumCallback) / n,
+                isrToCallback[n / 2], isrToCallback[(n * 99) / 100], isrToCallback[n - 1]);
+}
+
+void setup()
+{
+  gpio_config_t io = {};
+
+  Serial.begin(115200);
+  delay(1000);
+  called = xSemaphoreCreateBinary();
+  io.pin_bit_mask = 1ULL << PIN;
+  io.mode         = GPIO_MODE_INPUT_OUTPUT;
+  io.pull_up_en   = GPIO_PULLUP_DISABLE;
+  io.pull_down_en = GPIO_PULLDOWN_DISABLE;
+  io.intr_type    = GPIO_INTR_POSEDGE;
+  gpio_config(&io);
+  gpio_set_level(PIN, 0);
+  gpio_install_isr_service(0);
+  gpio_isr_handler_add(PIN, onEdge, nullptr);
+
+  Serial.println("scenario,triggers,missed,edge_to_isr_us,isr_to_callback_mean_us,isr_to_callback_p50_us,isr_to_callback_p99_us,isr_to_callback_max_us");
+  runScenario("low_idle", 1, false);
+  runScenario("low_busy", 1, true);
+  runScenario("high_busy", 5, true);
+  Serial.println("# done");
+}
+
+void loop()
+{
+  vTaskDelete(nullptr);
+}
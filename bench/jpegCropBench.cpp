@@ -0,0 +1,434 @@
+/**
+ * Program      jpegCropBench.cpp
+ *
+ * Purpose      Host check and benchmark of the lossless crop of JpegCrop.
+ *              Sample JPEGs of a synthetic scene (gradients, edges and texture)
+ *              are encoded by a minimal baseline encoder in the formats the
+ *              crop has to handle:
+ *                - 444, 422, 420: 3 components with 1x1, 2x1 (as the OV2640)
+ *                  and 2x2 sampling of the luminance, 320x240
+ *                - gray:    one component, non interleaved scan
+ *                - restart: 422 with a restart marker every 7 MCUs
+ *                - odd:     422 of 333x251, partial MCUs at the right and bottom
+ *                - uxga:    422 of 1600x1200, the full frame of the OV2640
+ *              Each is cropped to regions in the middle, at the top left and
+ *              beyond the bottom right corner and to the full image. The crop and
+ *              the original are decoded (dequantization and inverse DCT) into
+ *              their component planes, the planes of the crop must be identical
+ *              to the region of the original, else the exit code is 1.
+ *
+ * Build        pio run -e jpeg_crop_bench -t exec
+ *
+ * Output       CSV lines (data,width,height,x,y,w,h,bytes,crop_bytes,us_per_crop,identical),
+ *              x, y, w and h of the crop enlarged to the MCUs
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "JpegScan.hpp"
+#include "JpegCrop.hpp"
+
+const int RUNS = 20;
+
+// Annex K of the JPEG standard, the luminance table in natural order
+static const uint8_t QUANT[64] = {
+    16, 11, 10, 16,  24,  40,  51,  61,  12, 12, 14, 19,  26,  58,  60,  55,
+    14, 13, 16, 24,  40,  57,  69,  56,  14, 17, 22, 29,  51,  87,  80,  62,
+    18, 22, 37, 56,  68, 109, 103,  77,  24, 35, 55, 64,  81, 104, 113,  92,
+    49, 64, 78, 87, 103, 121, 120, 101,  72, 92, 95, 98, 112, 100, 103,  99 };
+
+static const uint8_t DC_BITS[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t AC_BITS[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7D };
+static const uint8_t AC_VALS[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+    0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
+    0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+    0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+    0xF9, 0xFA };
+
+using Format = struct frmt { const char *name; int width; int height; int nbrOfComponents; int h; int v;
+                             int restartInterval; };
+
+using Region = struct rgn { int x; int y; int w; int h; };
+
+// component planes of a decoded JPEG, the whole block grid
+using Planes = struct plns { int stride[JpegScan::MAX_COMPONENTS]; std::vector<uint8_t> samples[JpegScan::MAX_COMPONENTS]; };
+
+static int zigzag[64];      // natural index of the coefficient k
+
+static void makeZigzag()
+{
+    int k = 0;
+
+    for (int s = 0; s < 15; s++)
+    {
+        int lo = s > 7 ? s - 7 : 0;
+        int hi = s < 7 ? s : 7;
+        if (s % 2 == 0) for (int y = hi; y >= lo; y--) zigzag[k++] = 8 * y + s - y;
+        else            for (int y = lo; y <= hi; y++) zigzag[k++] = 8 * y + s - y;
+    }
+}
+
+/**
+ * Minimal baseline encoder: the tables of Annex K (the same huffman
+ * tables under the ids 0 and 1, so the components use different ids)
+*/
+class Encoder
+{
+    public:
+        std::vector<uint8_t> encode(const Format &f)
+        {
+            int hmax = f.nbrOfComponents == 1 ? 1 : f.h;
+            int vmax = f.nbrOfComponents == 1 ? 1 : f.v;
+            int mcusPerLine = (f.width + 8 * hmax - 1) / (8 * hmax);
+            int mcuLines    = (f.height + 8 * vmax - 1) / (8 * vmax);
+            int pred[3]     = { 0, 0, 0 };
+            int restarts    = 0;
+
+            _out.clear();
+            _bitBuf = 0;
+            _bitCnt = 0;
+            _headers(f);
+            for (int m = 0; m < mcusPerLine * mcuLines; m++)
+            {
+                if (f.restartInterval && m && m % f.restartInterval == 0)
+                {
+                    _flush();
+                    _out.push_back(0xFF);
+                    _out.push_back(0xD0 + restarts++ % 8);
+                    memset(pred, 0, sizeof(pred));
+                }
+                for (int c = 0; c < f.nbrOfComponents; c++)
+                {
+                    int h = c == 0 ? hmax : 1;
+                    int v = c == 0 ? vmax : 1;
+                    for (int b = 0; b < h * v; b++)
+                    {
+                        int x0 = (m % mcusPerLine * h + b % h) * 8;
+                        int y0 = (m / mcusPerLine * v + b / h) * 8;
+                        _block(f, c, hmax / h, vmax / v, x0, y0, pred[c]);
+                    }
+                }
+            }
+            _flush();
+            _out.push_back(0xFF);
+            _out.push_back(0xD9);
+            return _out;
+        }
+
+    private:
+        std::vector<uint8_t> _out;
+        uint32_t             _bitBuf = 0;
+        int                  _bitCnt = 0;
+        uint16_t             _dcCode[12];
+        uint8_t              _dcSize[12];
+        uint16_t             _acCode[256];
+        uint8_t              _acSize[256];
+
+        // the scene in full resolution, a component sample averages sx * sy pixels
+        static int _pixel(int c, int x, int y)
+        {
+            int v = c == 0 ? 40 + x * 150 / 1600 + y * 50 / 1200 + ((x / 37 + y / 23) % 2) * 40
+                           : 128 + (c == 1 ? 1 : -1) * ((x - y) % 97 - 48);
+            v += (x * 7919 + y * 104729) % 23 - 11;    // texture
+            return v < 0 ? 0 : v > 255 ? 255 : v;
+        }
+
+        int _sample(const Format &f, int c, int sx, int sy, int x, int y)
+        {
+            int sum = 0;
+            for (int j = 0; j < sy; j++)
+            {
+                for (int i = 0; i < sx; i++)
+                {
+                    int px = x * sx + i, py = y * sy + j;
+                    sum += _pixel(c, px < f.width ? px : f.width - 1, py < f.height ? py : f.height - 1);
+                }
+            }
+            return sum / (sx * sy);
+        }
+
+        void _block(const Format &f, int c, int sx, int sy, int x0, int y0, int &pred)
+        {
+            double  in[64];
+            int     coef[64];
+
+            for (int i = 0; i < 64; i++) in[i] = _sample(f, c, sx, sy, x0 + i % 8, y0 + i / 8) - 128.0;
+            for (int v = 0; v < 8; v++)
+            {
+                for (int u = 0; u < 8; u++)
+                {
+                    double sum = 0;
+                    for (int y = 0; y < 8; y++)
+                    {
+                        for (int x = 0; x < 8; x++)
+                        {
+                            sum += in[8 * y + x] * cos((2 * x + 1) * u * M_PI / 16) * cos((2 * y + 1) * v * M_PI / 16);
+                        }
+                    }
+                    double cu = u ? 1.0 : M_SQRT1_2, cv = v ? 1.0 : M_SQRT1_2;
+                    coef[8 * v + u] = lround(0.25 * cu * cv * sum / QUANT[8 * v + u]);
+                }
+            }
+
+            int diff = coef[0] - pred;
+            int n    = _bits(diff);
+            pred = coef[0];
+            _put(_dcCode[n], _dcSize[n]);
+            _put(diff < 0 ? diff - 1 : diff, n);
+            int run = 0;
+            for (int k = 1; k < 64; k++)
+            {
+                int a = coef[zigzag[k]];
+                if (a == 0) { run++; continue; }
+                for (; run > 15; run -= 16) _put(_acCode[0xF0], _acSize[0xF0]);
+                n = _bits(a);
+                _put(_acCode[run << 4 | n], _acSize[run << 4 | n]);
+                _put(a < 0 ? a - 1 : a, n);
+                run = 0;
+            }
+            if (run) _put(_acCode[0], _acSize[0]);
+        }
+
+        static int _bits(int v)
+        {
+            int n = 0;
+            for (v = abs(v); v; v >>= 1) n++;
+            return n;
+        }
+
+        static void _codes(const uint8_t bits[16], const uint8_t *vals, uint16_t *code, uint8_t *size)
+        {
+            uint16_t c = 0;
+            int      k = 0;
+
+            for (int l = 1; l <= 16; l++, c <<= 1)
+            {
+                for (int i = 0; i < bits[l - 1]; i++, k++, c++)
+                {
+                    code[vals[k]] = c;
+                    size[vals[k]] = l;
+                }
+            }
+        }
+
+        void _segment(uint8_t marker, const std::vector<uint8_t> &data)
+        {
+            _out.push_back(0xFF);
+            _out.push_back(marker);
+            _out.push_back((data.size() + 2) >> 8);
+            _out.push_back((data.size() + 2) & 0xFF);
+            _out.insert(_out.end(), data.begin(), data.end());
+        }
+
+        void _headers(const Format &f)
+        {
+            uint8_t              dcVals[12];
+            std::vector<uint8_t> dqt, sof, dht, sos;
+
+            for (int i = 0; i < 12; i++) dcVals[i] = i;
+            _codes(DC_BITS, dcVals, _dcCode, _dcSize);
+            _codes(AC_BITS, AC_VALS, _acCode, _acSize);
+            _out = { 0xFF, 0xD8 };
+
+            for (int t = 0; t < 2; t++)
+            {
+                dqt.push_back(t);
+                for (int k = 0; k < 64; k++) dqt.push_back(QUANT[zigzag[k]]);
+                for (int tc = 0; tc < 2; tc++)
+                {
+                    dht.push_back(tc << 4 | t);
+                    dht.insert(dht.end(), tc ? AC_BITS : DC_BITS, (tc ? AC_BITS : DC_BITS) + 16);
+                    dht.insert(dht.end(), tc ? AC_VALS : dcVals, tc ? AC_VALS + 162 : dcVals + 12);
+                }
+            }
+            sof = { 8, static_cast<uint8_t>(f.height >> 8), static_cast<uint8_t>(f.height),
+                    static_cast<uint8_t>(f.width >> 8), static_cast<uint8_t>(f.width),
+                    static_cast<uint8_t>(f.nbrOfComponents) };
+            sos = { static_cast<uint8_t>(f.nbrOfComponents) };
+            for (int c = 0; c < f.nbrOfComponents; c++)
+            {
+                int t = c ? 1 : 0;
+                sof.insert(sof.end(), { static_cast<uint8_t>(c + 1),
+                                        static_cast<uint8_t>(c ? 0x11 : f.h << 4 | f.v), static_cast<uint8_t>(t) });
+                sos.insert(sos.end(), { static_cast<uint8_t>(c + 1), static_cast<uint8_t>(t << 4 | t) });
+            }
+            sos.insert(sos.end(), { 0, 63, 0 });
+
+            _segment(0xDB, dqt);
+            _segment(0xC0, sof);
+            _segment(0xC4, dht);
+            if (f.restartInterval)
+            {
+                _segment(0xDD, { static_cast<uint8_t>(f.restartInterval >> 8), static_cast<uint8_t>(f.restartInterval) });
+            }
+            _segment(0xDA, sos);
+        }
+
+        void _put(uint32_t bits, int n)
+        {
+            if (n == 0) return;
+            _bitBuf = (_bitBuf << n) | (bits & ((1U << n) - 1));
+            for (_bitCnt += n; _bitCnt >= 8; _bitCnt -= 8)
+            {
+                uint8_t b = _bitBuf >> (_bitCnt - 8);
+                _out.push_back(b);
+                if (b == 0xFF) _out.push_back(0x00);
+            }
+        }
+
+        void _flush()
+        {
+            if (_bitCnt) _put(0x7F, 8 - _bitCnt);
+            _bitCnt = 0;
+        }
+};
+
+using Decoder = struct dcdr { JpegScan *scan; Planes *planes; };
+
+/**
+ * Dequantize and inverse DCT of a block into its place in the plane
+*/
+static void decodeBlock(void *ctx, uint32_t mcu, int comp, int block, const int16_t coef[64])
+{
+    Decoder             *d    = static_cast<Decoder *>(ctx);
+    const JpegComponent &c    = d->scan->getComponent(comp);
+    const uint16_t      *q    = d->scan->getQuant(comp);
+    bool                 one  = d->scan->getNbrOfComponents() == 1;
+    int                  h    = one ? 1 : c.h;
+    int                  v    = one ? 1 : c.v;
+    uint32_t             line = d->scan->getMcusPerLine();
+    int                  x0   = (mcu % line * h + block % h) * 8;
+    int                  y0   = (mcu / line * v + block / h) * 8;
+    double               in[64] = {};
+
+    for (int k = 0; k < 64; k++) in[zigzag[k]] = coef[k] * q[k];
+    for (int y = 0; y < 8; y++)
+    {
+        for (int x = 0; x < 8; x++)
+        {
+            double sum = 0;
+            for (int v2 = 0; v2 < 8; v2++)
+            {
+                for (int u = 0; u < 8; u++)
+                {
+                    double cu = u ? 1.0 : M_SQRT1_2, cv = v2 ? 1.0 : M_SQRT1_2;
+                    sum += cu * cv * in[8 * v2 + u] * cos((2 * x + 1) * u * M_PI / 16) * cos((2 * y + 1) * v2 * M_PI / 16);
+                }
+            }
+            long s = lround(0.25 * sum + 128);
+            d->planes->samples[comp][(y0 + y) * d->planes->stride[comp] + x0 + x] = s < 0 ? 0 : s > 255 ? 255 : s;
+        }
+    }
+}
+
+static bool decode(const uint8_t *jpg, size_t len, Planes &planes, JpegScan &scan)
+{
+    Decoder d = { &scan, &planes };
+
+    if (! scan.parse(jpg, len)) return false;
+    for (int c = 0; c < scan.getNbrOfComponents(); c++)
+    {
+        bool one = scan.getNbrOfComponents() == 1;
+        int  h   = one ? 1 : scan.getComponent(c).h;
+        int  v   = one ? 1 : scan.getComponent(c).v;
+        planes.stride[c] = scan.getMcusPerLine() * h * 8;
+        planes.samples[c].assign(static_cast<size_t>(planes.stride[c]) * scan.getMcuLines() * v * 8, 0);
+    }
+    return scan.decode(decodeBlock, &d);
+}
+
+/**
+ * The samples of the crop within its size against the region of the original
+*/
+static bool compare(JpegScan &orig, const Planes &full, JpegScan &cropped, const Planes &crop, JpegCrop &jc)
+{
+    if (cropped.getWidth() != jc.getWidth() || cropped.getHeight() != jc.getHeight()) return false;
+    for (int comp = 0; comp < orig.getNbrOfComponents(); comp++)
+    {
+        bool one = orig.getNbrOfComponents() == 1;
+        int  h   = one ? 1 : orig.getComponent(comp).h;
+        int  v   = one ? 1 : orig.getComponent(comp).v;
+        int  sx  = orig.getMcuWidth() / (8 * h);         // pixels per sample
+        int  sy  = orig.getMcuHeight() / (8 * v);
+        int  w   = (jc.getWidth() + sx - 1) / sx;
+        int  hh  = (jc.getHeight() + sy - 1) / sy;
+        int  x0  = jc.getX() / sx;
+        int  y0  = jc.getY() / sy;
+
+        for (int y = 0; y < hh; y++)
+        {
+            const uint8_t *a = &crop.samples[comp][static_cast<size_t>(y) * crop.stride[comp]];
+            const uint8_t *b = &full.samples[comp][static_cast<size_t>(y0 + y) * full.stride[comp] + x0];
+            if (memcmp(a, b, w) != 0) return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    const Format formats[] = {
+        { "444",     320,  240, 3, 1, 1, 0 },
+        { "422",     320,  240, 3, 2, 1, 0 },
+        { "420",     320,  240, 3, 2, 2, 0 },
+        { "gray",    320,  240, 1, 1, 1, 0 },
+        { "restart", 320,  240, 3, 2, 1, 7 },
+        { "odd",     333,  251, 3, 2, 1, 0 },
+        { "uxga",   1600, 1200, 3, 2, 1, 0 } };
+    Encoder  encoder;
+    JpegCrop crop;
+    JpegScan scanOrig, scanCrop;
+    bool     ok = true;
+
+    makeZigzag();
+    printf("data,width,height,x,y,w,h,bytes,crop_bytes,us_per_crop,identical\n");
+    for (const Format &f : formats)
+    {
+        std::vector<uint8_t> jpg = encoder.encode(f);
+        std::vector<uint8_t> out(2 * jpg.size() + 1024);
+        Planes               full, part;
+        const Region         regions[] = { { f.width / 3 + 5, f.height / 3 + 3, f.width / 3, f.height / 4 },
+                                           { 0, 0, 50, 30 },
+                                           { f.width - 70, f.height - 50, 100, 100 },
+                                           { 0, 0, f.width, f.height } };
+
+        if (! decode(jpg.data(), jpg.size(), full, scanOrig))
+        {
+            printf("# fail: %s, sample not decoded\n", f.name);
+            ok = false;
+            continue;
+        }
+        for (const Region &r : regions)
+        {
+            size_t len  = 0;
+            bool   done = true;
+            auto   t0   = std::chrono::steady_clock::now();
+            for (int i = 0; i < RUNS && done; i++)
+            {
+                done = crop.crop(jpg.data(), jpg.size(), r.x, r.y, r.w, r.h, out.data(), out.size(), len);
+            }
+            double us    = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / RUNS;
+            bool   equal = done && decode(out.data(), len, part, scanCrop) && compare(scanOrig, full, scanCrop, part, crop);
+
+            printf("%s,%d,%d,%d,%d,%d,%d,%zu,%zu,%.1f,%d\n", f.name, f.width, f.height, crop.getX(), crop.getY(),
+                   crop.getWidth(), crop.getHeight(), jpg.size(), len, us, equal);
+            if (! equal)
+            {
+                printf("# fail: %s, crop of %d,%d %dx%d differs\n", f.name, r.x, r.y, r.w, r.h);
+                ok = false;
+            }
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,96 @@
+/**
+ * Program      loadSim.cpp
+ * 
+ * Purpose      Host simulation of growing numbers of StartStopTimers with
+ *              random schedules (ScheduleGen, config DAY) sharing one CPU for
+ *              a simulated day. A callback occupies the CPU for its random cost,
+ *              a timer waking up meanwhile is late until the CPU is free. The
+ *              timer count is doubled from 1 to 4096 to find where the lateness
+ *              grows, i.e. where the callbacks no longer fit in the day.
+ * 
+ * Build        pio run -e load_sim -t exec
+ * 
+ * Usage        .pio/build/load_sim/program [seed]
+ * 
+ * Output       CSV lines (timers,firings,firings_per_s,cpu_load,late_mean_ms,
+ *              late_p99_ms,late_max_ms,host_ns_per_firing,bytes_per_timer)
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <queue>
+#include <vector>
+#include "ScheduleCore.hpp"
+#include "ScheduleGen.hpp"
+
+const time_t  T0     = 1686607200;      // 2023-06-13 00:00 CEST
+const int64_t DAY_US = 86400000000LL;
+
+int main(int argc, char *argv[])
+{
+    uint32_t seed = argc > 1 ? strtoul(argv[1], nullptr, 0) : 1;
+
+    printf("timers,firings,firings_per_s,cpu_load,late_mean_ms,late_p99_ms,late_max_ms,host_ns_per_firing,bytes_per_timer\n");
+    for (int n = 1; n <= 4096; n *= 2)
+    {
+        using Wake = std::pair<int64_t, int>;
+        std::vector<ScheduleCore> timers(n);
+        std::vector<TimerSpec>    specs(n);
+        std::vector<int64_t>      lateness;
+        std::priority_queue<Wake, std::vector<Wake>, std::greater<Wake>> queue;
+        ScheduleGen gen;
+        int64_t t0Us   = 1000000LL * T0;
+        int64_t cpuFree = t0Us;
+        int64_t busyUs = 0;
+
+        gen.init(seed, ScheduleGen::DAY);
+        for (int i = 0; i < n; i++)
+        {
+            specs[i] = gen.next();
+            ScheduleGen::apply(specs[i], timers[i], T0);
+            queue.push({ t0Us, i });
+        }
+
+        auto h0 = std::chrono::steady_clock::now();
+        while (! queue.empty())
+        {
+            auto [wake, i] = queue.top();
+            queue.pop();
+            if (wake >= t0Us + DAY_US) break;
+
+            ScheduleCore::Step step = timers[i].next(wake / 1000);
+            if (step.action == ScheduleCore::DONE) continue;
+            if (step.action != ScheduleCore::FIRE)
+            {
+                queue.push({ wake + 1000 * step.waitMs, i });
+                continue;
+            }
+            int64_t start = std::max(wake, cpuFree);
+            int64_t end   = start + gen.cost(specs[i]);
+            lateness.push_back(start - wake);
+            busyUs  += end - start;
+            cpuFree  = end;
+            timers[i].fired(end / 1000);
+            queue.push({ end, i });
+        }
+        double hostNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - h0).count();
+
+        size_t firings = lateness.size();
+        double mean = 0;
+        int64_t p99 = 0, max = 0;
+        if (firings)
+        {
+            for (int64_t l : lateness) mean += l;
+            mean /= firings;
+            max = *std::max_element(lateness.begin(), lateness.end());
+            std::nth_element(lateness.begin(), lateness.begin() + firings * 99 / 100, lateness.end());
+            p99 = lateness[firings * 99 / 100];
+        }
+        printf("%d,%zu,%.3f,%.4f,%.3f,%.3f,%.3f,%.1f,%zu\n", n, firings, firings / 86400.0,
+               static_cast<double>(busyUs) / DAY_US, mean / 1000, p99 / 1000.0, max / 1000.0,
+               firings ? hostNs / firings : 0.0, sizeof(ScheduleCore) + sizeof(TimerSpec));
+    }
+    return 0;
+}
@@ -0,0 +1,174 @@
+/**
+ * Program      pipelineBench.cpp
+ * 
+ * Purpose      Compares on the ESP32 a capture chain written as one blocking
+ *              callback with the same chain as a StagePipeline. The stages are
+ *              synthetic with the times of a photo: flash on (1 ms), capture
+ *              (60 ms waiting for the sensor), flash off (1 ms), encode (40 ms
+ *              busy), store (80 ms waiting for the card) and enqueue for upload
+ *              (2 ms). A timer fires every 100 ms for 20 s.
+ *                - blocking: the callback runs the whole chain, the next firing
+ *                            comes only 100 ms after its end
+ *                - pipeline: the callback only fires the pipeline; the camera,
+ *                            encode and storage workers run their stages, the
+ *                            firings overlap (3 jobs)
+ *              A second pipeline with two independent branches from one stage
+ *              checks that a failing stage skips only its own branch: the stage
+ *              after the failing one is skipped, the other branch runs on each
+ *              firing, else a line starting with "# fail" is printed.
+ * 
+ * Build        pio run -e pipeline_bench -t upload -t monitor
+ * 
+ * Output       CSV lines (mode,firings,expected,completed,dropped,latency_mean_ms,
+ *              latency_max_ms), then for the pipeline one line per stage
+ *              (stage,runs,wait_mean_us,wait_max_us,run_mean_us,queue_mean,queue_max),
+ *              at the end the runs and skips of the branches
+ *              (branch,fired,runs,skipped)
+*/
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "StartStopTimer.hpp"
+#include "StagePipeline.hpp"
+
+const uint32_t INTERVAL_MS = 100;
+const uint32_t RUN_SECONDS = 20;
+const uint32_t BRANCH_FIRINGS = 10;
+
+StagePipeline     pipeline;
+StagePipeline     branches;         // two branches, one of them failing
+volatile uint32_t firings   = 0;
+volatile uint32_t completed = 0;
+int64_t           sumLatencyUs;
+int64_t           maxLatencyUs;
+
+bool flashOn(PipelineJob &)   { delay(1); return true; }
+bool capture(PipelineJob &)   { delay(60); return true; }
+bool flashOff(PipelineJob &)  { delay(1); return true; }
+bool encode(PipelineJob &)    { delayMicroseconds(40000); return true; }
+bool store(PipelineJob &)     { delay(80); return true; }
+bool succeed(PipelineJob &)   { delay(5); return true; }
+bool fail(PipelineJob &)      { delay(5); return false; }
+
+bool enqueue(PipelineJob &job)
+{
+  delay(2);
+  int64_t latency = esp_timer_get_time() - job.startUs;
+  sumLatencyUs += latency;
+  maxLatencyUs  = max(maxLatencyUs, latency);
+  completed++;
+  return true;
+}
+
+void blockingChain()
+{
+  PipelineJob job = { firings++, nullptr, esp_timer_get_time() };
+  flashOn(job);
+  capture(job);
+  flashOff(job);
+  encode(job);
+  store(job);
+  enqueue(job);
+}
+
+void firePipeline()
+{
+  firings++;
+  pipeline.fire();
+}
+
+void runMode(const char name[], Callback cb)
+{
+  StartStopTimer timer;
+  time_t now = time(nullptr);
+
+  firings      = 0;
+  completed    = 0;
+  sumLatencyUs = 0;
+  maxLatencyUs = 0;
+  timer.init(cb, 4096, 3);
+  timer.setCycleStart(now);
+  timer.setCycleStop(now + RUN_SECONDS);
+  timer.setIntervalMultiplier(1);   // interval in ms
+  timer.setTaskInterval(INTERVAL_MS);
+  timer.setNbrOfCycles(1);
+  timer.resume();
+  delay(1000 * RUN_SECONDS + 1000);
+  timer.deleteTask();
+  delay(500);                       // let the pipeline drain
+
+  Serial.printf("%s,%u,%u,%u,%u,%.1f,%.1f\n", name, firings, 1000 * RUN_SECONDS / INTERVAL_MS, completed,
+                cb == firePipeline ? pipeline.getNbrOfDropped() : 0, 
+                completed ? sumLatencyUs / 1000.0f / completed : 0.0f, maxLatencyUs / 1000.0f);
+}
+
+/**
+ * source -> fail -> after_fail and source -> thumb -> after_thumb,
+ * the failure must not skip the thumb branch
+*/
+void runBranches()
+{
+  branches.init(2);
+  int a     = branches.addWorker("branch_a", 2048, 1);
+  int b     = branches.addWorker("branch_b", 2048, 1);
+  int src   = branches.addStage("source", succeed, a);
+  int bad   = branches.addStage("fail", fail, a, 1 << src);
+  int afBad = branches.addStage("after_fail", succeed, a, 1 << bad);
+  int thumb = branches.addStage("thumb", succeed, b, 1 << src);
+  int afOk  = branches.addStage("after_thumb", succeed, b, 1 << thumb);
+  branches.begin();
+
+  for (uint32_t i = 0; i < BRANCH_FIRINGS; i++)
+  {
+    branches.fire();
+    delay(50);                      // one firing in flight at a time
+  }
+  delay(200);
+
+  StageStats failed = branches.getStats(afBad);
+  StageStats ok     = branches.getStats(afOk);
+  Serial.println("branch,fired,runs,skipped");
+  Serial.printf("after_fail,%u,%u,%u\n", BRANCH_FIRINGS, failed.runs, failed.skipped);
+  Serial.printf("after_thumb,%u,%u,%u\n", BRANCH_FIRINGS, ok.runs, ok.skipped);
+  if (failed.runs != 0 || failed.skipped != BRANCH_FIRINGS) Serial.println("# fail: stage after the failure ran");
+  if (ok.runs != BRANCH_FIRINGS) Serial.println("# fail: independent branch skipped");
+}
+
+void setup()
+{
+  const char *names[] = { "flash_on", "capture", "flash_off", "encode", "store", "enqueue" };
+
+  Serial.begin(115200);
+  delay(1000);
+  pipeline.init(3);
+  int camera  = pipeline.addWorker("camera", 2048, 2);
+  int cpu     = pipeline.addWorker("encode", 2048, 1);
+  int storage = pipeline.addWorker("storage", 2048, 1);
+  int on      = pipeline.addStage(names[0], flashOn, camera);
+  int shot    = pipeline.addStage(names[1], capture, camera, 1 << on);
+  int off     = pipeline.addStage(names[2], flashOff, camera, 1 << shot, true);
+  int enc     = pipeline.addStage(names[3], encode, cpu, 1 << shot);
+  int st      = pipeline.addStage(names[4], store, storage, 1 << enc);
+  pipeline.addStage(names[5], enqueue, storage, (1 << st) | (1 << off));
+  pipeline.begin();
+
+  Serial.println("mode,firings,expected,completed,dropped,latency_mean_ms,latency_max_ms");
+  runMode("blocking", blockingChain);
+  runMode("pipeline", firePipeline);
+
+  Serial.println("stage,runs,wait_mean_us,wait_max_us,run_mean_us,queue_mean,queue_max");
+  for (int i = 0; i < 6; i++)
+  {
+    StageStats s = pipeline.getStats(i);
+    uint32_t   n = max(s.runs, 1U);
+    Serial.printf("%s,%u,%lld,%lld,%lld,%.2f,%u\n", names[i], s.runs, s.sumWaitUs / n, s.maxWaitUs, 
+                  s.sumRunUs / n, s.queued ? static_cast<float>(s.sumDepth) / s.queued : 0.0f, s.maxDepth);
+  }
+  runBranches();
+  Serial.println("# done");
+}
+
+void loop()
+{
+  vTaskDelete(nullptr);
+}
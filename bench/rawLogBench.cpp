@@ -0,0 +1,124 @@
+/**
+ * Program      rawLogBench.cpp
+ * 
+ * Purpose      Compares the sustained write rate of photos to the SD card
+ *              through the FAT file system (SD_MMC, one file per photo) and
+ *              through the raw block log (BlockLog on the 0xDA partition).
+ *              Synthetic photos of several sizes are written from PSRAM, like
+ *              camera frames. The FAT files are deleted afterwards, the raw
+ *              log partition is formatted, its content is lost.
+ * 
+ * Board        ESP32-CAM with an SD card partitioned as FAT + type 0xDA,
+ *              e.g. with fdisk: partition 1 FAT32, partition 2 type da
+ * 
+ * Build        pio run -e rawlog_bench -t upload -t monitor
+ * 
+ * Output       CSV lines (tier,photo_bytes,photos,photos_per_s,kbyte_per_s,max_ms)
+*/
+
+#include <Arduino.h>
+#include <FS.h>
+#include <SD_MMC.h>
+#include <esp_heap_caps.h>
+#include "BlockLog.hpp"
+#include "SdRawCard.hpp"
+
+const size_t   PHOTO_SIZES[] = { 20 * 1024, 60 * 1024, 150 * 1024 };
+const uint32_t NBR_OF_PHOTOS = 40;
+
+using Result = struct { uint32_t photos; uint32_t us; uint32_t maxUs; };
+
+SdRawCard rawCard;
+BlockLog  rawLog;
+
+void printResult(const char tier[], size_t size, const Result &r)
+{
+  Serial.printf("%s,%u,%u,%.2f,%.1f,%.1f\n", tier, size, r.photos, 1e6f * r.photos / r.us,
+                1e6f * r.photos * size / 1024 / r.us, r.maxUs / 1000.0f);
+}
+
+Result writeFat(const uint8_t *photo, size_t size)
+{
+  Result r = { 0, 0, 0 };
+  char   path[32];
+
+  for (uint32_t i = 0; i < NBR_OF_PHOTOS; i++)
+  {
+    snprintf(path, sizeof(path), "/bench%03u.jpg", i);
+    uint32_t t0 = micros();
+    File file = SD_MMC.open(path, FILE_WRITE);
+    if (! file) break;
+    bool ok = file.write(photo, size) == size;
+    file.close();
+    uint32_t us = micros() - t0;
+    if (! ok) break;
+    r.photos++;
+    r.us   += us;
+    r.maxUs = max(r.maxUs, us);
+  }
+  for (uint32_t i = 0; i < NBR_OF_PHOTOS; i++)
+  {
+    snprintf(path, sizeof(path), "/bench%03u.jpg", i);
+    SD_MMC.remove(path);
+  }
+  return r;
+}
+
+Result writeRaw(const uint8_t *photo, size_t size)
+{
+  Result r = { 0, 0, 0 };
+  char   name[32];
+
+  for (uint32_t i = 0; i < NBR_OF_PHOTOS; i++)
+  {
+    snprintf(name, sizeof(name), "/bench%03u.jpg", i);
+    uint32_t t0 = micros();
+    bool ok = rawLog.append(name, photo, size);
+    uint32_t us = micros() - t0;
+    if (! ok) break;
+    r.photos++;
+    r.us   += us;
+    r.maxUs = max(r.maxUs, us);
+  }
+  return r;
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  size_t maxSize = PHOTO_SIZES[sizeof(PHOTO_SIZES) / sizeof(PHOTO_SIZES[0]) - 1];
+  uint8_t *photo = static_cast<uint8_t *>(heap_caps_malloc(maxSize, MALLOC_CAP_SPIRAM));
+  if (! photo)
+  {
+    Serial.println("no PSRAM");
+    return;
+  }
+  for (size_t i = 0; i < maxSize; i++) photo[i] = esp_random();
+
+  Serial.println("tier,photo_bytes,photos,photos_per_s,kbyte_per_s,max_ms");
+  if (SD_MMC.begin("/sdcard", true))
+  {
+    for (size_t size : PHOTO_SIZES) printResult("fat", size, writeFat(photo, size));
+    SD_MMC.end();
+  }
+  else
+  {
+    Serial.println("# FAT partition not mounted");
+  }
+
+  if (rawCard.begin() && rawLog.format(&rawCard))
+  {
+    for (size_t size : PHOTO_SIZES) printResult("raw", size, writeRaw(photo, size));
+    rawCard.end();
+  }
+  else
+  {
+    Serial.println("# no raw log partition");
+  }
+  free(photo);
+}
+
+void loop()
+{
+  vTaskDelete(nullptr);
+}
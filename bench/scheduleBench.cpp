@@ -0,0 +1,207 @@
+/**
+ * Program      scheduleBench.cpp
+ * 
+ * Purpose      Host benchmark of the scheduling core of StartStopTimer.
+ *                - parse: setCycleStartStop() date time and interval parsing
+ *                - next: next firing computation within a window
+ *                - advance: stop of a cycle and start of the next one
+ *                - dispatch: n timers with random schedules driven by one fake
+ *                  clock for a simulated week, the next timer to wake is taken
+ *                  from a priority queue (as the FreeRTOS delayed list would)
+ *              Each result is the best of 5 runs of at least 100 ms. With a baseline file (the
+ *              output of a previous run) the ratio to the baseline is added
+ *              and the exit code is 1 if a ratio exceeds maxRatio (default 1.5,
+ *              the timing of a shared machine varies by 20% and more).
+ * 
+ * Build        pio run -e schedule_bench -t exec
+ * 
+ * Usage        .pio/build/schedule_bench/program [baseline.csv [maxRatio]] > result.csv
+ * 
+ * Output       CSV lines (benchmark,n,ops,ns_per_op[,baseline_ns_per_op,ratio])
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+#include "ScheduleCore.hpp"
+
+const time_t  T0        = 1686607200;    // 2023-06-13 00:00 CEST
+const int64_t WEEK_MS   = 7 * 86400000LL;
+const int     RUNS      = 5;
+
+using Result = struct { std::string name; int n; uint64_t ops; double nsPerOp; };
+
+static volatile uint64_t sink;      // keeps the optimizer from dropping the loops
+
+/**
+ * Repeat the benchmark for at least 100 ms, best of RUNS
+*/
+template <typename F>
+static Result measure(const char name[], int n, F run)
+{
+    Result best = { name, n, 0, 1e30 };
+    for (int r = 0; r < RUNS; r++)
+    {
+        uint64_t ops = 0;
+        double   ns  = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        do
+        {
+            ops += run();
+            ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        } while (ns < 1e8);
+        if (ns / ops < best.nsPerOp) best = { name, n, ops, ns / ops };
+    }
+    return best;
+}
+
+static uint64_t benchParse()
+{
+    const int N = 20000;
+    ScheduleCore s;
+    for (int i = 0; i < N; i++)
+    {
+        s.parse("2023-06-13 22:40", "2023-06-20 06:15", "00:05");
+        sink += s.getNbrOfCycles();
+    }
+    return N;
+}
+
+static uint64_t benchNext()
+{
+    const int N = 200000;
+    ScheduleCore s;
+    s.setStart(T0);
+    s.setStop(T0 + 86400);
+    s.setInterval(60);
+    s.next(1000LL * T0);
+    s.fired(1000LL * T0);
+    for (int i = 0; i < N; i++)
+    {
+        ScheduleCore::Step step = s.next(1000LL * T0 + i % 60000);
+        sink += step.waitMs;
+    }
+    return N;
+}
+
+static uint64_t benchAdvance()
+{
+    const uint32_t N = 100000;
+    ScheduleCore s;
+    s.setStart(T0);
+    s.setStop(T0 + 1);
+    s.setCyclePeriod(2);
+    s.setNbrOfCycles(N);
+    for (int64_t t = 1000LL * T0; s.getCycle() < N; t += 1000)
+    {
+        ScheduleCore::Step step = s.next(t);
+        if (step.action == ScheduleCore::FIRE) s.fired(t);
+        sink += step.action;
+    }
+    return N;
+}
+
+/**
+ * Timers with intervals of 1 s .. 1 h and daily windows of 1 .. 24 h,
+ * each callback takes 0 .. 50 ms of the fake clock
+*/
+static uint64_t benchDispatch(int n)
+{
+    using Wake = std::pair<int64_t, int>;
+    std::mt19937 rng(n);
+    std::vector<ScheduleCore> timers(n);
+    std::vector<int> cost(n);
+    std::priority_queue<Wake, std::vector<Wake>, std::greater<Wake>> queue;
+    uint64_t firings = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        time_t start = T0 + rng() % 86400;
+        timers[i].setStart(start);
+        timers[i].setStop(start + 3600 + rng() % (23 * 3600));
+        timers[i].setInterval(1 + rng() % 3600);
+        timers[i].setNbrOfCycles(7);
+        cost[i] = rng() % 50;
+        queue.push({ 1000LL * T0, i });
+    }
+    while (! queue.empty())
+    {
+        auto [now, i] = queue.top();
+        queue.pop();
+        if (now > 1000LL * T0 + WEEK_MS) break;
+        ScheduleCore::Step step = timers[i].next(now);
+        if (step.action == ScheduleCore::DONE) continue;
+        if (step.action == ScheduleCore::FIRE)
+        {
+            firings++;
+            timers[i].fired(now + cost[i]);
+            queue.push({ now + cost[i], i });
+        }
+        else
+        {
+            queue.push({ now + step.waitMs, i });
+        }
+    }
+    sink += firings;
+    return firings;
+}
+
+static std::map<std::string, double> readBaseline(const char path[])
+{
+    std::map<std::string, double> baseline;
+    char line[256], name[64];
+    int n;
+    unsigned long long ops;
+    double ns;
+
+    FILE *f = fopen(path, "r");
+    if (! f) return baseline;
+    while (fgets(line, sizeof(line), f))
+    {
+        if (sscanf(line, "%63[^,],%d,%llu,%lf", name, &n, &ops, &ns) == 4) baseline[std::string(name) + "/" + std::to_string(n)] = ns;
+    }
+    fclose(f);
+    return baseline;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<Result> results;
+    double maxRatio = argc > 2 ? atof(argv[2]) : 1.5;
+    int rc = 0;
+
+    setenv("TZ", "CET-1CEST,M3.5.0,M10.5.0/3", 1);
+    tzset();
+
+    results.push_back(measure("parse", 1, benchParse));
+    results.push_back(measure("next", 1, benchNext));
+    results.push_back(measure("advance", 1, benchAdvance));
+    for (int n : { 1, 10, 100, 1000, 10000 })
+    {
+        results.push_back(measure("dispatch", n, [n]() { return benchDispatch(n); }));
+    }
+
+    std::map<std::string, double> baseline;
+    if (argc > 1) baseline = readBaseline(argv[1]);
+    printf("benchmark,n,ops,ns_per_op%s\n", baseline.empty() ? "" : ",baseline_ns_per_op,ratio");
+    for (const Result &r : results)
+    {
+        printf("%s,%d,%llu,%.1f", r.name.c_str(), r.n, static_cast<unsigned long long>(r.ops), r.nsPerOp);
+        auto b = baseline.find(r.name + "/" + std::to_string(r.n));
+        if (b != baseline.end())
+        {
+            double ratio = r.nsPerOp / b->second;
+            printf(",%.1f,%.2f", b->second, ratio);
+            if (ratio > maxRatio) rc = 1;
+        }
+        printf("\n");
+    }
+    if (rc) fprintf(stderr, "regression: a benchmark is more than %.2f times slower than the baseline\n", maxRatio);
+    return rc;
+}
@@ -0,0 +1,66 @@
+/**
+ * Program      sharpnessBench.cpp
+ * 
+ * Purpose      Host benchmark of the sharpness kernels. Measures the throughput
+ *              of the SWAR and the scalar Laplacian variance on synthetic images
+ *              of the sizes a burst frame is decoded to (1/4 and 1/2 of UXGA),
+ *              and checks that both kernels give the same score.
+ * 
+ * Build        pio run -e sharpness_bench -t exec
+ * 
+ * Output       One CSV line per image size and kernel: 
+ *              kernel,width,height,score,mpixel_per_s
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "Sharpness.hpp"
+
+using Kernel = float(*)(const uint8_t *gray, int width, int height, int stride);
+
+static double mpixelPerSec(Kernel kernel, const std::vector<uint8_t> &img, int w, int h, float &score)
+{
+    int repeats = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    auto t1 = t0;
+    do
+    {
+        score = kernel(img.data(), w, h, w);
+        repeats++;
+        t1 = std::chrono::steady_clock::now();
+    } while (t1 - t0 < std::chrono::milliseconds(500));
+    double secs = std::chrono::duration<double>(t1 - t0).count();
+    return static_cast<double>(w) * h * repeats / secs / 1e6;
+}
+
+int main()
+{
+    const int sizes[][2] = { { 400, 300 }, { 800, 600 }, { 1600, 1200 } };
+    int rc = 0;
+
+    srand(1);
+    printf("kernel,width,height,score,mpixel_per_s\n");
+    for (auto &s : sizes)
+    {
+        int w = s[0];
+        int h = s[1];
+        std::vector<uint8_t> img(w * h);
+        for (int y = 0; y < h; y++)
+            for (int x = 0; x < w; x++)
+                img[y * w + x] = ((x / 8 + y / 8) & 1 ? 160 : 90) + rand() % 32;  // texture plus noise
+
+        float swar, scalar;
+        double rateSwar   = mpixelPerSec(Sharpness::laplacianVariance, img, w, h, swar);
+        double rateScalar = mpixelPerSec(Sharpness::laplacianVarianceScalar, img, w, h, scalar);
+        printf("swar,%d,%d,%.2f,%.1f\n", w, h, swar, rateSwar);
+        printf("scalar,%d,%d,%.2f,%.1f\n", w, h, scalar, rateScalar);
+        if (swar != scalar)
+        {
+            fprintf(stderr, "score mismatch at %dx%d: %f != %f\n", w, h, swar, scalar);
+            rc = 1;
+        }
+    }
+    return rc;
+}
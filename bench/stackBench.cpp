@@ -0,0 +1,95 @@
+/**
+ * Program      stackBench.cpp
+ * 
+ * Purpose      Host benchmark and noise reduction evaluation of the frame stack.
+ *              Measures the accumulate throughput of the SWAR and the scalar
+ *              kernel on a SVGA grayscale frame, then stacks 1 to 16 frames of a
+ *              synthetic scene with gaussian noise (sigma 20, like a dark scene
+ *              at high gain) and reports the noise left and the PSNR.
+ * 
+ * Build        pio run -e stack_bench -t exec
+ * 
+ * Output       CSV lines for the throughput (kernel,mpixel_per_s) 
+ *              and the noise (frames,noise_sigma,psnr_db)
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "FrameStack.hpp"
+
+const int WIDTH  = 800;
+const int HEIGHT = 600;
+const int PIXELS = WIDTH * HEIGHT;
+
+using AddKernel = bool (FrameStack::*)(const uint8_t *frame);
+
+static double mpixelPerSec(FrameStack &stack, AddKernel add, const std::vector<uint8_t> &frame)
+{
+    int repeats = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    auto t1 = t0;
+    do
+    {
+        if (stack.getCount() == FrameStack::MAX_FRAMES) stack.clear();
+        (stack.*add)(frame.data());
+        repeats++;
+        t1 = std::chrono::steady_clock::now();
+    } while (t1 - t0 < std::chrono::milliseconds(500));
+    double secs = std::chrono::duration<double>(t1 - t0).count();
+    return static_cast<double>(PIXELS) * repeats / secs / 1e6;
+}
+
+int main()
+{
+    std::vector<uint32_t> acc(PIXELS / 2);
+    std::vector<uint8_t>  scene(PIXELS);
+    std::vector<uint8_t>  frame(PIXELS);
+    std::vector<uint8_t>  out(PIXELS);
+    std::mt19937 rng(1);
+    std::normal_distribution<float> noise(0.0f, 20.0f);
+    FrameStack stack;
+    int rc = 0;
+
+    // dark scene: smooth gradient with a few bright objects
+    for (int y = 0; y < HEIGHT; y++)
+        for (int x = 0; x < WIDTH; x++)
+            scene[y * WIDTH + x] = 30 + 40 * x / WIDTH + ((x / 100 + y / 100) % 3 == 0 ? 60 : 0);
+
+    stack.init(acc.data(), PIXELS);
+    printf("kernel,mpixel_per_s\n");
+    printf("swar,%.1f\n", mpixelPerSec(stack, &FrameStack::add, scene));
+    stack.clear();
+    printf("scalar,%.1f\n", mpixelPerSec(stack, &FrameStack::addScalar, scene));
+
+    printf("frames,noise_sigma,psnr_db\n");
+    for (int n = 1; n <= 16; n *= 2)
+    {
+        std::vector<uint32_t> accRef(PIXELS / 2);
+        FrameStack reference;
+        reference.init(accRef.data(), PIXELS);
+        stack.clear();
+        for (int f = 0; f < n; f++)
+        {
+            for (int i = 0; i < PIXELS; i++)
+            {
+                frame[i] = static_cast<uint8_t>(fminf(fmaxf(scene[i] + noise(rng) + 0.5f, 0.0f), 255.0f));
+            }
+            stack.add(frame.data());
+            reference.addScalar(frame.data());
+        }
+        if (acc != accRef)
+        {
+            fprintf(stderr, "accumulator mismatch after %d frames\n", n);
+            rc = 1;
+        }
+        stack.average(out.data());
+        double sumSq = 0;
+        for (int i = 0; i < PIXELS; i++) sumSq += (out[i] - scene[i]) * (out[i] - scene[i]);
+        double mse = sumSq / PIXELS;
+        printf("%d,%.2f,%.2f\n", n, sqrt(mse), 10 * log10(255.0 * 255.0 / mse));
+    }
+    return rc;
+}
@@ -0,0 +1,222 @@
+/**
+ * Program      stagingBench.cpp
+ * 
+ * Purpose      Host benchmark and power cut check of the flash staging ring.
+ *              The flash is emulated by a file with NOR semantics (erase sets
+ *              the bits of whole sectors, writes can only clear bits) and the
+ *              geometry of the default spiffs partition of the ESP32 (1472 KB,
+ *              4 KB sectors). Besides the host time, the time the ESP32 flash
+ *              would need is estimated from the bytes written and the sectors
+ *              erased (typical values of the flash datasheets).
+ *                - staging: append photos of 60..160 KB, latency per photo
+ *                - migration: copy the staged photos to files (the bulk tier)
+ *                  and remove them from the ring, throughput
+ *                - power cut: cut the power after a random number of written
+ *                  bytes, mount again and check that all committed photos
+ *                  survived unchanged and the torn one is dropped
+ * 
+ * Build        pio run -e staging_bench -t exec
+ * 
+ * Output       CSV lines (phase,records,bytes,host_ms,flash_ms,mbyte_per_s)
+ *              and the result of the power cut check (cuts,recovered,lost)
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "StagingRing.hpp"
+
+const size_t PARTITION   = 1472 * 1024;
+const size_t SECTOR      = 4096;
+const double PROGRAM_US_PER_BYTE = 1.2;    // page program 0.3 ms per 256 bytes + overhead
+const double ERASE_US_PER_SECTOR = 45000;  // sector erase
+
+/**
+ * File-backed NOR flash. A power cut can be armed: the write 
+ * crossing the budget is torn and all later accesses fail.
+*/
+class FileFlash : public FlashDevice
+{
+    public:
+        FileFlash(size_t size, size_t sectorSize) : _size(size), _sectorSize(sectorSize)
+        {
+            std::vector<uint8_t> erased(size, 0xFF);
+            _file = std::tmpfile();
+            fwrite(erased.data(), 1, size, _file);
+        }
+        ~FileFlash() { fclose(_file); }
+
+        size_t getSize() override { return _size; }
+        size_t getSectorSize() override { return _sectorSize; }
+
+        bool read(size_t addr, void *buf, size_t len) override
+        {
+            if (_cut || addr + len > _size) return false;
+            fseek(_file, addr, SEEK_SET);
+            return fread(buf, 1, len, _file) == len;
+        }
+
+        bool write(size_t addr, const void *buf, size_t len) override
+        {
+            if (_cut || addr + len > _size) return false;
+            size_t n = len;
+            if (_budget < len) { n = _budget; _cut = true; }
+            _budget -= n;
+
+            std::vector<uint8_t> old(n);
+            const uint8_t *p = static_cast<const uint8_t *>(buf);
+            fseek(_file, addr, SEEK_SET);
+            fread(old.data(), 1, n, _file);
+            for (size_t i = 0; i < n; i++) old[i] &= p[i];
+            fseek(_file, addr, SEEK_SET);
+            fwrite(old.data(), 1, n, _file);
+            _written += n;
+            return ! _cut;
+        }
+
+        bool erase(size_t addr, size_t len) override
+        {
+            if (_cut || addr % _sectorSize || len % _sectorSize || addr + len > _size) return false;
+            std::vector<uint8_t> erased(len, 0xFF);
+            fseek(_file, addr, SEEK_SET);
+            fwrite(erased.data(), 1, len, _file);
+            _erased += len / _sectorSize;
+            return true;
+        }
+
+        void cutAfter(size_t bytes) { _budget = bytes; }
+        void powerOn() { _cut = false; _budget = SIZE_MAX; }
+        double flashMs() { return (_written * PROGRAM_US_PER_BYTE + _erased * ERASE_US_PER_SECTOR) / 1000.0; }
+        void resetStats() { _written = 0; _erased = 0; }
+
+    private:
+        FILE   *_file;
+        size_t  _size;
+        size_t  _sectorSize;
+        size_t  _budget  = SIZE_MAX;
+        bool    _cut     = false;
+        size_t  _written = 0;
+        size_t  _erased  = 0;
+};
+
+using Photo = struct { char name[32]; std::vector<uint8_t> data; };
+
+static Photo makePhoto(std::mt19937 &rng, uint32_t nbr)
+{
+    Photo photo;
+    snprintf(photo.name, sizeof(photo.name), "/photo%05u.jpg", nbr);
+    photo.data.resize(60 * 1024 + rng() % (100 * 1024));
+    for (auto &b : photo.data) b = rng();
+    return photo;
+}
+
+static double msSince(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+/**
+ * Copy all records to files and remove them from the ring,
+ * returns false if a record differs from the photo staged
+*/
+static bool migrate(StagingRing &ring, std::vector<Photo> &staged, size_t &bytes)
+{
+    std::vector<uint8_t> buf(SECTOR);
+    char   name[StagingRing::MAX_NAME + 1];
+    size_t len;
+
+    while (ring.peek(name, len))
+    {
+        std::vector<uint8_t> data(len);
+        for (size_t offset = 0; offset < len; offset += buf.size())
+        {
+            size_t n = std::min(buf.size(), len - offset);
+            if (! ring.read(offset, buf.data(), n)) return false;
+            memcpy(data.data() + offset, buf.data(), n);
+        }
+        FILE *file = std::tmpfile();
+        fwrite(data.data(), 1, len, file);
+        fclose(file);
+
+        if (staged.empty() || strcmp(staged.front().name, name) || staged.front().data != data) return false;
+        staged.erase(staged.begin());
+        bytes += len;
+        if (! ring.pop()) return false;
+    }
+    return staged.empty();
+}
+
+int main()
+{
+    std::mt19937 rng(1);
+    std::vector<Photo> staged;
+    FileFlash   flash(PARTITION, SECTOR);
+    StagingRing ring;
+    uint32_t    nbr = 0;
+    double      maxMs = 0;
+    size_t      bytes = 0;
+    int         rc = 0;
+
+    if (! ring.mount(&flash)) { printf("mount failed\n"); return 1; }
+    printf("phase,records,bytes,host_ms,flash_ms,mbyte_per_s\n");
+
+    // staging: fill the ring
+    auto t0 = std::chrono::steady_clock::now();
+    flash.resetStats();
+    while (true)
+    {
+        Photo photo = makePhoto(rng, nbr++);
+        if (photo.data.size() > ring.getFree()) break;
+        auto t1 = std::chrono::steady_clock::now();
+        if (! ring.append(photo.name, photo.data.data(), photo.data.size())) { printf("append failed\n"); return 1; }
+        maxMs = std::max(maxMs, msSince(t1));
+        bytes += photo.data.size();
+        staged.push_back(std::move(photo));
+    }
+    printf("staging,%zu,%zu,%.2f,%.1f,%.3f\n", staged.size(), bytes, msSince(t0), flash.flashMs(),
+           bytes / (flash.flashMs() * 1000.0));
+    printf("# flash latency per photo %.1f ms (mean), host max %.2f ms\n", flash.flashMs() / staged.size(), maxMs);
+
+    // migration: empty the ring, the sectors are erased here and not when staging
+    size_t nbrOfRecords = staged.size();
+    t0 = std::chrono::steady_clock::now();
+    flash.resetStats();
+    bytes = 0;
+    if (! migrate(ring, staged, bytes)) { printf("migration failed\n"); return 1; }
+    printf("migration,%zu,%zu,%.2f,%.1f,%.3f\n", nbrOfRecords, bytes, msSince(t0), flash.flashMs(),
+           bytes / (flash.flashMs() * 1000.0));
+
+    // power cuts: stage a few photos, cut during the next one, mount again
+    int cuts = 0, recovered = 0, lost = 0;
+    for (int i = 0; i < 50; i++)
+    {
+        for (int k = 0; k < 2; k++)
+        {
+            Photo photo = makePhoto(rng, nbr++);
+            if (photo.data.size() > ring.getFree()) break;
+            if (! ring.append(photo.name, photo.data.data(), photo.data.size())) { rc = 1; break; }
+            staged.push_back(std::move(photo));
+        }
+        Photo torn = makePhoto(rng, nbr++);
+        flash.cutAfter(rng() % (torn.data.size() + 64));
+        ring.append(torn.name, torn.data.data(), torn.data.size());
+        flash.powerOn();
+        cuts++;
+
+        StagingRing after;
+        if (! after.mount(&flash) || after.getNbrOfRecords() != staged.size()) { lost++; rc = 1; break; }
+        recovered += staged.size();
+        ring = after;
+
+        // migrate now and then, so the ring wraps around
+        if (i % 3 == 2)
+        {
+            bytes = 0;
+            if (! migrate(ring, staged, bytes)) { lost++; rc = 1; break; }
+        }
+    }
+    printf("cuts,recovered,lost\n%d,%d,%d\n", cuts, recovered, lost);
+    return rc;
+}
@@ -0,0 +1,112 @@
+/**
+ * Program      streamStatsBench.cpp
+ *
+ * Purpose      Host benchmark of the StreamStats kernel: ns per sample for
+ *              decimation 1, 16 and 64, fed with DMA sized buffers of 256
+ *              12 bit samples (a sine with noise, channel bits set in the upper
+ *              nibble as in the I2S ADC mode). Each result is the best of 5 runs
+ *              of at least 100 ms. The records are checked against the same
+ *              statistics computed naively in double, else the exit code is 1.
+ *
+ * Build        pio run -e stream_stats_bench -t exec
+ *
+ * Output       CSV lines (decimation,samples,ns_per_sample,msamples_per_s)
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "StreamStats.hpp"
+
+const int      RUNS        = 5;
+const size_t   BUF_SAMPLES = 256;
+const size_t   NBR_SAMPLES = 1 << 16;
+const uint16_t CHANNEL     = 6 << 12;
+
+static std::vector<uint16_t> makeSamples()
+{
+    std::vector<uint16_t> s(NBR_SAMPLES);
+
+    srand(1);
+    for (size_t i = 0; i < NBR_SAMPLES; i++)
+    {
+        double v = 2048 + 1500 * sin(i * 0.01) + (rand() % 201 - 100);
+        s[i] = CHANNEL | static_cast<uint16_t>(v);
+    }
+    return s;
+}
+
+static bool near(double a, double b, double tol) { return fabs(a - b) <= tol * fmax(1.0, fabs(b)); }
+
+/**
+ * The record of n samples compared with the statistics in double
+*/
+static bool check(const std::vector<uint16_t> &s, size_t n, uint32_t decimation, const SampleRecord &rec)
+{
+    double sum = 0, sumSq = 0, lo = 1e9, hi = -1e9;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        double v = s[i] & 0x0FFF;
+        sum   += v;
+        sumSq += v * v;
+    }
+    for (size_t b = 0; b + decimation <= n; b += decimation)
+    {
+        double m = 0;
+        for (size_t i = b; i < b + decimation; i++) m += s[i] & 0x0FFF;
+        lo = fmin(lo, m / decimation);
+        hi = fmax(hi, m / decimation);
+    }
+    double mean = sum / n;
+    double rms  = sqrt(sumSq / n);
+    double ac   = sqrt(sumSq / n - mean * mean);
+    return rec.count == n && near(rec.mean, mean, 1e-6) && near(rec.rms, rms, 1e-6) && near(rec.acRms, ac, 1e-4)
+           && near(rec.min, lo, 1e-6) && near(rec.max, hi, 1e-6);
+}
+
+int main()
+{
+    std::vector<uint16_t> samples = makeSamples();
+    const uint32_t        decimations[] = { 1, 16, 64 };
+    bool                  ok = true;
+    StreamStats           stats;
+
+    printf("decimation,samples,ns_per_sample,msamples_per_s\n");
+    for (uint32_t d : decimations)
+    {
+        double       best = 1e9;
+        uint64_t     n    = 0;
+        SampleRecord rec;
+
+        stats.init(d, 0x0FFF);
+        for (size_t i = 0; i < NBR_SAMPLES; i += BUF_SAMPLES) stats.add(&samples[i], BUF_SAMPLES);
+        rec = stats.take();
+        if (! check(samples, NBR_SAMPLES, d, rec))
+        {
+            printf("# fail: decimation %u, mean %.3f rms %.3f ac %.3f min %.3f max %.3f\n", d, rec.mean, rec.rms,
+                   rec.acRms, rec.min, rec.max);
+            ok = false;
+        }
+
+        for (int r = 0; r < RUNS; r++)
+        {
+            uint64_t runSamples = 0;
+            auto     t0         = std::chrono::steady_clock::now();
+            double   ns;
+            do
+            {
+                for (size_t i = 0; i < NBR_SAMPLES; i += BUF_SAMPLES) stats.add(&samples[i], BUF_SAMPLES);
+                n += stats.take().count;
+                runSamples += NBR_SAMPLES;
+                ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+            }
+            while (ns < 1e8);
+            best = fmin(best, ns / runSamples);
+        }
+        printf("%u,%llu,%.3f,%.1f\n", d, static_cast<unsigned long long>(n), best, 1e3 / best);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,211 @@
+/**
+ * Program      timeSeriesBench.cpp
+ *
+ * Purpose      Host benchmark of the TimeSeries store on a block device in
+ *              memory: compression ratio and query speed for 30 days of 3
+ *              series every 10 s (259200 points, the time jittered by a few ms).
+ *              Data sets:
+ *                - sensors: light level (exposure index, 3 digits), temperature
+ *                           (0.1 degree) and battery voltage (mV), slowly changing
+ *                - noisy:   the same with a noise of 0.1 % on each value, so all
+ *                           bits of the mantissa change
+ *              The sizes are compared with binary records (time and floats) and
+ *              with a CSV line of text per point. Queries of 1 hour, 1 day and
+ *              7 days at random times report the time per query and the blocks
+ *              read. All points are read back and compared bit for bit, the store
+ *              is mounted again and continued, and the queries are checked
+ *              against a filter of all points, else the exit code is 1.
+ *
+ * Build        pio run -e time_series_bench -t exec
+ *
+ * Output       Two CSV tables one after the other, each with its header: the
+ *              compression (data,points,blocks,ratio_binary,ratio_text,bits_per_point,
+ *              append_ns_per_point) and the queries (data,range_h,queries,
+ *              points_per_query,blocks_per_query,us_per_query)
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "TimeSeries.hpp"
+
+const uint32_t NBR_POINTS  = 30 * 24 * 360;
+const int64_t  INTERVAL_MS = 10000;
+const int64_t  T0_MS       = 1700000000000LL;
+const int      NBR_SERIES  = 3;
+const int      NBR_QUERIES = 200;
+
+/**
+ * Block device in memory
+*/
+class MemoryBlocks : public BlockDevice
+{
+    public:
+        MemoryBlocks(uint32_t nbrOfBlocks) : _data(static_cast<size_t>(nbrOfBlocks) * BLOCK_SIZE) {}
+
+        uint32_t getNbrOfBlocks() override { return _data.size() / BLOCK_SIZE; }
+
+        bool readBlocks(uint32_t lba, void *buf, uint32_t n) override
+        {
+            if (lba + n > getNbrOfBlocks()) return false;
+            memcpy(buf, &_data[static_cast<size_t>(lba) * BLOCK_SIZE], static_cast<size_t>(n) * BLOCK_SIZE);
+            return true;
+        }
+
+        bool writeBlocks(uint32_t lba, const void *buf, uint32_t n) override
+        {
+            if (lba + n > getNbrOfBlocks()) return false;
+            memcpy(&_data[static_cast<size_t>(lba) * BLOCK_SIZE], buf, static_cast<size_t>(n) * BLOCK_SIZE);
+            return true;
+        }
+
+    private:
+        std::vector<uint8_t> _data;
+};
+
+using Point = struct pnt { int64_t timeMs; float values[NBR_SERIES]; };
+
+// of a query: the points expected, the index of the next one and the mismatches
+using Check = struct chck { const std::vector<Point> *points; size_t next; uint32_t errors; };
+
+static std::vector<Point> makePoints(bool noisy)
+{
+    std::vector<Point> points(NBR_POINTS);
+
+    srand(1);
+    for (uint32_t i = 0; i < NBR_POINTS; i++)
+    {
+        double day = fmod(i * INTERVAL_MS / 86400000.0, 1.0);
+        double sun = fmax(0.0, sin(2 * M_PI * (day - 0.25)));
+        points[i].timeMs    = T0_MS + i * INTERVAL_MS + rand() % 7 - 3;
+        points[i].values[0] = roundf(20 + 980 * sun);
+        points[i].values[1] = roundf(10 * (12 + 8 * sun + (rand() % 3 - 1) * 0.1)) / 10;
+        points[i].values[2] = roundf(4150 - i * 0.002f) / 1000;
+        if (noisy)
+        {
+            for (float &v : points[i].values) v *= 1 + (rand() % 2001 - 1000) * 1e-6f;
+        }
+    }
+    return points;
+}
+
+static bool same(const float a[], const float b[]) { return memcmp(a, b, NBR_SERIES * sizeof(float)) == 0; }
+
+static bool checkPoint(int64_t timeMs, const float values[], void *ctx)
+{
+    Check       *c = static_cast<Check *>(ctx);
+    const Point &p = (*c->points)[c->next++];
+
+    if (p.timeMs != timeMs || ! same(p.values, values)) c->errors++;
+    return true;
+}
+
+static size_t firstAtOrAfter(const std::vector<Point> &points, int64_t timeMs)
+{
+    size_t lo = 0, hi = points.size();
+
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (points[mid].timeMs < timeMs) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * Compare the points of the range with those of the store
+*/
+static bool checkRange(TimeSeries &ts, const std::vector<Point> &points, int64_t fromMs, int64_t toMs)
+{
+    Check    c     = { &points, firstAtOrAfter(points, fromMs), 0 };
+    size_t   end   = firstAtOrAfter(points, toMs + 1);
+    uint32_t n     = ts.query(fromMs, toMs, checkPoint, &c);
+
+    return c.errors == 0 && n == end - firstAtOrAfter(points, fromMs);
+}
+
+/**
+ * Print the line of the compression and add those of the queries to
+ * queryLines, printed after the compression of all data sets
+*/
+static bool run(const char name[], bool noisy, std::string &queryLines)
+{
+    std::vector<Point> points = makePoints(noisy);
+    MemoryBlocks       dev(NBR_POINTS / 8);
+    TimeSeries         ts;
+    size_t             text = 0;
+    bool               ok   = true;
+    char               line[80];
+
+    if (! ts.format(&dev, NBR_SERIES)) return false;
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < NBR_POINTS / 2; i++) ok &= ts.append(points[i].timeMs, points[i].values);
+    ok &= ts.flush();
+
+    // mount again in the middle and continue the last block
+    TimeSeries again;
+    ok &= again.mount(&dev) && again.getNbrOfPoints() == NBR_POINTS / 2;
+    for (uint32_t i = NBR_POINTS / 2; i < NBR_POINTS; i++) ok &= again.append(points[i].timeMs, points[i].values);
+    double appendNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    if (! ok) printf("# fail: %s, append or mount\n", name);
+
+    for (const Point &p : points)
+    {
+        text += snprintf(line, sizeof(line), "%lld,%.0f,%.1f,%.3f\n", static_cast<long long>(p.timeMs),
+                         p.values[0], p.values[1], p.values[2]);
+    }
+    if (! checkRange(again, points, points.front().timeMs, points.back().timeMs))
+    {
+        printf("# fail: %s, points read back differ\n", name);
+        ok = false;
+    }
+    uint64_t stored = static_cast<uint64_t>(again.getUsedBlocks()) * BlockDevice::BLOCK_SIZE;
+    printf("%s,%u,%u,%.2f,%.2f,%.1f,%.1f\n", name, again.getNbrOfPoints(), again.getUsedBlocks(),
+           again.getCompressionRatio(), static_cast<double>(text) / stored, 8.0 * stored / NBR_POINTS,
+           appendNs / NBR_POINTS);
+
+    for (int64_t rangeH : { 1, 24, 168 })
+    {
+        int64_t  rangeMs = rangeH * 3600000;
+        uint64_t blocks  = 0;
+        uint64_t found   = 0;
+        double   us      = 0;
+
+        for (int q = 0; q < NBR_QUERIES; q++)
+        {
+            int64_t fromMs = T0_MS + (rand() % (NBR_POINTS - rangeMs / INTERVAL_MS)) * INTERVAL_MS + rand() % INTERVAL_MS;
+            Check   c      = { &points, firstAtOrAfter(points, fromMs), 0 };
+            auto    t1     = std::chrono::steady_clock::now();
+            found  += again.query(fromMs, fromMs + rangeMs, checkPoint, &c);
+            us     += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t1).count();
+            blocks += again.getBlocksRead();
+            if (c.errors || ! checkRange(again, points, fromMs, fromMs + rangeMs))
+            {
+                printf("# fail: %s, query of %lld h at %lld\n", name, static_cast<long long>(rangeH),
+                       static_cast<long long>(fromMs));
+                ok = false;
+            }
+        }
+        snprintf(line, sizeof(line), "%s,%lld,%d,%.0f,%.1f,%.1f\n", name, static_cast<long long>(rangeH), NBR_QUERIES,
+                 static_cast<double>(found) / NBR_QUERIES, static_cast<double>(blocks) / NBR_QUERIES, us / NBR_QUERIES);
+        queryLines += line;
+    }
+    return ok;
+}
+
+int main()
+{
+    bool        ok = true;
+    std::string queryLines;
+
+    printf("data,points,blocks,ratio_binary,ratio_text,bits_per_point,append_ns_per_point\n");
+    ok &= run("sensors", false, queryLines);
+    ok &= run("noisy", true, queryLines);
+    printf("\ndata,range_h,queries,points_per_query,blocks_per_query,us_per_query\n%s", queryLines.c_str());
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+/**
+ * Program      timerLatencyBench.cpp
+ * 
+ * Purpose      Measures on the ESP32 how late and how regularly StartStopTimer
+ *              calls its callback, in standardized scenarios:
+ *                - idle:  nothing else running
+ *                - wifi:  WiFi scanning continuously (radio and its task busy)
+ *                - flash: a task erasing and writing the spiffs partition
+ *                         (the flash cache is disabled meanwhile)
+ *                - both:  wifi and flash together
+ *              Each scenario runs a timer with an interval of 100 ms for 200
+ *              firings. The callback takes its start time with esp_timer and
+ *              the cycle counter (CCOUNT) of its core. The latency of a firing
+ *              is its start minus the end of the previous callback plus the
+ *              interval, as the interval counts from the end of the callback.
+ *              Each scenario runs without and with the latency compensation
+ *              (suffix _comp), which wakes the timer early by its learned
+ *              lateness; the first 50 firings with it are left out as warm-up.
+ * 
+ * Build        pio run -e timer_bench -t upload -t monitor
+ *              The spiffs partition is overwritten by the flash scenario.
+ * 
+ * Output       Compact lines, summarized by tools/timerBenchSummary.py:
+ *                B,scenario,interval_ms,cpu_mhz     begin of a scenario
+ *                F,firing,latency_us,ccount,core    one per firing
+ *                E,scenario                          end of a scenario
+*/
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_partition.h>
+#include <esp_timer.h>
+#include "StartStopTimer.hpp"
+
+const uint32_t INTERVAL_MS   = 100;
+const uint32_t NBR_OF_FIRINGS = 200;
+const uint32_t WARMUP_FIRINGS = 50;    // the compensator learns meanwhile
+
+using Firing = struct { int64_t startUs; int64_t endUs; uint32_t ccount; uint8_t core; };
+
+Firing           firings[NBR_OF_FIRINGS];
+volatile uint32_t nbrOfFirings = 0;
+volatile bool    loadRunning  = false;
+uint8_t          flashBuf[4096];
+
+void record()
+{
+  uint32_t i = nbrOfFirings;
+  if (i >= NBR_OF_FIRINGS) return;
+  firings[i].ccount  = ESP.getCycleCount();
+  firings[i].startUs = esp_timer_get_time();
+  firings[i].core    = xPortGetCoreID();
+  firings[i].endUs   = esp_timer_get_time();
+  nbrOfFirings = i + 1;
+}
+
+void wifiLoad(void *)
+{
+  WiFi.mode(WIFI_STA);
+  while (loadRunning)
+  {
+    WiFi.scanNetworks();
+    WiFi.scanDelete();
+  }
+  WiFi.mode(WIFI_OFF);
+  vTaskDelete(nullptr);
+}
+
+void flashLoad(void *)
+{
+  const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "spiffs");
+  size_t addr = 0;
+
+  while (loadRunning && part)
+  {
+    esp_partition_erase_range(part, addr, sizeof(flashBuf));
+    esp_partition_write(part, addr, flashBuf, sizeof(flashBuf));
+    addr = (addr + sizeof(flashBuf)) % part->size;
+    vTaskDelay(1);
+  }
+  vTaskDelete(nullptr);
+}
+
+void runScenario(const char name[], bool wifi, bool flash, bool compensate)
+{
+  StartStopTimer timer;
+  time_t   now   = time(nullptr);
+  uint32_t first = compensate ? WARMUP_FIRINGS : 1;
+
+  loadRunning = true;
+  if (wifi)  xTaskCreatePinnedToCore(wifiLoad, "wifiLoad", 4096, nullptr, 1, nullptr, 0);
+  if (flash) xTaskCreatePinnedToCore(flashLoad, "flashLoad", 2048, nullptr, 1, nullptr, 0);
+  delay(500);
+
+  nbrOfFirings = 0;
+  timer.init(record, 4096, 2);
+  timer.setCompensation(compensate);
+  timer.setCycleStart(now);
+  timer.setCycleStop(now + 2 + NBR_OF_FIRINGS * INTERVAL_MS / 1000 * 2);
+  timer.setIntervalMultiplier(1);   // interval in ms
+  timer.setTaskInterval(INTERVAL_MS);
+  timer.setNbrOfCycles(1);
+  timer.resume();
+  while (nbrOfFirings < NBR_OF_FIRINGS) delay(100);
+  timer.deleteTask();
+  loadRunning = false;
+  delay(1000);                      // let the load tasks end
+
+  Serial.printf("B,%s%s,%u,%u\n", name, compensate ? "_comp" : "", INTERVAL_MS, getCpuFrequencyMhz());
+  for (uint32_t i = first; i < NBR_OF_FIRINGS; i++)
+  {
+    int64_t latency = firings[i].startUs - (firings[i - 1].endUs + 1000LL * INTERVAL_MS);
+    Serial.printf("F,%u,%lld,%u,%u\n", i, latency, firings[i].ccount, firings[i].core);
+  }
+  Serial.printf("E,%s%s\n", name, compensate ? "_comp" : "");
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(1000);
+  for (int compensate = 0; compensate < 2; compensate++)
+  {
+    runScenario("idle", false, false, compensate);
+    runScenario("wifi", true, false, compensate);
+    runScenario("flash", false, true, compensate);
+    runScenario("both", true, true, compensate);
+  }
+  Serial.println("# done");
+}
+
+void loop()
+{
+  vTaskDelete(nullptr);
+}
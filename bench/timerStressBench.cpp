@@ -0,0 +1,119 @@
+/**
+ * Program      timerStressBench.cpp
+ * 
+ * Purpose      Stress run of StartStopTimer on the ESP32 with growing numbers
+ *              of timers with random schedules (ScheduleGen, config STRESS:
+ *              intervals of 50 ms .. 2 s, callbacks busy for 0.5 ms on average,
+ *              5% ten times longer). The same seed gives the same timers as in
+ *              the host simulation with this config. For 1, 2, 4 .. 128 timers
+ *              all timers run for 30 s, then the firings, the lateness of the
+ *              callbacks and the heap used per timer are reported. The run ends
+ *              early when the heap gets short.
+ * 
+ * Build        pio run -e timer_stress -t upload -t monitor
+ * 
+ * Output       CSV lines (timers,firings,expected,firings_per_s,late_mean_ms,
+ *              late_max_ms,heap_per_timer)
+*/
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "StartStopTimer.hpp"
+#include "ScheduleGen.hpp"
+
+const uint32_t SEED        = 1;
+const int      MAX_TIMERS  = 128;
+const uint32_t STACK_DEPTH = 2048;
+const uint32_t RUN_SECONDS = 30;
+const uint32_t MIN_HEAP    = 20000;
+
+using Stats = struct { TimerSpec spec; ScheduleGen costGen; int64_t lastEndUs; uint32_t firings;
+                       int64_t sumLateUs; int64_t maxLateUs; };
+
+StartStopTimer *timers[MAX_TIMERS];
+Stats           stats[MAX_TIMERS];
+volatile int    nbrOfTimers = 0;
+
+/**
+ * Shared by all timers, the timer is found by the handle of the calling task
+*/
+void stressCallback()
+{
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  int i = 0;
+  while (i < nbrOfTimers && timers[i]->getTaskHandle() != self) i++;
+  if (i == nbrOfTimers) return;
+
+  Stats  &s     = stats[i];
+  int64_t start = esp_timer_get_time();
+  if (s.firings)
+  {
+    int64_t late = start - (s.lastEndUs + 1000LL * s.spec.intervalMs);
+    s.sumLateUs += late;
+    s.maxLateUs  = max(s.maxLateUs, late);
+  }
+  s.firings++;
+  delayMicroseconds(s.costGen.cost(s.spec));
+  s.lastEndUs = esp_timer_get_time();
+}
+
+bool runTimers(int n)
+{
+  ScheduleGen gen;
+  uint32_t heapBefore = ESP.getFreeHeap();
+  time_t   now = time(nullptr) + 1;
+
+  gen.init(SEED, ScheduleGen::STRESS);
+  nbrOfTimers = 0;
+  for (int i = 0; i < n; i++)
+  {
+    if (ESP.getFreeHeap() < MIN_HEAP + STACK_DEPTH) break;
+    stats[i] = { gen.next(), ScheduleGen(), 0, 0, 0, 0 };
+    stats[i].costGen.init(SEED + i, ScheduleGen::STRESS);
+    timers[i] = new StartStopTimer();
+    timers[i]->init(stressCallback, STACK_DEPTH, 1);
+    ScheduleGen::apply(stats[i].spec, timers[i]->getSchedule(), now);
+    nbrOfTimers = i + 1;
+  }
+  uint32_t heapPerTimer = nbrOfTimers ? (heapBefore - ESP.getFreeHeap()) / nbrOfTimers : 0;
+
+  for (int i = 0; i < nbrOfTimers; i++) timers[i]->resume();
+  delay(1000 * (RUN_SECONDS + 2));
+
+  uint32_t firings = 0, expected = 0;
+  int64_t  sumLate = 0, maxLate = 0;
+  for (int i = 0; i < nbrOfTimers; i++)
+  {
+    if (timers[i]->getTaskHandle()) timers[i]->deleteTask();
+    firings  += stats[i].firings;
+    expected += timers[i]->getFiringsPerCycle();
+    sumLate  += stats[i].sumLateUs;
+    maxLate   = max(maxLate, stats[i].maxLateUs);
+  }
+  int laterFirings = firings - nbrOfTimers;
+  Serial.printf("%d,%u,%u,%.1f,%.3f,%.3f,%u\n", nbrOfTimers, firings, expected, 
+                static_cast<float>(firings) / RUN_SECONDS, laterFirings > 0 ? sumLate / 1000.0f / laterFirings : 0.0f,
+                maxLate / 1000.0f, heapPerTimer);
+
+  bool complete = nbrOfTimers == n;
+  for (int i = 0; i < nbrOfTimers; i++) delete timers[i];
+  nbrOfTimers = 0;
+  return complete;
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(1000);
+  Serial.println("timers,firings,expected,firings_per_s,late_mean_ms,late_max_ms,heap_per_timer");
+  for (int n = 1; n <= MAX_TIMERS; n *= 2)
+  {
+    if (! runTimers(n)) break;      // heap exhausted
+  }
+  Serial.println("# done");
+}
+
+void loop()
+{
+  vTaskDelete(nullptr);
+}
@@ -0,0 +1,116 @@
+#include "AdcSampler.hpp"
+
+/**
+ * Install the I2S driver in ADC mode for the channel and create the
+ * reader task, the sampling does not start yet. Each sample of the DMA
+ * has 12 bits, the upper bits are the channel and are masked.
+*/
+bool AdcSampler::init(adc1_channel_t channel, uint32_t rateHz, uint32_t decimation, i2s_port_t port)
+{
+    i2s_config_t cfg = {
+        .mode                 = static_cast<i2s_mode_t>(I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN),
+        .sample_rate          = rateHz,
+        .bits_per_sample      = I2S_BITS_PER_SAMPLE_16BIT,
+        .channel_format       = I2S_CHANNEL_FMT_ONLY_LEFT,
+        .communication_format = I2S_COMM_FORMAT_STAND_I2S,
+        .intr_alloc_flags     = 0,
+        .dma_buf_count        = DMA_BUFFERS,
+        .dma_buf_len          = DMA_SAMPLES,
+        .use_apll             = false
+    };
+
+    _port = port;
+    _stats.init(decimation, 0x0FFF);
+    _mutex = xSemaphoreCreateMutex();
+    if (! _mutex || i2s_driver_install(_port, &cfg, 0, nullptr) != ESP_OK)
+    {
+        log_e("I2S driver not installed");
+        return false;
+    }
+    adc1_config_width(ADC_WIDTH_BIT_12);
+    adc1_config_channel_atten(channel, ADC_ATTEN_DB_11);
+    if (i2s_set_adc_mode(ADC_UNIT_1, channel) != ESP_OK
+        || xTaskCreatePinnedToCore(_taskFunction, "sampler", 3072, this, 3, &_task, 1) != pdPASS)
+    {
+        log_e("sampler not created");
+        return false;
+    }
+    log_i("==> done");
+    return true;
+}
+
+/**
+ * Start the DMA and the reader, the first record starts with
+ * the next samples
+*/
+bool AdcSampler::start()
+{
+    if (! _task || _running) return false;
+    i2s_zero_dma_buffer(_port);
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _stats.take();
+    xSemaphoreGive(_mutex);
+    if (i2s_adc_enable(_port) != ESP_OK) return false;
+    _running = true;
+    xTaskNotifyGive(_task);
+    return true;
+}
+
+/**
+ * Stop the DMA, the samples taken so far are kept for takeRecord()
+*/
+void AdcSampler::stop()
+{
+    if (! _running) return;
+    _running = false;
+    i2s_adc_disable(_port);
+}
+
+/**
+ * The aggregate of the samples since the last record. Returns false
+ * if there are none, e.g. if the sampling is stopped.
+*/
+bool AdcSampler::takeRecord(SampleRecord &rec)
+{
+    if (! _mutex) return false;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    rec = _stats.take();
+    xSemaphoreGive(_mutex);
+    return rec.count > 0;
+}
+
+bool AdcSampler::isRunning() { return _running; }
+
+uint32_t AdcSampler::getNbrOfSamples() { return _samples; }
+
+uint32_t AdcSampler::getNbrOfErrors() { return _errors; }
+
+/**
+ * Wait while the sampling is stopped, else hand each DMA buffer to
+ * the statistics. A read ends early when the sampling is stopped,
+ * its samples still count.
+*/
+void AdcSampler::_taskFunction(void *params)
+{
+    AdcSampler *s = static_cast<AdcSampler *>(params);
+
+    for (;;)
+    {
+        if (! s->_running)
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        size_t    bytes = 0;
+        esp_err_t err   = i2s_read(s->_port, s->_buf, sizeof(s->_buf), &bytes, pdMS_TO_TICKS(100));
+        size_t    n     = bytes / sizeof(s->_buf[0]);
+
+        if (err != ESP_OK && s->_running) s->_errors++;
+        if (n == 0) continue;
+        xSemaphoreTake(s->_mutex, portMAX_DELAY);
+        s->_stats.add(s->_buf, n);
+        xSemaphoreGive(s->_mutex);
+        s->_samples += n;
+    }
+}
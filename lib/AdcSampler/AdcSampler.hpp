@@ -0,0 +1,54 @@
+#pragma once
+#include <Arduino.h>
+#include <driver/i2s.h>
+#include <driver/adc.h>
+#include "StreamStats.hpp"
+
+/**
+ * Samples an ADC1 channel at kHz rates with the I2S peripheral in
+ * built-in ADC mode: the DMA fills the buffers, a reader task hands
+ * each buffer to StreamStats, so no sample is taken by the CPU and
+ * none is stored. start() and stop() turn the sampling on and off,
+ * e.g. as the open and close actions of a timer window, and
+ * takeRecord() returns the aggregate of the samples since the last
+ * record, e.g. in the callback of each firing.
+ *
+ * Only I2S0 has the ADC mode, the camera of the ESP32-CAM needs it
+ * as well, and ADC2 does not work in parallel with WiFi. So the
+ * sampler and the camera can not run in the same firmware.
+ *
+ * Example:
+ *      sampler.init(ADC1_CHANNEL_6, 20000, 16);
+ *      timer.setWindowActions(startSampling, stopSampling);
+ *      ...
+ *      SampleRecord rec;
+ *      if (sampler.takeRecord(rec)) log_i("mean %.1f rms %.1f", rec.mean, rec.rms);
+*/
+class AdcSampler
+{
+    public:
+        static const int DMA_BUFFERS = 4;
+        static const int DMA_SAMPLES = 256;     // per DMA buffer
+
+        AdcSampler(){}
+
+        bool init(adc1_channel_t channel, uint32_t rateHz, uint32_t decimation=16, i2s_port_t port=I2S_NUM_0);
+        bool start();
+        void stop();
+        bool takeRecord(SampleRecord &rec);
+        bool isRunning();
+        uint32_t getNbrOfSamples();
+        uint32_t getNbrOfErrors();
+
+    private:
+        i2s_port_t        _port     = I2S_NUM_0;
+        TaskHandle_t      _task     = nullptr;
+        SemaphoreHandle_t _mutex    = nullptr;     // _stats between reader and takeRecord()
+        StreamStats       _stats;
+        uint16_t          _buf[DMA_SAMPLES];
+        volatile bool     _running  = false;
+        uint32_t          _samples  = 0;           // since init
+        uint32_t          _errors   = 0;           // failed reads
+
+        static void       _taskFunction(void *params);
+};
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * Storage addressed in blocks of 512 bytes, e.g. a raw partition of
+ * the SD card on the ESP32 or a card image on the host
+*/
+class BlockDevice
+{
+    public:
+        static const uint32_t BLOCK_SIZE = 512;
+
+        virtual ~BlockDevice(){}
+
+        virtual uint32_t getNbrOfBlocks() = 0;
+        virtual bool readBlocks(uint32_t lba, void *buf, uint32_t n) = 0;
+        virtual bool writeBlocks(uint32_t lba, const void *buf, uint32_t n) = 0;
+};
@@ -0,0 +1,242 @@
+#include <cstring>
+#include <cstddef>
+#include "BlockLog.hpp"
+#include "Crc32.hpp"
+
+/**
+ * Start an empty log. The log id is increased, so the records
+ * left over from the previous log are not mistaken as new ones.
+*/
+bool BlockLog::format(BlockDevice *dev)
+{
+    Super sb;
+
+    _dev   = dev;
+    _logId = 1;
+    for (uint32_t lba = 0; lba < FIRST_RECORD; lba++)
+    {
+        if (_readSuper(lba, sb) && sb.logId >= _logId) _logId = sb.logId + 1;
+    }
+    _generation      = 0;
+    _head            = FIRST_RECORD;
+    _nextSeq         = 0;
+    _sinceCheckpoint = 0;
+    _rolledForward   = 0;
+    return checkpoint() && checkpoint();
+}
+
+/**
+ * Read the newer superblock and roll forward over the records appended
+ * after it. Returns false if there is no log on the device.
+*/
+bool BlockLog::mount(BlockDevice *dev, uint32_t checkpointInterval)
+{
+    Super  sb[FIRST_RECORD];
+    bool   valid[FIRST_RECORD];
+    Header hdr;
+
+    _dev      = dev;
+    _interval = checkpointInterval ? checkpointInterval : 1;
+    for (uint32_t lba = 0; lba < FIRST_RECORD; lba++) valid[lba] = _readSuper(lba, sb[lba]);
+    if (! valid[0] && ! valid[1]) return false;
+
+    const Super &newest = ! valid[1] || (valid[0] && sb[0].generation > sb[1].generation) ? sb[0] : sb[1];
+    _logId           = newest.logId;
+    _generation      = newest.generation;
+    _head            = newest.head;
+    _nextSeq         = newest.nextSeq;
+    _sinceCheckpoint = 0;
+    _rolledForward   = 0;
+
+    while (_readHeader(_head, hdr) && hdr.seq == _nextSeq && _checkData(_head, hdr))
+    {
+        _head += 1 + _blocks(hdr.len);
+        _nextSeq++;
+        _rolledForward++;
+    }
+    _sinceCheckpoint = _rolledForward;     // checkpoint with the next append, the device may be read-only
+    return true;
+}
+
+/**
+ * Append a record: the whole blocks of the data directly from the
+ * buffer, the last partial block and the header block. A checkpoint
+ * is written after every checkpointInterval records.
+*/
+bool BlockLog::append(const char name[], const void *data, size_t len)
+{
+    const uint8_t *p    = static_cast<const uint8_t *>(data);
+    uint32_t       full = len / BlockDevice::BLOCK_SIZE;
+    size_t         rest = len % BlockDevice::BLOCK_SIZE;
+    Header         hdr;
+
+    if (! _dev || strlen(name) > MAX_NAME) return false;
+    if (_head + 1 + _blocks(len) > _dev->getNbrOfBlocks()) return false;
+
+    if (full && ! _dev->writeBlocks(_head + 1, p, full)) return false;
+    if (rest)
+    {
+        memset(_block, 0, sizeof(_block));
+        memcpy(_block, p + len - rest, rest);
+        if (! _dev->writeBlocks(_head + 1 + full, _block, 1)) return false;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic  = MAGIC_RECORD;
+    hdr.logId  = _logId;
+    hdr.seq    = _nextSeq;
+    hdr.len    = len;
+    hdr.crc    = Crc32::compute(data, len);
+    strncpy(hdr.name, name, MAX_NAME);
+    hdr.hdrCrc = Crc32::compute(&hdr, offsetof(Header, hdrCrc));
+    memset(_block, 0, sizeof(_block));
+    memcpy(_block, &hdr, sizeof(hdr));
+    if (! _dev->writeBlocks(_head, _block, 1)) return false;
+
+    _head += 1 + _blocks(len);
+    _nextSeq++;
+    if (++_sinceCheckpoint >= _interval) return checkpoint();
+    return true;
+}
+
+/**
+ * Write the end of the log to the older of the two superblocks
+*/
+bool BlockLog::checkpoint()
+{
+    Super sb = { MAGIC_SUPER, _logId, _generation + 1, _head, _nextSeq, 0 };
+
+    if (! _dev) return false;
+    sb.crc = Crc32::compute(&sb, offsetof(Super, crc));
+    memset(_block, 0, sizeof(_block));
+    memcpy(_block, &sb, sizeof(sb));
+    if (! _dev->writeBlocks(sb.generation % FIRST_RECORD, _block, 1)) return false;
+    _generation = sb.generation;
+    _sinceCheckpoint = 0;
+    return true;
+}
+
+/**
+ * Iterate over the records: first() gets the oldest record,
+ * next() the one following rec. The data is not read.
+*/
+bool BlockLog::first(Record &rec)
+{
+    Header hdr;
+
+    if (_head == FIRST_RECORD || ! _readHeader(FIRST_RECORD, hdr)) return false;
+    rec.lba = FIRST_RECORD;
+    rec.seq = hdr.seq;
+    rec.len = hdr.len;
+    rec.crc = hdr.crc;
+    memcpy(rec.name, hdr.name, sizeof(rec.name));
+    return true;
+}
+
+bool BlockLog::next(Record &rec)
+{
+    Header   hdr;
+    uint32_t lba = rec.lba + 1 + _blocks(rec.len);
+
+    if (lba >= _head || ! _readHeader(lba, hdr)) return false;
+    rec.lba = lba;
+    rec.seq = hdr.seq;
+    rec.len = hdr.len;
+    rec.crc = hdr.crc;
+    memcpy(rec.name, hdr.name, sizeof(rec.name));
+    return true;
+}
+
+/**
+ * Read a part of the data of a record
+*/
+bool BlockLog::read(const Record &rec, size_t offset, void *buf, size_t len)
+{
+    uint8_t *p = static_cast<uint8_t *>(buf);
+
+    if (! _dev || offset + len > rec.len) return false;
+    while (len > 0)
+    {
+        uint32_t lba = rec.lba + 1 + offset / BlockDevice::BLOCK_SIZE;
+        size_t   pos = offset % BlockDevice::BLOCK_SIZE;
+        size_t   n   = len < BlockDevice::BLOCK_SIZE - pos ? len : BlockDevice::BLOCK_SIZE - pos;
+
+        if (! _dev->readBlocks(lba, _block, 1)) return false;
+        memcpy(p, _block + pos, n);
+        p      += n;
+        offset += n;
+        len    -= n;
+    }
+    return true;
+}
+
+uint32_t BlockLog::getNbrOfRecords() { return _nextSeq; }
+
+/**
+ * Records found after the last checkpoint when mounting
+*/
+uint32_t BlockLog::getNbrOfRolledForward() { return _rolledForward; }
+
+/**
+ * Bytes left for the data of further records (each also needs a header block)
+*/
+uint64_t BlockLog::getFree()
+{
+    uint32_t nbrOfBlocks = _dev ? _dev->getNbrOfBlocks() : 0;
+    return nbrOfBlocks > _head + 1 ? static_cast<uint64_t>(nbrOfBlocks - _head - 1) * BlockDevice::BLOCK_SIZE : 0;
+}
+
+/**
+ * Find the first partition of type PARTITION_TYPE in a master boot record
+*/
+bool BlockLog::findPartition(const uint8_t mbr[512], uint32_t &first, uint32_t &count)
+{
+    if (mbr[510] != 0x55 || mbr[511] != 0xAA) return false;
+    for (int i = 0; i < 4; i++)
+    {
+        const uint8_t *entry = mbr + 446 + 16 * i;
+        if (entry[4] != PARTITION_TYPE) continue;
+        first = entry[8]  | entry[9] << 8  | entry[10] << 16 | static_cast<uint32_t>(entry[11]) << 24;
+        count = entry[12] | entry[13] << 8 | entry[14] << 16 | static_cast<uint32_t>(entry[15]) << 24;
+        return count > FIRST_RECORD;
+    }
+    return false;
+}
+
+bool BlockLog::_readSuper(uint32_t lba, Super &sb)
+{
+    if (! _dev->readBlocks(lba, _block, 1)) return false;
+    memcpy(&sb, _block, sizeof(sb));
+    return sb.magic == MAGIC_SUPER && sb.crc == Crc32::compute(&sb, offsetof(Super, crc)) &&
+           sb.head >= FIRST_RECORD && sb.head <= _dev->getNbrOfBlocks();
+}
+
+bool BlockLog::_readHeader(uint32_t lba, Header &hdr)
+{
+    if (lba >= _dev->getNbrOfBlocks() || ! _dev->readBlocks(lba, _block, 1)) return false;
+    memcpy(&hdr, _block, sizeof(hdr));
+    return hdr.magic == MAGIC_RECORD && hdr.logId == _logId && hdr.name[MAX_NAME] == '\0' &&
+           hdr.hdrCrc == Crc32::compute(&hdr, offsetof(Header, hdrCrc)) &&
+           lba + 1 + _blocks(hdr.len) <= _dev->getNbrOfBlocks();
+}
+
+/**
+ * Check the CRC of the data of a record found by rolling forward
+*/
+bool BlockLog::_checkData(uint32_t lba, const Header &hdr)
+{
+    uint32_t crc = 0;
+
+    for (size_t offset = 0; offset < hdr.len; offset += BlockDevice::BLOCK_SIZE)
+    {
+        size_t n = hdr.len - offset < BlockDevice::BLOCK_SIZE ? hdr.len - offset : BlockDevice::BLOCK_SIZE;
+        if (! _dev->readBlocks(lba + 1 + offset / BlockDevice::BLOCK_SIZE, _block, 1)) return false;
+        crc = Crc32::compute(_block, n, crc);
+    }
+    return crc == hdr.crc;
+}
+
+uint32_t BlockLog::_blocks(size_t len)
+{
+    return (len + BlockDevice::BLOCK_SIZE - 1) / BlockDevice::BLOCK_SIZE;
+}
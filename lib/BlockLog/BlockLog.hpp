@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include "BlockDevice.hpp"
+
+/**
+ * Append-only log of files on raw blocks, used instead of a FAT file
+ * system when the capture rate matters more than the convenience of
+ * reading the card in a PC. There are no directory entries or cluster
+ * chains to update, a record is written with at most three commands.
+ *
+ * Layout: blocks 0 and 1 hold two copies of the superblock, written
+ * alternately at each checkpoint, the records follow from block 2.
+ * A record is a header block (name, length, sequence number, CRC) and
+ * the data padded to whole blocks. The header is written after the
+ * data, so a record with a valid header is complete.
+ *
+ * The superblock tells where the log ended at the last checkpoint.
+ * When mounting, the records appended since are found by rolling
+ * forward from there, so checkpoints can be rare. The log id in the
+ * superblock and the headers keeps the records of a previous format
+ * from being taken as new ones.
+ *
+ * Example:
+ *      if (! log.mount(&card)) log.format(&card);
+ *      log.append("/photo00042.jpg", fb->buf, fb->len);
+*/
+class BlockLog
+{
+    public:
+        static const size_t   MAX_NAME        = 39;
+        static const uint8_t  PARTITION_TYPE  = 0xDA;   // MBR type "non-FS data"
+
+        using Record = struct { uint32_t lba; uint32_t seq; uint32_t len; uint32_t crc; char name[MAX_NAME + 1]; };
+
+        BlockLog(){}
+
+        bool format(BlockDevice *dev);
+        bool mount(BlockDevice *dev, uint32_t checkpointInterval=16);
+        bool append(const char name[], const void *data, size_t len);
+        bool checkpoint();
+        bool first(Record &rec);
+        bool next(Record &rec);
+        bool read(const Record &rec, size_t offset, void *buf, size_t len);
+        uint32_t getNbrOfRecords();
+        uint32_t getNbrOfRolledForward();
+        uint64_t getFree();
+        static bool findPartition(const uint8_t mbr[512], uint32_t &first, uint32_t &count);
+
+    private:
+        static const uint32_t MAGIC_SUPER  = 0x31474F4C;  // "LOG1"
+        static const uint32_t MAGIC_RECORD = 0x31434552;  // "REC1"
+        static const uint32_t FIRST_RECORD = 2;
+
+        using Super  = struct { uint32_t magic; uint32_t logId; uint32_t generation; uint32_t head;
+                                uint32_t nextSeq; uint32_t crc; };
+        using Header = struct { uint32_t magic; uint32_t logId; uint32_t seq; uint32_t len; uint32_t crc;
+                                char name[MAX_NAME + 1]; uint32_t hdrCrc; };
+
+        BlockDevice *_dev        = nullptr;
+        uint32_t     _logId      = 0;
+        uint32_t     _generation = 0;    // of the last superblock written
+        uint32_t     _head       = FIRST_RECORD;  // block of the next record
+        uint32_t     _nextSeq    = 0;
+        uint32_t     _interval   = 16;   // records between checkpoints
+        uint32_t     _sinceCheckpoint = 0;
+        uint32_t     _rolledForward   = 0;
+        uint8_t      _block[BlockDevice::BLOCK_SIZE];
+
+        bool         _readSuper(uint32_t lba, Super &sb);
+        bool         _readHeader(uint32_t lba, Header &hdr);
+        bool         _checkData(uint32_t lba, const Header &hdr);
+        uint32_t     _blocks(size_t len);
+};
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * CRC-32 (IEEE 802.3, as used by zip and png) with a 16 entry table,
+ * small enough for the ESP32 and fast enough for checksumming photos.
+ * Pass the previous result as crc to continue over several chunks.
+*/
+class Crc32
+{
+    public:
+        static uint32_t compute(const void *data, size_t len, uint32_t crc=0);
+};
@@ -0,0 +1,78 @@
+#include <cmath>
+#include "Deflicker.hpp"
+
+void Deflicker::init(float alpha, float gain, float maxTarget)
+{
+    _alpha     = alpha;
+    _gain      = gain;
+    _maxTarget = maxTarget;
+    reset();
+}
+
+/**
+ * Feed the luminance of the last frame and get the exposure target
+ * for the next frame relative to the nominal target. The luminance
+ * the sensor would have delivered without correction is averaged,
+ * the next frame is then steered towards this average.
+ *
+ * Only the predictable part of the deviation can be corrected in
+ * advance. The deviation of the next frame is predicted with the lag-1
+ * autocorrelation of the deviations: a hunting auto exposure (negative
+ * correlation) is damped, random deviations of single frames (no
+ * correlation) are left alone.
+*/
+float Deflicker::update(float luma)
+{
+    float raw = luma / _target;
+
+    if (_nbrOfFrames == 0)
+    {
+        _mean = raw;
+    }
+    else
+    {
+        _sumDiff += fabsf(luma - _lastLuma);
+        _mean += _alpha * (raw - _mean);
+    }
+    float dev = raw - _mean;       // deviation from the average
+    _varDev += _alpha * (dev * dev - _varDev);
+    _covDev += _alpha * (dev * _lastDev - _covDev);
+    _lastDev  = dev;
+    _lastLuma = luma;
+    _nbrOfFrames++;
+
+    float rho = _varDev > 0.0f ? fminf(fmaxf(_covDev / _varDev, -1.0f), 1.0f) : 0.0f;
+    float predicted = _mean + rho * dev;
+    if (predicted > 1.0f)
+    {
+        _target = 1.0f + _gain * (_mean / predicted - 1.0f);
+        _target = fminf(fmaxf(_target, 1.0f / _maxTarget), _maxTarget);
+    }
+    return _target;
+}
+
+void Deflicker::reset()
+{
+    _mean        = 0.0f;
+    _target      = 1.0f;
+    _lastLuma    = 0.0f;
+    _lastDev     = 0.0f;
+    _varDev      = 0.0f;
+    _covDev      = 0.0f;
+    _sumDiff     = 0.0f;
+    _nbrOfFrames = 0;
+}
+
+float Deflicker::getMean() { return _mean; }
+
+float Deflicker::getTarget() { return _target; }
+
+/**
+ * Mean absolute luminance change between consecutive frames
+*/
+float Deflicker::getFlicker()
+{
+    return _nbrOfFrames > 1 ? _sumDiff / (_nbrOfFrames - 1) : 0.0f;
+}
+
+uint32_t Deflicker::getNbrOfFrames() { return _nbrOfFrames; }
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * Deflicker controller for time-lapse sequences. It keeps an exponential
+ * moving average of the frame luminance and computes the exposure target
+ * for the next capture, relative to the nominal target of the sensor, so
+ * that the luminance follows the smooth average instead of jumping from
+ * frame to frame.
+ *
+ * The controller has no dependencies on Arduino or the camera, the caller
+ * maps the relative target to the AE window of the sensor. This way the
+ * same code runs in the host evaluation tool on recorded sequences.
+ *
+ * Example:
+ *      float target = deflicker.update(luma);  // e.g. 0.97
+ *      // scale the AE target window of the sensor by 0.97
+*/
+class Deflicker
+{
+    public:
+        Deflicker(){}
+
+        void init(float alpha=0.2f, float gain=0.5f, float maxTarget=1.5f);
+        float update(float luma);
+        void reset();
+        float getMean();
+        float getTarget();
+        float getFlicker();
+        uint32_t getNbrOfFrames();
+
+    private:
+        float       _alpha      = 0.2f;  // weight of the newest frame in the average
+        float       _gain       = 0.5f;  // fraction of the predicted deviation corrected
+        float       _maxTarget  = 1.5f;  // target stays within 1/max .. max
+        float       _mean       = 0.0f;
+        float       _target     = 1.0f;
+        float       _lastLuma   = 0.0f;
+        float       _lastDev    = 0.0f;  // deviation of the last frame from the average
+        float       _varDev     = 0.0f;  // moving variance of the deviations
+        float       _covDev     = 0.0f;  // moving lag-1 covariance of the deviations
+        float       _sumDiff    = 0.0f;  // sum of the luminance changes between frames
+        uint32_t    _nbrOfFrames = 0;
+};
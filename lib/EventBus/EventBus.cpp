@@ -0,0 +1,82 @@
+#include "EventBus.hpp"
+
+/**
+ * Register the handler for the event types in the mask (bit n for
+ * type n), before seal(). Returns the subscriber id, -1 if sealed
+ * already or there are too many subscribers.
+*/
+int EventBus::subscribe(uint32_t types, EventHandler handler, void *ctx)
+{
+    if (_sealed || ! handler || _nbrOfSubscribers >= MAX_SUBSCRIBERS) return -1;
+    _handlers[_nbrOfSubscribers] = handler;
+    _ctx[_nbrOfSubscribers]      = ctx;
+    _types[_nbrOfSubscribers]    = types;
+    return _nbrOfSubscribers++;
+}
+
+/**
+ * Compute the subscriber list of each type and allow publishing.
+ * Must be called before the publishing tasks start.
+*/
+bool EventBus::seal()
+{
+    if (_sealed) return false;
+    for (int t = 0; t < MAX_TYPES; t++)
+    {
+        _nbrOf[t] = 0;
+        for (int s = 0; s < _nbrOfSubscribers; s++)
+        {
+            if (_types[s] & (1U << t)) _lists[t][_nbrOf[t]++] = s;
+        }
+    }
+    _sealed = true;
+    return true;
+}
+
+/**
+ * Hand an event to the subscribers of its type, in the context of the
+ * caller. Returns the number of handlers called, 0 also before seal()
+ * and for an invalid type.
+*/
+uint32_t EventBus::publish(uint16_t type, uint16_t source, int64_t value, uint32_t arg, int64_t timeMs)
+{
+    if (! _sealed || type >= MAX_TYPES) return 0;
+
+    Event    event = { type, source, _seq.fetch_add(1, std::memory_order_relaxed), timeMs, value, arg };
+    uint32_t muted = _muted.load(std::memory_order_relaxed);
+    uint32_t n     = 0;
+
+    _published[type].fetch_add(1, std::memory_order_relaxed);
+    for (int i = 0; i < _nbrOf[type]; i++)
+    {
+        int s = _lists[type][i];
+        if (muted & (1U << s)) continue;
+        _handlers[s](event, _ctx[s]);
+        n++;
+    }
+    if (n == 0) _unheard.fetch_add(1, std::memory_order_relaxed);
+    return n;
+}
+
+/**
+ * Stop or resume handing events to the subscriber, takes effect
+ * with the next event published
+*/
+void EventBus::setMuted(int id, bool muted)
+{
+    if (id < 0 || id >= _nbrOfSubscribers) return;
+    if (muted) _muted.fetch_or(1U << id, std::memory_order_relaxed);
+    else _muted.fetch_and(~(1U << id), std::memory_order_relaxed);
+}
+
+uint32_t EventBus::getNbrOfSubscribers(uint16_t type) { return type < MAX_TYPES ? _nbrOf[type] : 0; }
+
+uint32_t EventBus::getNbrOfPublished(uint16_t type)
+{
+    return type < MAX_TYPES ? _published[type].load(std::memory_order_relaxed) : 0;
+}
+
+/**
+ * Events published without a subscriber listening (none or all muted)
+*/
+uint32_t EventBus::getNbrOfUnheard() { return _unheard.load(std::memory_order_relaxed); }
@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Fixed-size record published on the EventBus. type is one of the
+ * event types of the application (0 .. MAX_TYPES - 1), source e.g.
+ * the number of a timer, value and arg the payload of the type.
+*/
+using Event = struct evnt { uint16_t type; uint16_t source; uint32_t seq; int64_t timeMs; int64_t value; uint32_t arg; };
+
+using EventHandler = void(*)(const Event &event, void *ctx);
+
+/**
+ * In-process publish/subscribe of events between the parts of the
+ * firmware, e.g. timer firings, captures and storage completions to
+ * metrics, logging and upload. The subscribers are registered at
+ * startup with a mask of the types they want, then seal() computes
+ * the list of subscribers of each type. From then on the lists do not
+ * change and publish() runs without locks: the event is built on the
+ * stack of the publisher and handed to the handlers of its type in
+ * the order they subscribed, in the context of the publisher. Only the
+ * sequence number and the counters are atomic. Nothing is allocated.
+ *
+ * Handlers must be short and must not block; a consumer with slow work
+ * (upload) copies the event into its own queue. Subscribers can be
+ * muted and unmuted at any time, e.g. the logging.
+ *
+ * No dependency on FreeRTOS or Arduino, the event bus benchmark runs
+ * on the host.
+ *
+ * Example:
+ *      int log = bus.subscribe((1 << EV_PHOTO) | (1 << EV_FAILED), logEvent);
+ *      bus.seal();
+ *      bus.publish(EV_PHOTO, 4, len, nbr, nowMs);
+*/
+class EventBus
+{
+    public:
+        static const int MAX_TYPES       = 32;
+        static const int MAX_SUBSCRIBERS = 16;
+
+        EventBus(){}
+
+        int subscribe(uint32_t types, EventHandler handler, void *ctx=nullptr);
+        bool seal();
+        uint32_t publish(uint16_t type, uint16_t source, int64_t value=0, uint32_t arg=0, int64_t timeMs=0);
+        void setMuted(int id, bool muted);
+        uint32_t getNbrOfSubscribers(uint16_t type);
+        uint32_t getNbrOfPublished(uint16_t type);
+        uint32_t getNbrOfUnheard();
+
+    private:
+        EventHandler          _handlers[MAX_SUBSCRIBERS] = {};
+        void                 *_ctx[MAX_SUBSCRIBERS]      = {};
+        uint32_t              _types[MAX_SUBSCRIBERS]    = {};
+        uint8_t               _lists[MAX_TYPES][MAX_SUBSCRIBERS];   // subscriber ids per type
+        uint8_t               _nbrOf[MAX_TYPES]          = {};
+        int                   _nbrOfSubscribers          = 0;
+        bool                  _sealed                    = false;
+        std::atomic<uint32_t> _muted{0};                 // bit per subscriber
+        std::atomic<uint32_t> _seq{0};
+        std::atomic<uint32_t> _published[MAX_TYPES]     = {};
+        std::atomic<uint32_t> _unheard{0};               // events without a subscriber
+};
@@ -0,0 +1,146 @@
+#include "ExposureBracket.hpp"
+#include "Ov2640Exposure.hpp"
+
+void ExposureBracket::init(const float evSteps[], int nbrOfSteps, int settleFrames)
+{
+    _nbrOfSteps   = min(nbrOfSteps, MAX_FRAMES);
+    _settleFrames = settleFrames;
+    for (int i = 0; i < _nbrOfSteps; i++) _frames[i].ev = evSteps[i];
+    log_i("==> done");
+}
+
+/**
+ * Take the bracket. Exposure times beyond one frame are made up with gain.
+ * Returns false if a frame could not be taken or copied.
+*/
+bool ExposureBracket::capture(sensor_t *sensor)
+{
+    uint16_t aec0  = Ov2640Exposure::readAec(sensor);
+    uint8_t  gain0 = Ov2640Exposure::readGain(sensor);
+    float    ei0   = Ov2640Exposure::exposureIndex(aec0, gain0);
+    bool     ok    = true;
+
+    // pre-stage the register values of all frames
+    for (int i = 0; i < _nbrOfSteps; i++)
+    {
+        float ei  = ei0 * powf(2.0f, _frames[i].ev);
+        float aec = constrain(ei, 1.0f, static_cast<float>(Ov2640Exposure::MAX_AEC));
+        _frames[i].aec  = lroundf(aec);
+        _frames[i].gain = Ov2640Exposure::gainRegister(ei / aec);
+    }
+
+    _time = time(nullptr);
+    _nbrOfFrames = 0;
+    Ov2640Exposure::setAuto(sensor, false);
+    Ov2640Exposure::write(sensor, _frames[0].aec, _frames[0].gain);
+    for (int i = 0; ok && i < _nbrOfSteps; i++)
+    {
+        for (int s = 0; s < _settleFrames; s++)
+        {
+            camera_fb_t *fb = esp_camera_fb_get();
+            if (fb) esp_camera_fb_return(fb);
+        }
+        camera_fb_t *fb = esp_camera_fb_get();
+        if (! fb) { ok = false; break; }
+
+        // the sensor settles to the next exposure while the frame is copied
+        if (i + 1 < _nbrOfSteps) Ov2640Exposure::write(sensor, _frames[i + 1].aec, _frames[i + 1].gain);
+        _frames[i].tUs = static_cast<int64_t>(fb->timestamp.tv_sec) * 1000000 + fb->timestamp.tv_usec;
+        ok = _copy(_frames[i], fb);
+        esp_camera_fb_return(fb);
+        if (ok) _nbrOfFrames++;
+    }
+    Ov2640Exposure::write(sensor, aec0, gain0);
+    Ov2640Exposure::setAuto(sensor, true);
+    log_i("%d frames, max gap: %u us", _nbrOfFrames, getMaxGap());
+    return ok;
+}
+
+/**
+ * Write the frames as /brkGGGGG_N.jpg and the metadata of the
+ * group as /brkGGGGG.txt
+*/
+bool ExposureBracket::save(fs::FS &fs, uint32_t group)
+{
+    char path[32];
+    char buf[META_SIZE];
+    bool ok = true;
+
+    for (int i = 0; i < _nbrOfFrames; i++)
+    {
+        snprintf(path, sizeof(path), "/brk%05u_%d.jpg", group, i);
+        File file = fs.open(path, FILE_WRITE);
+        if (! file) { ok = false; continue; }
+        ok &= file.write(_frames[i].buf, _frames[i].len) == _frames[i].len;
+        file.close();
+    }
+
+    snprintf(path, sizeof(path), "/brk%05u.txt", group);
+    File meta = fs.open(path, FILE_WRITE);
+    if (! meta) return false;
+    size_t len = printMeta(buf, sizeof(buf), group);
+    ok &= meta.write(reinterpret_cast<uint8_t *>(buf), len) == len;
+    meta.close();
+    return ok;
+}
+
+/**
+ * The metadata of the group as text, returns its length (truncated
+ * to size - 1), META_SIZE bytes hold a full bracket
+*/
+size_t ExposureBracket::printMeta(char buf[], size_t size, uint32_t group)
+{
+    char   when[24];
+    tm     td;
+    size_t n;
+
+    localtime_r(&_time, &td);
+    strftime(when, sizeof(when), "%F %T", &td);
+    n = snprintf(buf, size, "group: %u\ntime: %s\nframes: %d\nsettle: %d\nframe,ev,aec,gain,gap_us,bytes\n",
+                 group, when, _nbrOfFrames, _settleFrames);
+    for (int i = 0; i < _nbrOfFrames && n < size; i++)
+    {
+        n += snprintf(buf + n, size - n, "%d,%.1f,%u,0x%02x,%u,%u\n", i, _frames[i].ev, _frames[i].aec,
+                      _frames[i].gain, getGap(i), _frames[i].len);
+    }
+    return min(n, size - 1);
+}
+
+int ExposureBracket::getNbrOfFrames() { return _nbrOfFrames; }
+
+const uint8_t *ExposureBracket::getBuf(int frame) { return _frames[frame].buf; }
+
+size_t ExposureBracket::getLen(int frame) { return frame < _nbrOfFrames ? _frames[frame].len : 0; }
+
+/**
+ * Time between the start of the previous and this frame in microseconds
+*/
+uint32_t ExposureBracket::getGap(int frame)
+{
+    if (frame <= 0 || frame >= _nbrOfFrames) return 0;
+    return _frames[frame].tUs - _frames[frame - 1].tUs;
+}
+
+uint32_t ExposureBracket::getMaxGap()
+{
+    uint32_t gap = 0;
+    for (int i = 1; i < _nbrOfFrames; i++) gap = max(gap, getGap(i));
+    return gap;
+}
+
+/**
+ * Copy the frame to PSRAM, the buffers are kept for the next bracket
+*/
+bool ExposureBracket::_copy(Frame &frame, camera_fb_t *fb)
+{
+    if (fb->len > frame.capacity)
+    {
+        free(frame.buf);
+        frame.buf = static_cast<uint8_t *>(ps_malloc(fb->len));
+        frame.capacity = frame.buf ? fb->len : 0;
+        if (! frame.buf) return false;
+    }
+    memcpy(frame.buf, fb->buf, fb->len);
+    frame.len = fb->len;
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <Arduino.h>
+#include <esp_camera.h>
+#include <FS.h>
+
+/**
+ * Exposure bracketing for high dynamic range scenes. Starting from the
+ * exposure the sensor has converged to, a bracket of frames is taken at
+ * the given EV offsets with automatic exposure disabled.
+ *
+ * The register values of all frames are computed before the first frame
+ * is taken. The exposure of the next frame is written as soon as a frame
+ * has arrived, so the settling of the sensor overlaps with copying the
+ * frame to PSRAM. The frames are written to the card only after the whole
+ * bracket has been taken, together with a metadata file shared by the
+ * group, which also records the gaps between the frames. To store them
+ * elsewhere (e.g. a raw log), use getBuf(), getLen() and printMeta().
+ *
+ * Example:
+ *      const float EV[] = { -2.0f, 0.0f, 2.0f };
+ *      bracket.init(EV, 3);
+ *      if (bracket.capture(esp_camera_sensor_get())) bracket.save(SD_MMC, nbr);
+*/
+class ExposureBracket
+{
+    public:
+        static const int MAX_FRAMES = 5;
+        static const size_t META_SIZE = 384;    // bytes of printMeta() for MAX_FRAMES
+
+        ExposureBracket(){}
+
+        void init(const float evSteps[], int nbrOfSteps, int settleFrames=2);
+        bool capture(sensor_t *sensor);
+        bool save(fs::FS &fs, uint32_t group);
+        int getNbrOfFrames();
+        const uint8_t *getBuf(int frame);
+        size_t getLen(int frame);
+        size_t printMeta(char buf[], size_t size, uint32_t group);
+        uint32_t getGap(int frame);
+        uint32_t getMaxGap();
+
+    private:
+        using Frame = struct { uint8_t *buf; size_t len; size_t capacity; int64_t tUs;
+                               uint16_t aec; uint8_t gain; float ev; };
+
+        Frame       _frames[MAX_FRAMES] = {};
+        int         _nbrOfSteps   = 0;
+        int         _nbrOfFrames  = 0;   // frames taken by the last capture
+        int         _settleFrames = 2;   // frames until a new exposure is applied
+        time_t      _time         = 0;
+        bool        _copy(Frame &frame, camera_fb_t *fb);
+};
@@ -0,0 +1,127 @@
+#include "ExposureCache.hpp"
+#include "Ov2640Exposure.hpp"
+
+void ExposureCache::init(sensor_t *sensor, uint32_t bucketSeconds)
+{
+    _bucketSeconds = max(bucketSeconds, 86400U / MAX_BUCKETS);
+    setSensor(sensor);
+    log_i("==> done");
+}
+
+/**
+ * Use another sensor instance, e.g. after the camera has been
+ * reinitialized. The cached settings are kept.
+*/
+void ExposureCache::setSensor(sensor_t *sensor)
+{
+    _sensor = sensor;
+    if (_sensor && _sensor->id.PID != OV2640_PID)
+    {
+        log_w("sensor is not an OV2640, exposure cache disabled");
+        _sensor = nullptr;
+    }
+}
+
+/**
+ * Apply the cached exposure settings for the current time of day
+ * and light level, drop the frames until auto exposure has settled
+ * and return the first stable frame. The frame must be returned
+ * with esp_camera_fb_return() by the caller.
+*/
+camera_fb_t *ExposureCache::capture()
+{
+    if (! _sensor) return esp_camera_fb_get();
+
+    Entry   &entry  = _entries[_bucket() * LIGHT_LEVELS + _lightLevel];
+    bool     hit    = entry.valid;
+    float    prevEi = 0;
+    float    ei     = 0;
+    uint32_t frames = 0;
+    uint16_t aec;
+    uint8_t  gain;
+    camera_fb_t *fb;
+
+    if (hit) Ov2640Exposure::write(_sensor, entry.aec, entry.gain);
+
+    while (true)
+    {
+        fb = esp_camera_fb_get();
+        if (! fb) return nullptr;
+        aec  = Ov2640Exposure::readAec(_sensor);
+        gain = Ov2640Exposure::readGain(_sensor);
+        ei   = Ov2640Exposure::exposureIndex(aec, gain);
+        if (frames > 0 && 1000.0f * fabsf(ei - prevEi) <= SETTLE_PERMIL * prevEi) break;
+        if (frames >= MAX_WARMUP) break;
+        prevEi = ei;
+        frames++;
+        esp_camera_fb_return(fb);
+    }
+
+    // refine the entry of the light level actually measured
+    float ev = log2f(max(ei, 1.0f));
+    _lightLevel = constrain(static_cast<int>(ev / 2), 0, LIGHT_LEVELS - 1);
+    Entry &refined = _entries[_bucket() * LIGHT_LEVELS + _lightLevel];
+    if (refined.valid)
+    {
+        refined.aec  = (3 * refined.aec + aec) / 4;
+        refined.gain = (3 * refined.gain + gain) / 4;
+    }
+    else
+    {
+        refined = { aec, gain, 1 };
+    }
+
+    if (hit) { _hits++;   _warmupHits += frames; }
+    else     { _misses++; _warmupMisses += frames; }
+
+    if (_lastEv > 0)
+    {
+        _sumEvDiff += fabsf(ev - _lastEv);
+        _nbrOfEvDiffs++;
+    }
+    _lastEv = max(ev, 0.001f);
+    return fb;
+}
+
+/**
+ * Light level of the last capture, 0 (bright) .. LIGHT_LEVELS - 1 (dark)
+*/
+int ExposureCache::getLightLevel() { return _lightLevel; }
+
+uint32_t ExposureCache::getHits() { return _hits; }
+
+uint32_t ExposureCache::getMisses() { return _misses; }
+
+/**
+ * Warm-up frames saved by the cache hits compared with
+ * the mean warm-up of a capture without cached settings
+*/
+uint32_t ExposureCache::getWarmupFramesAvoided()
+{
+    if (_misses == 0) return 0;
+    float expected = static_cast<float>(_warmupMisses) / _misses * _hits;
+    return expected > _warmupHits ? expected - _warmupHits : 0;
+}
+
+/**
+ * Mean exposure change between consecutive captures in EV (stops)
+*/
+float ExposureCache::getFlicker()
+{
+    return _nbrOfEvDiffs ? _sumEvDiff / _nbrOfEvDiffs : 0.0f;
+}
+
+void ExposureCache::printStats()
+{
+    log_i("hits: %u (%u warm-up frames), misses: %u (%u warm-up frames), avoided: %u, flicker: %.3f EV",
+          _hits, _warmupHits, _misses, _warmupMisses, getWarmupFramesAvoided(), getFlicker());
+}
+
+int ExposureCache::_bucket()
+{
+    time_t now = time(nullptr);
+    tm     lt;
+
+    localtime_r(&now, &lt);
+    return ((lt.tm_hour * 60 + lt.tm_min) * 60 + lt.tm_sec) / _bucketSeconds;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <Arduino.h>
+#include <esp_camera.h>
+
+/**
+ * Cache of converged OV2640 exposure settings (AEC exposure time and
+ * AGC gain) keyed by time-of-day bucket and light level. Before a
+ * capture the cached settings are written to the sensor, so auto
+ * exposure starts close to its final value and needs less warm-up
+ * frames. After convergence the entry is refined with the new values.
+ *
+ * The light level of the coming capture is not known in advance, so
+ * the level of the previous capture is used, as light changes slowly
+ * between the firings of a time-lapse.
+ *
+ * White balance is left to the sensor, the OV2640 does not expose
+ * the gains its automatic white balance has converged to.
+ *
+ * Example:
+ *      exposure.init(esp_camera_sensor_get());
+ *      camera_fb_t *fb = exposure.capture();
+ *      ...
+ *      esp_camera_fb_return(fb);
+*/
+class ExposureCache
+{
+    public:
+        ExposureCache(){}
+
+        void init(sensor_t *sensor, uint32_t bucketSeconds=1800);
+        void setSensor(sensor_t *sensor);
+        camera_fb_t *capture();
+        int getLightLevel();
+        uint32_t getHits();
+        uint32_t getMisses();
+        uint32_t getWarmupFramesAvoided();
+        float getFlicker();
+        void printStats();
+
+    private:
+        static const int LIGHT_LEVELS  = 8;   // buckets of 2 EV of the exposure index, 7 is darkest
+        static const int MAX_BUCKETS   = 96;  // time-of-day buckets (15 min minimum)
+        static const int MAX_WARMUP    = 10;  // frames to wait at most for convergence
+        static const int SETTLE_PERMIL = 30;  // exposure index change considered stable
+
+        using Entry = struct { uint16_t aec; uint8_t gain; uint8_t valid; };
+
+        sensor_t   *_sensor        = nullptr;
+        uint32_t    _bucketSeconds = 1800;
+        Entry       _entries[MAX_BUCKETS * LIGHT_LEVELS] = {};
+        int         _lightLevel    = LIGHT_LEVELS / 2;
+        uint32_t    _hits          = 0;
+        uint32_t    _misses        = 0;
+        uint32_t    _warmupHits    = 0;   // warm-up frames summed over all hits
+        uint32_t    _warmupMisses  = 0;   // warm-up frames summed over all misses
+        float       _lastEv        = 0;
+        float       _sumEvDiff     = 0;
+        uint32_t    _nbrOfEvDiffs  = 0;
+
+        int         _bucket();
+};
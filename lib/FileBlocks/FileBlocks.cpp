@@ -0,0 +1,62 @@
+#include "FileBlocks.hpp"
+
+/**
+ * Open the file, create it filled with zeros if it does not exist
+ * or is shorter than nbrOfBlocks
+*/
+bool FileBlocks::begin(fs::FS &fs, const char path[], uint32_t nbrOfBlocks)
+{
+    size_t size = static_cast<size_t>(nbrOfBlocks) * BLOCK_SIZE;
+
+    _file = fs.open(path, FILE_READ);
+    bool exists = _file && _file.size() >= size;
+    _file.close();
+    if (! exists)
+    {
+        uint8_t zeros[BLOCK_SIZE] = {};
+        _file = fs.open(path, FILE_WRITE);
+        if (! _file) return false;
+        for (uint32_t i = 0; i < nbrOfBlocks; i++)
+        {
+            if (_file.write(zeros, BLOCK_SIZE) != BLOCK_SIZE)
+            {
+                _file.close();
+                return false;
+            }
+        }
+        _file.close();
+    }
+    _file = fs.open(path, "r+");
+    if (! _file) return false;
+    _nbrOfBlocks = nbrOfBlocks;
+    return true;
+}
+
+void FileBlocks::end()
+{
+    _file.close();
+    _nbrOfBlocks = 0;
+}
+
+uint32_t FileBlocks::getNbrOfBlocks() { return _nbrOfBlocks; }
+
+bool FileBlocks::readBlocks(uint32_t lba, void *buf, uint32_t n)
+{
+    size_t len = static_cast<size_t>(n) * BLOCK_SIZE;
+
+    if (lba + n > _nbrOfBlocks || ! _file.seek(lba * BLOCK_SIZE)) return false;
+    return _file.read(static_cast<uint8_t *>(buf), len) == len;
+}
+
+/**
+ * Write and flush, so the blocks are on the card when it returns
+*/
+bool FileBlocks::writeBlocks(uint32_t lba, const void *buf, uint32_t n)
+{
+    size_t len = static_cast<size_t>(n) * BLOCK_SIZE;
+
+    if (lba + n > _nbrOfBlocks || ! _file.seek(lba * BLOCK_SIZE)) return false;
+    if (_file.write(static_cast<const uint8_t *>(buf), len) != len) return false;
+    _file.flush();
+    return true;
+}
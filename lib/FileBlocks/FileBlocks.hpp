@@ -0,0 +1,30 @@
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+#include "BlockDevice.hpp"
+
+/**
+ * Block device on a file of a file system, e.g. on the SD card next to
+ * the photos, so a store of blocks (TimeSeries) needs no partition of
+ * its own. The file is created with its full size at the first start,
+ * so its blocks are allocated once and later writes do not grow it.
+ *
+ * Example:
+ *      file.begin(SD_MMC, "/sensors.ts", 2048);
+ *      if (! sensors.mount(&file)) sensors.format(&file, 3);
+*/
+class FileBlocks : public BlockDevice
+{
+    public:
+        FileBlocks(){}
+
+        bool begin(fs::FS &fs, const char path[], uint32_t nbrOfBlocks);
+        void end();
+        uint32_t getNbrOfBlocks() override;
+        bool readBlocks(uint32_t lba, void *buf, uint32_t n) override;
+        bool writeBlocks(uint32_t lba, const void *buf, uint32_t n) override;
+
+    private:
+        File     _file;
+        uint32_t _nbrOfBlocks = 0;
+};
@@ -0,0 +1,85 @@
+#include <cstring>
+#include "FrameStack.hpp"
+
+/**
+ * The accumulator must be 4-byte aligned and hold 2 bytes per pixel
+ * (rounded up to a multiple of 4 pixels).
+*/
+bool FrameStack::init(void *accumulator, size_t nbrOfPixels)
+{
+    if (! accumulator || reinterpret_cast<uintptr_t>(accumulator) % 4) return false;
+    _acc = static_cast<uint32_t *>(accumulator);
+    _nbrOfPixels = nbrOfPixels;
+    clear();
+    return true;
+}
+
+void FrameStack::clear()
+{
+    if (_acc) memset(_acc, 0, 2 * ((_nbrOfPixels + 3) & ~3));
+    _count = 0;
+}
+
+/**
+ * Add a frame. The bytes p0 p1 p2 p3 of a little endian word are
+ * spread to the lanes (p0, p1) and (p2, p3) of two accumulator words.
+*/
+bool FrameStack::add(const uint8_t *frame)
+{
+    if (! _acc || _count >= MAX_FRAMES) return false;
+
+    size_t   nbrOfWords = _nbrOfPixels / 4;
+    uint32_t *acc = _acc;
+
+    for (size_t i = 0; i < nbrOfWords; i++, frame += 4, acc += 2)
+    {
+        uint32_t w;
+        memcpy(&w, frame, sizeof(w));
+        acc[0] += (w & 0x000000FF) | ((w << 8) & 0x00FF0000);
+        acc[1] += ((w >> 16) & 0x000000FF) | ((w >> 8) & 0x00FF0000);
+    }
+    for (size_t i = 4 * nbrOfWords; i < _nbrOfPixels; i++, frame++)
+    {
+        _acc[i / 2] += static_cast<uint32_t>(*frame) << (16 * (i & 1));
+    }
+    _count++;
+    return true;
+}
+
+/**
+ * Reference implementation, one pixel at a time
+*/
+bool FrameStack::addScalar(const uint8_t *frame)
+{
+    if (! _acc || _count >= MAX_FRAMES) return false;
+
+    for (size_t i = 0; i < _nbrOfPixels; i++)
+    {
+        _acc[i / 2] += static_cast<uint32_t>(frame[i]) << (16 * (i & 1));
+    }
+    _count++;
+    return true;
+}
+
+/**
+ * Write the rounded mean of the accumulated frames. The division
+ * is replaced by a multiplication with the 16.16 reciprocal.
+*/
+void FrameStack::average(uint8_t *out)
+{
+    if (! _acc || _count == 0) return;
+
+    uint32_t recip = (65536 + _count - 1) / _count;
+    uint32_t half  = _count / 2;
+
+    for (size_t i = 0; i < _nbrOfPixels; i++)
+    {
+        uint32_t sum = (_acc[i / 2] >> (16 * (i & 1))) & 0xFFFF;
+        uint32_t avg = ((sum + half) * recip) >> 16;
+        out[i] = avg > 255 ? 255 : avg;
+    }
+}
+
+int FrameStack::getCount() { return _count; }
+
+size_t FrameStack::getNbrOfPixels() { return _nbrOfPixels; }
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Accumulates 8-bit grayscale frames into a 16-bit accumulator and 
+ * averages them, which reduces the sensor noise of night photos by
+ * the square root of the number of frames.
+ *
+ * The accumulation uses SWAR kernels: four pixels are loaded as one
+ * 32-bit word, spread into two words of 16-bit lanes and added to the
+ * accumulator without unpacking. Up to MAX_FRAMES frames fit into the
+ * lanes without overflow. The accumulator (2 bytes per pixel) is
+ * supplied by the caller, e.g. allocated in PSRAM. There are no
+ * dependencies on Arduino.
+ *
+ * Example:
+ *      stack.init(ps_malloc(2 * nbrOfPixels), nbrOfPixels);
+ *      for (...) stack.add(fb->buf);
+ *      stack.average(gray);
+*/
+class FrameStack
+{
+    public:
+        static const int MAX_FRAMES = 257;   // 257 * 255 still fits into 16 bits
+
+        FrameStack(){}
+
+        bool init(void *accumulator, size_t nbrOfPixels);
+        void clear();
+        bool add(const uint8_t *frame);
+        bool addScalar(const uint8_t *frame);
+        void average(uint8_t *out);
+        int getCount();
+        size_t getNbrOfPixels();
+
+    private:
+        uint32_t   *_acc         = nullptr;  // two 16-bit lanes per word, pixel n in the low lane
+        size_t      _nbrOfPixels = 0;
+        int         _count       = 0;
+};
@@ -0,0 +1,186 @@
+#include <cstring>
+#include "JpegCrop.hpp"
+
+static int bitLength(int v)
+{
+    int n = 0;
+    if (v < 0) v = -v;
+    while (v) { n++; v >>= 1; }
+    return n;
+}
+
+/**
+ * Crop the region (x, y, w, h) in pixels, enlarged to MCU boundaries, 
+ * into the output buffer. Returns false if the JPEG is not supported, 
+ * the region is empty or the output buffer is too small.
+*/
+bool JpegCrop::crop(const uint8_t *jpg, size_t len, int x, int y, int w, int h,
+                    uint8_t *out, size_t capacity, size_t &outLen)
+{
+    if (! _scan.parse(jpg, len)) return false;
+
+    int mcuW = _scan.getMcuWidth();
+    int mcuH = _scan.getMcuHeight();
+    int imgW = _scan.getWidth();
+    int imgH = _scan.getHeight();
+
+    x = x < 0 ? 0 : x;
+    y = y < 0 ? 0 : y;
+    if (x + w > imgW) w = imgW - x;
+    if (y + h > imgH) h = imgH - y;
+    if (w <= 0 || h <= 0) return false;
+
+    _mcuX0 = x / mcuW;
+    _mcuY0 = y / mcuH;
+    _mcuX1 = (x + w + mcuW - 1) / mcuW;     // exclusive
+    _mcuY1 = (y + h + mcuH - 1) / mcuH;
+    _x = _mcuX0 * mcuW;
+    _y = _mcuY0 * mcuH;
+    _w = (_mcuX1 * mcuW > static_cast<uint32_t>(imgW) ? imgW : _mcuX1 * mcuW) - _x;
+    _h = (_mcuY1 * mcuH > static_cast<uint32_t>(imgH) ? imgH : _mcuY1 * mcuH) - _y;
+
+    for (int c = 0; c < _scan.getNbrOfComponents(); c++)
+    {
+        const JpegComponent &comp = _scan.getComponent(c);
+        _buildCodes(_scan.getHuffman(false, comp.td), _dcCodes[comp.td]);
+        _buildCodes(_scan.getHuffman(true,  comp.ta), _acCodes[comp.ta]);
+        _pred[c] = 0;
+    }
+
+    _out      = out;
+    _capacity = capacity;
+    _pos      = 0;
+    _bitBuf   = 0;
+    _bitCnt   = 0;
+    _error    = false;
+
+    // copy the headers, patch the dimensions in SOF and drop DRI
+    size_t pos = 2;
+    _putByte(0xFF); _putByte(0xD8);
+    while (pos + 4 <= len && ! _error)
+    {
+        uint8_t marker = jpg[pos + 1];
+        size_t  segLen = (jpg[pos + 2] << 8) | jpg[pos + 3];
+        if (marker != 0xDD)
+        {
+            if (_pos + segLen + 2 > _capacity) return false;
+            memcpy(_out + _pos, jpg + pos, segLen + 2);
+            if (pos == _scan.getSofOffset())
+            {
+                _out[_pos + 5] = _h >> 8; _out[_pos + 6] = _h & 0xFF;
+                _out[_pos + 7] = _w >> 8; _out[_pos + 8] = _w & 0xFF;
+            }
+            _pos += segLen + 2;
+        }
+        if (marker == 0xDA) break;
+        pos += segLen + 2;
+    }
+
+    if (! _scan.decode(_visit, this)) return false;
+    _flush();
+    _putByte(0xFF); _putByte(0xD9);
+    if (_error) return false;
+    outLen = _pos;
+    return true;
+}
+
+int JpegCrop::getX() { return _x; }
+
+int JpegCrop::getY() { return _y; }
+
+int JpegCrop::getWidth() { return _w; }
+
+int JpegCrop::getHeight() { return _h; }
+
+/**
+ * Codes of the symbols of a huffman table, a size of 0 marks
+ * a symbol which is not in the table
+*/
+void JpegCrop::_buildCodes(const JpegHuffman &h, HuffCode &codes)
+{
+    uint16_t code = 0;
+    int      k = 0;
+
+    memset(codes.size, 0, sizeof(codes.size));
+    for (int l = 1; l <= 16; l++)
+    {
+        for (int i = 0; i < h.bits[l]; i++, k++, code++)
+        {
+            codes.code[h.vals[k]] = code;
+            codes.size[h.vals[k]] = l;
+        }
+        code <<= 1;
+    }
+}
+
+void JpegCrop::_visit(void *ctx, uint32_t mcu, int comp, int block, const int16_t coef[64])
+{
+    JpegCrop *self = static_cast<JpegCrop *>(ctx);
+    uint32_t  perLine = self->_scan.getMcusPerLine();
+    uint32_t  mx = mcu % perLine;
+    uint32_t  my = mcu / perLine;
+
+    if (mx < self->_mcuX0 || mx >= self->_mcuX1 || my < self->_mcuY0 || my >= self->_mcuY1) return;
+    self->_encodeBlock(comp, coef);
+}
+
+void JpegCrop::_encodeBlock(int comp, const int16_t coef[64])
+{
+    const JpegComponent &c = _scan.getComponent(comp);
+    int diff = coef[0] - _pred[comp];
+    int n    = bitLength(diff);
+    int run  = 0;
+
+    _pred[comp] = coef[0];
+    _putSymbol(_dcCodes[c.td], n);
+    _putBits(diff < 0 ? diff - 1 : diff, n);
+
+    for (int k = 1; k < 64; k++)
+    {
+        if (coef[k] == 0) { run++; continue; }
+        while (run > 15)
+        {
+            _putSymbol(_acCodes[c.ta], 0xF0);   // ZRL
+            run -= 16;
+        }
+        n = bitLength(coef[k]);
+        _putSymbol(_acCodes[c.ta], (run << 4) | n);
+        _putBits(coef[k] < 0 ? coef[k] - 1 : coef[k], n);
+        run = 0;
+    }
+    if (run > 0) _putSymbol(_acCodes[c.ta], 0x00);  // EOB
+}
+
+void JpegCrop::_putSymbol(const HuffCode &codes, uint8_t symbol)
+{
+    if (codes.size[symbol] == 0) { _error = true; return; }
+    _putBits(codes.code[symbol], codes.size[symbol]);
+}
+
+void JpegCrop::_putBits(uint32_t bits, int n)
+{
+    if (n == 0) return;
+    _bitBuf = (_bitBuf << n) | (bits & ((1U << n) - 1));
+    _bitCnt += n;
+    while (_bitCnt >= 8)
+    {
+        uint8_t b = _bitBuf >> (_bitCnt - 8);
+        _putByte(b);
+        if (b == 0xFF) _putByte(0x00);     // byte stuffing
+        _bitCnt -= 8;
+    }
+}
+
+void JpegCrop::_putByte(uint8_t b)
+{
+    if (_pos >= _capacity) { _error = true; return; }
+    _out[_pos++] = b;
+}
+
+/**
+ * Pad the last byte with 1 bits
+*/
+void JpegCrop::_flush()
+{
+    if (_bitCnt > 0) _putBits(0x7F, 8 - _bitCnt);
+}
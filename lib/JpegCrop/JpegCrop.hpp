@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include "JpegScan.hpp"
+
+/**
+ * Lossless crop of a baseline JPEG at MCU boundaries. The quantized DCT
+ * coefficients of the MCUs inside the region are copied and entropy
+ * coded again with the huffman tables of the original, only the DC
+ * differences change. There is no dequantization, inverse DCT or new
+ * quantization, so the crop costs no image quality and little time.
+ *
+ * The region is enlarged to the enclosing MCUs (16x8 pixels for the
+ * 4:2:2 JPEGs of the OV2640). Restart markers are dropped. There are no
+ * dependencies on Arduino.
+ *
+ * Example:
+ *      JpegCrop crop;
+ *      size_t len;
+ *      if (crop.crop(fb->buf, fb->len, 400, 300, 640, 480, out, capacity, len)) ...
+*/
+class JpegCrop
+{
+    public:
+        JpegCrop(){}
+
+        bool crop(const uint8_t *jpg, size_t len, int x, int y, int w, int h,
+                  uint8_t *out, size_t capacity, size_t &outLen);
+        int getX();
+        int getY();
+        int getWidth();
+        int getHeight();
+
+    private:
+        using HuffCode = struct { uint16_t code[256]; uint8_t size[256]; };
+
+        JpegScan    _scan;
+        HuffCode    _dcCodes[4];
+        HuffCode    _acCodes[4];
+        uint32_t    _mcuX0 = 0, _mcuY0 = 0, _mcuX1 = 0, _mcuY1 = 0;
+        int         _x = 0, _y = 0, _w = 0, _h = 0;
+        int         _pred[JpegScan::MAX_COMPONENTS];
+
+        // bit writer state
+        uint8_t    *_out      = nullptr;
+        size_t      _capacity = 0;
+        size_t      _pos      = 0;
+        uint32_t    _bitBuf   = 0;
+        int         _bitCnt   = 0;
+        bool        _error    = false;
+
+        static void _buildCodes(const JpegHuffman &h, HuffCode &codes);
+        static void _visit(void *ctx, uint32_t mcu, int comp, int block, const int16_t coef[64]);
+        void        _encodeBlock(int comp, const int16_t coef[64]);
+        void        _putSymbol(const HuffCode &codes, uint8_t symbol);
+        void        _putBits(uint32_t bits, int n);
+        void        _putByte(uint8_t b);
+        void        _flush();
+};
@@ -0,0 +1,339 @@
+#include <cstring>
+#include "JpegScan.hpp"
+
+/**
+ * Parse the JPEG headers up to the start of the scan. Returns
+ * false if the data is not a baseline JPEG with a single scan.
+*/
+bool JpegScan::parse(const uint8_t *data, size_t len)
+{
+    bool sof = false;
+
+    _data = data;
+    _len  = len;
+    _restartInterval = 0;
+    _nbrOfComponents = 0;
+    memset(_dc, 0, sizeof(_dc));
+    memset(_ac, 0, sizeof(_ac));
+
+    if (len < 4 || data[0] != 0xFF || data[1] != 0xD8) return false;
+
+    size_t pos = 2;
+    while (pos + 4 <= len)
+    {
+        if (data[pos] != 0xFF) return false;
+        uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) { pos++; continue; }   // fill byte
+        pos += 2;
+
+        size_t segLen = (data[pos] << 8) | data[pos + 1];
+        if (segLen < 2 || pos + segLen > len) return false;
+        const uint8_t *seg = data + pos + 2;
+        size_t n = segLen - 2;
+
+        switch (marker)
+        {
+            case 0xC0:      // SOF0 baseline
+            case 0xC1:      // SOF1 extended sequential, huffman coded
+                if (n < 6 || seg[0] != 8) return false;
+                _sofOffset = pos - 2;
+                _height = (seg[1] << 8) | seg[2];
+                _width  = (seg[3] << 8) | seg[4];
+                _nbrOfComponents = seg[5];
+                if (_nbrOfComponents < 1 || _nbrOfComponents > MAX_COMPONENTS || n < 6 + 3U * _nbrOfComponents) return false;
+                _hmax = _vmax = 1;
+                for (int c = 0; c < _nbrOfComponents; c++)
+                {
+                    _comps[c].id = seg[6 + 3 * c];
+                    _comps[c].h  = seg[7 + 3 * c] >> 4;
+                    _comps[c].v  = seg[7 + 3 * c] & 0x0F;
+                    _comps[c].tq = seg[8 + 3 * c] & 0x03;
+                    if (_comps[c].h < 1 || _comps[c].v < 1) return false;
+                    if (_comps[c].h > _hmax) _hmax = _comps[c].h;
+                    if (_comps[c].v > _vmax) _vmax = _comps[c].v;
+                }
+                sof = true;
+                break;
+
+            case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+            case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+                return false;   // progressive, lossless or arithmetic coding
+
+            case 0xC4:      // DHT
+                for (size_t i = 0; i < n; )
+                {
+                    uint8_t tc = seg[i] >> 4;
+                    uint8_t th = seg[i] & 0x03;
+                    JpegHuffman &h = tc ? _ac[th] : _dc[th];
+                    size_t nbrOfVals = 0;
+
+                    if (i + 17 > n) return false;
+                    h.bits[0] = 0;
+                    for (int l = 1; l <= 16; l++) { h.bits[l] = seg[i + l]; nbrOfVals += h.bits[l]; }
+                    if (nbrOfVals > 256 || i + 17 + nbrOfVals > n) return false;
+                    memcpy(h.vals, seg + i + 17, nbrOfVals);
+                    _buildHuffman(h);
+                    i += 17 + nbrOfVals;
+                }
+                break;
+
+            case 0xDB:      // DQT
+                for (size_t i = 0; i < n; )
+                {
+                    bool    wide = seg[i] >> 4;
+                    uint8_t tq   = seg[i] & 0x03;
+
+                    if (i + 1 + (wide ? 128 : 64) > n) return false;
+                    for (int k = 0; k < 64; k++)
+                    {
+                        _quant[tq][k] = wide ? (seg[i + 1 + 2 * k] << 8) | seg[i + 2 + 2 * k] : seg[i + 1 + k];
+                    }
+                    i += 1 + (wide ? 128 : 64);
+                }
+                break;
+
+            case 0xDD:      // DRI
+                if (n < 2) return false;
+                _restartInterval = (seg[0] << 8) | seg[1];
+                break;
+
+            case 0xDA:      // SOS
+                if (! sof || n < 1 || seg[0] != _nbrOfComponents || n < 1 + 2U * seg[0]) return false;
+                for (int s = 0; s < seg[0]; s++)
+                {
+                    if (seg[1 + 2 * s] != _comps[s].id) return false;
+                    _comps[s].td = seg[2 + 2 * s] >> 4 & 0x03;
+                    _comps[s].ta = seg[2 + 2 * s] & 0x03;
+                    if (! _dc[_comps[s].td].defined || ! _ac[_comps[s].ta].defined) return false;
+                }
+                if (_nbrOfComponents == 1) _hmax = _vmax = 1;  // non interleaved: one block per MCU
+                _scanOffset = pos + segLen;
+                return true;
+
+            default:
+                break;
+        }
+        pos += segLen;
+    }
+    return false;
+}
+
+/**
+ * Decode all blocks of the scan and call the visitor for each block
+ * with the quantized coefficients in zigzag order. If dcOnly is set,
+ * the AC coefficients are skipped and passed as zeros.
+*/
+bool JpegScan::decode(JpegBlockVisitor visitor, void *ctx, bool dcOnly)
+{
+    int     pred[MAX_COMPONENTS] = { 0 };
+    int16_t coef[64] = { 0 };
+    uint32_t nbrOfMcus = getMcusPerLine() * getMcuLines();
+
+    if (! _data || _scanOffset == 0) return false;
+    _pos = _scanOffset;
+    _bitBuf = 0;
+    _bitCnt = 0;
+    _marker = false;
+
+    for (uint32_t m = 0; m < nbrOfMcus; m++)
+    {
+        if (_restartInterval && m && m % _restartInterval == 0)
+        {
+            if (! _restart()) return false;
+            memset(pred, 0, sizeof(pred));
+        }
+
+        for (int c = 0; c < _nbrOfComponents; c++)
+        {
+            const JpegComponent &comp = _comps[c];
+            int nbrOfBlocks = _nbrOfComponents == 1 ? 1 : comp.h * comp.v;
+
+            for (int b = 0; b < nbrOfBlocks; b++)
+            {
+                int s = _decodeHuffman(_dc[comp.td]);
+                if (s < 0 || s > 11) return false;
+                int v = _getBits(s);
+                if (s && v < (1 << (s - 1))) v -= (1 << s) - 1;
+                pred[c] += v;
+                coef[0] = pred[c];
+
+                if (! dcOnly) memset(coef + 1, 0, 63 * sizeof(int16_t));
+                for (int k = 1; k < 64; )
+                {
+                    int rs = _decodeHuffman(_ac[comp.ta]);
+                    if (rs < 0) return false;
+                    int r = rs >> 4;
+                    s = rs & 0x0F;
+                    if (s == 0)
+                    {
+                        if (r != 15) break;     // end of block
+                        k += 16;
+                        continue;
+                    }
+                    k += r;
+                    if (k > 63) return false;
+                    v = _getBits(s);
+                    if (v < (1 << (s - 1))) v -= (1 << s) - 1;
+                    if (! dcOnly) coef[k] = v;
+                    k++;
+                }
+                if (visitor) visitor(ctx, m, c, b, coef);
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Mean luminance (0..255) of the image computed from the DC
+ * coefficients of the luminance blocks, i.e. without any
+ * dequantization of the AC coefficients and inverse DCT.
+*/
+bool JpegScan::meanLuma(float &luma)
+{
+    struct LumaSum { int64_t sum; uint32_t cnt; } acc = { 0, 0 };
+
+    bool ok = decode([](void *ctx, uint32_t, int comp, int, const int16_t coef[64])
+    {
+        LumaSum *a = static_cast<LumaSum *>(ctx);
+        if (comp != 0) return;
+        a->sum += coef[0];
+        a->cnt++;
+    }, &acc, true);
+
+    if (! ok || acc.cnt == 0) return false;
+    luma = 128.0f + static_cast<float>(acc.sum) / acc.cnt * _quant[_comps[0].tq][0] / 8.0f;
+    return true;
+}
+
+uint16_t JpegScan::getWidth() { return _width; }
+
+uint16_t JpegScan::getHeight() { return _height; }
+
+int JpegScan::getNbrOfComponents() { return _nbrOfComponents; }
+
+const JpegComponent &JpegScan::getComponent(int comp) { return _comps[comp]; }
+
+const JpegHuffman &JpegScan::getHuffman(bool ac, int table) { return ac ? _ac[table] : _dc[table]; }
+
+const uint16_t *JpegScan::getQuant(int comp) { return _quant[_comps[comp].tq]; }
+
+uint32_t JpegScan::getMcusPerLine() { return (_width + getMcuWidth() - 1) / getMcuWidth(); }
+
+uint32_t JpegScan::getMcuLines() { return (_height + getMcuHeight() - 1) / getMcuHeight(); }
+
+int JpegScan::getMcuWidth() { return 8 * _hmax; }
+
+int JpegScan::getMcuHeight() { return 8 * _vmax; }
+
+size_t JpegScan::getScanOffset() { return _scanOffset; }
+
+size_t JpegScan::getSofOffset() { return _sofOffset; }
+
+/**
+ * Build the decoding tables of a huffman table (JPEG spec F.2.2.3)
+ * and a lookup table for all codes of up to 8 bits
+*/
+void JpegScan::_buildHuffman(JpegHuffman &h)
+{
+    int32_t code = 0;
+    int     k = 0;
+
+    memset(h.lookup, 0, sizeof(h.lookup));
+    for (int l = 1; l <= 16; l++)
+    {
+        h.valptr[l]  = k;
+        h.mincode[l] = code;
+        for (int i = 0; i < h.bits[l]; i++, k++, code++)
+        {
+            if (l > 8) continue;
+            int shift = 8 - l;
+            for (int j = 0; j < (1 << shift); j++)
+            {
+                h.lookup[(code << shift) | j] = (l << 8) | h.vals[k];
+            }
+        }
+        h.maxcode[l] = h.bits[l] ? code - 1 : -1;
+        code <<= 1;
+    }
+    h.maxcode[17] = INT32_MAX;
+    h.defined = true;
+}
+
+/**
+ * Fill the bit buffer with at least 25 bits. Stuffed zero bytes
+ * are removed, at a marker the buffer is padded with zeros.
+*/
+void JpegScan::_fill()
+{
+    while (_bitCnt <= 24)
+    {
+        uint32_t b = 0;
+        if (! _marker)
+        {
+            if (_pos >= _len)
+            {
+                _marker = true;
+            }
+            else if (_data[_pos] == 0xFF)
+            {
+                if (_pos + 1 < _len && _data[_pos + 1] == 0x00) { b = 0xFF; _pos += 2; }
+                else _marker = true;
+            }
+            else
+            {
+                b = _data[_pos++];
+            }
+        }
+        _bitBuf |= b << (24 - _bitCnt);
+        _bitCnt += 8;
+    }
+}
+
+int JpegScan::_getBits(int n)
+{
+    if (n == 0) return 0;
+    if (_bitCnt < n) _fill();
+    int v = _bitBuf >> (32 - n);
+    _bitBuf <<= n;
+    _bitCnt -= n;
+    return v;
+}
+
+int JpegScan::_decodeHuffman(const JpegHuffman &h)
+{
+    if (_bitCnt < 16) _fill();
+
+    uint16_t e = h.lookup[_bitBuf >> 24];
+    if (e)
+    {
+        _bitBuf <<= e >> 8;
+        _bitCnt -= e >> 8;
+        return e & 0xFF;
+    }
+    for (int l = 9; l <= 16; l++)
+    {
+        int32_t code = _bitBuf >> (32 - l);
+        if (code <= h.maxcode[l])
+        {
+            _bitBuf <<= l;
+            _bitCnt -= l;
+            return h.vals[h.valptr[l] + code - h.mincode[l]];
+        }
+    }
+    return -1;
+}
+
+/**
+ * Skip to the byte boundary and over the expected RSTn marker
+*/
+bool JpegScan::_restart()
+{
+    _bitBuf = 0;
+    _bitCnt = 0;
+    if (_pos + 1 >= _len || _data[_pos] != 0xFF) return false;
+    if (_data[_pos + 1] < 0xD0 || _data[_pos + 1] > 0xD7) return false;
+    _pos += 2;
+    _marker = false;
+    return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Minimal baseline JPEG scanner. It parses the headers and decodes the
+ * entropy coded data into quantized DCT coefficients (zigzag order)
+ * without dequantization and inverse DCT. This is cheap enough to run on
+ * every photo, e.g. to get the mean luminance from the DC coefficients.
+ *
+ * Only baseline (SOF0) JPEGs with a single interleaved scan are
+ * supported, as produced by the OV2640. There are no dependencies
+ * on Arduino, so the scanner is also used by the host tools.
+ *
+ * Example:
+ *      JpegScan scan;
+ *      float luma;
+ *      if (scan.parse(fb->buf, fb->len) && scan.meanLuma(luma)) ...
+*/
+
+using JpegBlockVisitor = void(*)(void *ctx, uint32_t mcu, int comp, int block, const int16_t coef[64]);
+
+using JpegComponent = struct jpgc { uint8_t id; uint8_t h; uint8_t v; uint8_t tq; uint8_t td; uint8_t ta; };
+
+using JpegHuffman = struct jpgh { uint8_t bits[17]; uint8_t vals[256];
+                                  uint16_t lookup[256]; int32_t maxcode[18]; int32_t valptr[17];
+                                  uint16_t mincode[17]; bool defined;
+                                } ;
+
+class JpegScan
+{
+    public:
+        static const int MAX_COMPONENTS = 3;
+
+        JpegScan(){}
+
+        bool parse(const uint8_t *data, size_t len);
+        bool decode(JpegBlockVisitor visitor, void *ctx, bool dcOnly=false);
+        bool meanLuma(float &luma);
+        uint16_t getWidth();
+        uint16_t getHeight();
+        int getNbrOfComponents();
+        const JpegComponent &getComponent(int comp);
+        const JpegHuffman &getHuffman(bool ac, int table);
+        const uint16_t *getQuant(int comp);
+        uint32_t getMcusPerLine();
+        uint32_t getMcuLines();
+        int getMcuWidth();
+        int getMcuHeight();
+        size_t getScanOffset();
+        size_t getSofOffset();
+
+    private:
+        const uint8_t *_data          = nullptr;
+        size_t         _len           = 0;
+        size_t         _sofOffset     = 0;   // offset of the SOF0 marker
+        size_t         _scanOffset    = 0;   // offset of the entropy coded data
+        uint16_t       _width         = 0;
+        uint16_t       _height        = 0;
+        uint16_t       _restartInterval = 0;
+        int            _nbrOfComponents = 0;
+        int            _hmax          = 1;
+        int            _vmax          = 1;
+        JpegComponent  _comps[MAX_COMPONENTS];
+        uint16_t       _quant[4][64];
+        JpegHuffman    _dc[4];
+        JpegHuffman    _ac[4];
+
+        // bit reader state
+        size_t         _pos           = 0;
+        uint32_t       _bitBuf        = 0;
+        int            _bitCnt        = 0;
+        bool           _marker        = false;
+
+        static void    _buildHuffman(JpegHuffman &h);
+        void           _fill();
+        int            _getBits(int n);
+        int            _decodeHuffman(const JpegHuffman &h);
+        bool           _restart();
+};
@@ -0,0 +1,50 @@
+#include <cmath>
+#include "LatencyCompensator.hpp"
+
+/**
+ * alpha is the weight of a new sample, 1/8 follows a change of
+ * the lateness within some 20 firings
+*/
+void LatencyCompensator::init(float alpha, int64_t maxLeadMs)
+{
+    _alpha        = alpha;
+    _maxLeadMs    = maxLeadMs;
+    _mean         = 0;
+    _variance     = 0;
+    _leadMs       = 0;
+    _nbrOfSamples = 0;
+}
+
+/**
+ * Lateness of a firing in ms, negative if it was early
+*/
+void LatencyCompensator::add(int64_t lateMs)
+{
+    float raw = static_cast<float>(lateMs + _leadMs);
+
+    if (_nbrOfSamples++ == 0)
+    {
+        _mean = raw;
+    }
+    else
+    {
+        float limit = _mean + 4.0f * fmaxf(sqrtf(_variance), 1.0f);
+        float diff  = fminf(raw, limit) - _mean;
+        _mean     += _alpha * diff;
+        _variance  = (1.0f - _alpha) * (_variance + _alpha * diff * diff);
+    }
+    _leadMs = static_cast<int64_t>(lroundf(_mean));
+    if (_leadMs < 0) _leadMs = 0;
+    if (_leadMs > _maxLeadMs) _leadMs = _maxLeadMs;
+}
+
+/**
+ * How much earlier than due the timer should wake up
+*/
+int64_t LatencyCompensator::getLeadMs() { return _leadMs; }
+
+float LatencyCompensator::getMean() { return _mean; }
+
+float LatencyCompensator::getDeviation() { return sqrtf(_variance); }
+
+uint32_t LatencyCompensator::getNbrOfSamples() { return _nbrOfSamples; }
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * Learned lateness of the firings of a timer. Waking up a task and
+ * dispatching the callback takes a fairly constant time, so the
+ * callbacks start a few ms late. The mean and the variance of the
+ * lateness are followed with exponentially weighted moving averages
+ * and the timer wakes up early by the mean (the lead), so that its
+ * firings land on their due times on average.
+ *
+ * The observed lateness is taken with the lead applied, the raw
+ * lateness is the observed one plus the lead. Outliers, e.g. a firing
+ * delayed by a flash write, are clipped to the mean plus 4 standard
+ * deviations, so a single one does not pull the lead. The lead is
+ * limited to maxLeadMs.
+ *
+ * Example:
+ *      ScheduleCore::Step step = schedule.next(nowMs, comp.getLeadMs());
+ *      ...
+ *      comp.add(nowMs - schedule.getDueMs());     // at FIRE
+*/
+class LatencyCompensator
+{
+    public:
+        LatencyCompensator(){}
+
+        void init(float alpha=0.125f, int64_t maxLeadMs=20);
+        void add(int64_t lateMs);
+        int64_t getLeadMs();
+        float getMean();
+        float getDeviation();
+        uint32_t getNbrOfSamples();
+
+    private:
+        float       _alpha     = 0.125f;
+        int64_t     _maxLeadMs = 20;
+        float       _mean      = 0;      // raw lateness, without the lead
+        float       _variance  = 0;
+        int64_t     _leadMs    = 0;
+        uint32_t    _nbrOfSamples = 0;
+};
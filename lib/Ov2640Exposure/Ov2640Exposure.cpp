@@ -0,0 +1,74 @@
+#include "Ov2640Exposure.hpp"
+
+// OV2640 sensor bank registers (bank 1 is selected by bit 8 of the address)
+static const int REG_GAIN  = 0x100;   // AGC gain
+static const int REG_REG04 = 0x104;   // AEC[1:0]
+static const int REG_AEC   = 0x110;   // AEC[9:2]
+static const int REG_REG45 = 0x145;   // AEC[15:10]
+
+uint16_t Ov2640Exposure::readAec(sensor_t *sensor)
+{
+    int lo  = sensor->get_reg(sensor, REG_REG04, 0x03);
+    int mid = sensor->get_reg(sensor, REG_AEC,   0xFF);
+    int hi  = sensor->get_reg(sensor, REG_REG45, 0x3F);
+    if (lo < 0 || mid < 0 || hi < 0) return 0;
+    return (hi << 10) | (mid << 2) | lo;
+}
+
+uint8_t Ov2640Exposure::readGain(sensor_t *sensor)
+{
+    int gain = sensor->get_reg(sensor, REG_GAIN, 0xFF);
+    return gain < 0 ? 0 : gain;
+}
+
+/**
+ * Write exposure time and gain. With automatic exposure enabled
+ * the sensor continues to regulate from these values.
+*/
+void Ov2640Exposure::write(sensor_t *sensor, uint16_t aec, uint8_t gain)
+{
+    sensor->set_reg(sensor, REG_REG45, 0x3F, aec >> 10);
+    sensor->set_reg(sensor, REG_AEC,   0xFF, aec >> 2);
+    sensor->set_reg(sensor, REG_REG04, 0x03, aec);
+    sensor->set_reg(sensor, REG_GAIN,  0xFF, gain);
+}
+
+/**
+ * Enable or disable automatic exposure and gain control
+*/
+void Ov2640Exposure::setAuto(sensor_t *sensor, bool enable)
+{
+    sensor->set_exposure_ctrl(sensor, enable);
+    sensor->set_gain_ctrl(sensor, enable);
+}
+
+/**
+ * Exposure time (in lines) times the analog gain
+*/
+float Ov2640Exposure::exposureIndex(uint16_t aec, uint8_t gain)
+{
+    return aec * gainFactor(gain);
+}
+
+float Ov2640Exposure::gainFactor(uint8_t gain)
+{
+    return ((gain >> 7) + 1) * (((gain >> 6) & 1) + 1) * (((gain >> 5) & 1) + 1) * (((gain >> 4) & 1) + 1)
+         * (1.0f + (gain & 0x0F) / 16.0f);
+}
+
+/**
+ * Register value of the gain closest to the factor (1 .. 31)
+*/
+uint8_t Ov2640Exposure::gainRegister(float factor)
+{
+    uint8_t doublings = 0;
+
+    factor = constrain(factor, 1.0f, 31.0f);
+    while (doublings < 4 && factor >= 2.0f)
+    {
+        factor /= 2.0f;
+        doublings++;
+    }
+    int fraction = constrain(static_cast<int>(lroundf((factor - 1.0f) * 16.0f)), 0, 15);
+    return (((1 << doublings) - 1) << 4) | fraction;
+}
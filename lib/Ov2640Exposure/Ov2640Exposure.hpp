@@ -0,0 +1,23 @@
+#pragma once
+#include <Arduino.h>
+#include <esp_camera.h>
+
+/**
+ * Direct access to the exposure registers of the OV2640, which the
+ * esp32-camera driver does not expose with their converged values.
+ * The exposure time (AEC) is given in lines, the gain as the raw
+ * register value with 4 doubling bits and a 1/16 fraction.
+*/
+class Ov2640Exposure
+{
+    public:
+        static const uint16_t MAX_AEC = 1200;  // about one UXGA frame
+
+        static uint16_t readAec(sensor_t *sensor);
+        static uint8_t readGain(sensor_t *sensor);
+        static void write(sensor_t *sensor, uint16_t aec, uint8_t gain);
+        static void setAuto(sensor_t *sensor, bool enable);
+        static float exposureIndex(uint16_t aec, uint8_t gain);
+        static float gainFactor(uint8_t gain);
+        static uint8_t gainRegister(float factor);
+};
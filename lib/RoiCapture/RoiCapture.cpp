@@ -0,0 +1,120 @@
+#include "RoiCapture.hpp"
+
+void RoiCapture::init(int x, int y, int w, int h, bool useWindowing)
+{
+    _x = constrain(x & ~15, 0, FULL_WIDTH - 16);
+    _y = constrain(y & ~15, 0, FULL_HEIGHT - 16);
+    _w = constrain((w + 15) & ~15, 16, FULL_WIDTH - _x);
+    _h = constrain((h + 15) & ~15, 16, FULL_HEIGHT - _y);
+    _useWindowing = useWindowing;
+    log_i("roi: %d,%d %dx%d", _x, _y, _w, _h);
+}
+
+/**
+ * Capture the region. The sensor is left in the given framesize
+ * afterwards. The JPEG is kept in PSRAM until the next capture.
+*/
+bool RoiCapture::capture(sensor_t *sensor, framesize_t framesize)
+{
+    if (_fullLen == 0)
+    {
+        camera_fb_t *fb = _grab(_fullFrameUs);
+        if (fb)
+        {
+            _fullLen = fb->len;
+            esp_camera_fb_return(fb);
+        }
+    }
+
+    _windowed = _useWindowing && sensor->id.PID == OV2640_PID && _captureWindowed(sensor, framesize);
+    return _windowed || _captureCropped();
+}
+
+const uint8_t *RoiCapture::getBuf() { return _buf; }
+
+size_t RoiCapture::getLen() { return _len; }
+
+bool RoiCapture::isWindowed() { return _windowed; }
+
+void RoiCapture::printStats()
+{
+    log_i("%s: %u bytes (full frame %u), frame time %u us (full frame %u)", 
+          _windowed ? "windowed" : "cropped", _len, _fullLen, _frameUs, _fullFrameUs);
+}
+
+/**
+ * Grab two consecutive frames, the difference of their timestamps 
+ * is the frame time, which is dominated by the readout
+*/
+camera_fb_t *RoiCapture::_grab(uint32_t &frameUs)
+{
+    camera_fb_t *first = esp_camera_fb_get();
+    if (! first) return nullptr;
+    int64_t t0 = static_cast<int64_t>(first->timestamp.tv_sec) * 1000000 + first->timestamp.tv_usec;
+    esp_camera_fb_return(first);
+
+    camera_fb_t *fb = esp_camera_fb_get();
+    if (! fb) return nullptr;
+    frameUs = static_cast<int64_t>(fb->timestamp.tv_sec) * 1000000 + fb->timestamp.tv_usec - t0;
+    return fb;
+}
+
+bool RoiCapture::_store(const uint8_t *data, size_t len)
+{
+    if (len > _capacity)
+    {
+        free(_buf);
+        _buf = static_cast<uint8_t *>(ps_malloc(len));
+        _capacity = _buf ? len : 0;
+        if (! _buf) return false;
+    }
+    memcpy(_buf, data, len);
+    _len = len;
+    return true;
+}
+
+/**
+ * Set the sensor window (UXGA mode) to the region with a 1:1 output
+*/
+bool RoiCapture::_captureWindowed(sensor_t *sensor, framesize_t framesize)
+{
+    if (sensor->set_res_raw(sensor, 0, 0, 0, 0, _x, _y, _w, _h, _w, _h, false, false) != 0) return false;
+    for (int i = 0; i < SETTLE_FRAMES; i++)
+    {
+        camera_fb_t *fb = esp_camera_fb_get();
+        if (fb) esp_camera_fb_return(fb);
+    }
+
+    camera_fb_t *fb = _grab(_frameUs);
+    bool ok = fb && _store(fb->buf, fb->len);
+    if (fb) esp_camera_fb_return(fb);
+    sensor->set_framesize(sensor, framesize);
+    return ok;
+}
+
+/**
+ * Take a full frame and crop it without decoding the pixels. The
+ * region is scaled if the frame is smaller than UXGA.
+*/
+bool RoiCapture::_captureCropped()
+{
+    camera_fb_t *fb = _grab(_frameUs);
+    if (! fb) return false;
+
+    int x = _x * static_cast<int>(fb->width) / FULL_WIDTH;
+    int y = _y * static_cast<int>(fb->height) / FULL_HEIGHT;
+    int w = _w * static_cast<int>(fb->width) / FULL_WIDTH;
+    int h = _h * static_cast<int>(fb->height) / FULL_HEIGHT;
+    bool ok = false;
+
+    if (_capacity < fb->len)
+    {
+        free(_buf);
+        _buf = static_cast<uint8_t *>(ps_malloc(fb->len));
+        _capacity = _buf ? fb->len : 0;
+    }
+    if (_buf) ok = _crop.crop(fb->buf, fb->len, x, y, w, h, _buf, _capacity, _len);
+    if (! ok) ok = _store(fb->buf, fb->len);    // keep at least the full frame
+    esp_camera_fb_return(fb);
+    return ok;
+}
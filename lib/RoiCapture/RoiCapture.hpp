@@ -0,0 +1,55 @@
+#pragma once
+#include <Arduino.h>
+#include <esp_camera.h>
+#include "JpegCrop.hpp"
+
+/**
+ * Capture of a region of interest, e.g. a gate or a gauge. Where possible
+ * the window of the OV2640 is set to the region, which shortens the
+ * readout and makes the JPEG smaller at the source. Otherwise a full
+ * frame is taken and cropped losslessly at MCU boundaries (JpegCrop).
+ *
+ * The region is given in pixels of the full UXGA frame. For windowing
+ * it is aligned to 16 pixels. The first capture additionally measures a
+ * full frame, so the savings in frame time and bytes can be reported.
+ *
+ * Each timer can have its own region by calling its own instance from
+ * its callback.
+ *
+ * Example:
+ *      gate.init(800, 400, 640, 480);
+ *      if (gate.capture(esp_camera_sensor_get(), FRAMESIZE_UXGA)) save(gate.getBuf(), gate.getLen());
+*/
+class RoiCapture
+{
+    public:
+        RoiCapture(){}
+
+        void init(int x, int y, int w, int h, bool useWindowing=true);
+        bool capture(sensor_t *sensor, framesize_t framesize);
+        const uint8_t *getBuf();
+        size_t getLen();
+        bool isWindowed();
+        void printStats();
+
+    private:
+        static const int FULL_WIDTH  = 1600;
+        static const int FULL_HEIGHT = 1200;
+        static const int SETTLE_FRAMES = 2;   // frames until a new window is applied
+
+        int         _x = 0, _y = 0, _w = FULL_WIDTH, _h = FULL_HEIGHT;
+        bool        _useWindowing = true;
+        bool        _windowed     = false;   // last capture used the sensor window
+        uint8_t    *_buf          = nullptr;
+        size_t      _capacity     = 0;
+        size_t      _len          = 0;
+        uint32_t    _frameUs      = 0;       // frame time of the last capture
+        uint32_t    _fullFrameUs  = 0;       // frame time of a full frame
+        size_t      _fullLen      = 0;       // size of a full frame
+        JpegCrop    _crop;
+
+        camera_fb_t *_grab(uint32_t &frameUs);
+        bool        _store(const uint8_t *data, size_t len);
+        bool        _captureWindowed(sensor_t *sensor, framesize_t framesize);
+        bool        _captureCropped();
+};
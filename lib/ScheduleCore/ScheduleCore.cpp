@@ -0,0 +1,187 @@
+#include <cstdio>
+#include "ScheduleCore.hpp"
+
+/**
+ * Convert the date time strings into timestamps and the task interval
+ * into seconds. The cycle period is set to one day (86400 sec) and the
+ * number of cycles (days) to be performed is computed.
+ * Example:
+ *      startDateTime  (CEST): "2023-06-13 22:40" --> 1686688800
+ *      stopDateTime   (CEST): "2023-06-14 06:15" --> 1686716100
+ *      taskInterval:          "00:05"            --> 300
+*/
+bool ScheduleCore::parse(const char startDateTime[], const char stopDateTime[], const char taskInterval[])
+{
+    int tskHH;
+    int tskMM;
+
+    if (sscanf(taskInterval, "%d:%d", &tskHH, &tskMM) != 2) return false;
+    if (! _parseDateTime(startDateTime, _tStart) || ! _parseDateTime(stopDateTime, _tStop)) return false;
+    _tInterval    = 60 * (60 * tskHH + tskMM);
+    _tCyclePeriod = 86400;
+    _nbrOfCycles  = 1 + (_tStop - _tStart) / _tCyclePeriod;
+    return true;
+}
+
+void ScheduleCore::setStart(time_t tsecStart)  { _tStart = tsecStart; }
+
+void ScheduleCore::setStop(time_t tsecStop)    { _tStop = tsecStop; }
+
+void ScheduleCore::setInterval(time_t tsecInterval) { _tInterval = tsecInterval; }
+
+void ScheduleCore::setCyclePeriod(time_t tsecPeriod) { _tCyclePeriod = tsecPeriod; }
+
+void ScheduleCore::setNbrOfCycles(uint32_t nbrOfCycles) { _nbrOfCycles = nbrOfCycles; }
+
+void ScheduleCore::setIntervalMultiplier(uint32_t factor) { _intervalMultiplier = factor; }
+
+/**
+ * Move the stop of the current window by tsec (shorten it if negative),
+ * the following windows keep their length
+*/
+void ScheduleCore::extendWindow(time_t tsec)
+{
+    _tStop      += tsec;
+    _tExtension += tsec;
+}
+
+time_t ScheduleCore::getStart() { return _tStart; }
+
+time_t ScheduleCore::getStop() { return _tStop; }
+
+time_t ScheduleCore::getInterval() { return _tInterval; }
+
+time_t ScheduleCore::getCyclePeriod() { return _tCyclePeriod; }
+
+uint32_t ScheduleCore::getNbrOfCycles() { return _nbrOfCycles; }
+
+int64_t ScheduleCore::getIntervalMs() { return static_cast<int64_t>(_intervalMultiplier) * _tInterval; }
+
+/**
+ * Start over with the first cycle, the firing count is kept
+*/
+void ScheduleCore::reset()
+{
+    _cycle    = 0;
+    _inWindow = false;
+}
+
+/**
+ * What to do at the time nowMs: wait for the start of the cycle, wait
+ * for the next firing, fire or nothing more (all cycles done). At the
+ * stop time the cycle is advanced by the cycle period. FIRE counts the
+ * firing, the caller calls fired() after the callback has returned.
+ * With leadMs a firing is given leadMs before it is due, to make up
+ * for the time the caller needs to wake up (see LatencyCompensator).
+*/
+ScheduleCore::Step ScheduleCore::next(int64_t nowMs, int64_t leadMs)
+{
+    while (_cycle < _nbrOfCycles)
+    {
+        if (! _inWindow)
+        {
+            int64_t startMs = 1000LL * _tStart;
+            if (startMs > nowMs) return { WAIT_START, startMs - nowMs };
+            _tStart     = nowMs / 1000;   // remember start time of cycle
+            _inWindow   = true;
+            // due at the planned start, fires at once. Entered later than an interval after
+            // it (boot or resume within the window), due now: that time is not lateness.
+            _nextFireMs = nowMs - startMs > getIntervalMs() ? nowMs : startMs;
+        }
+        if (nowMs / 1000 >= _tStop)
+        {
+            _tStart  += _tCyclePeriod;
+            _tStop   += _tCyclePeriod - _tExtension;
+            _tExtension = 0;
+            _inWindow = false;
+            _cycle++;
+            continue;
+        }
+        if (nowMs < _nextFireMs - leadMs) return { WAIT, _nextFireMs - leadMs - nowMs };
+        _firings++;
+        return { FIRE, 0 };
+    }
+    return { DONE, 0 };
+}
+
+/**
+ * The callback has returned at nowMs, the next firing is one interval later
+*/
+void ScheduleCore::fired(int64_t nowMs) { _nextFireMs = nowMs + getIntervalMs(); }
+
+/**
+ * Leave out the next n firings, called after fired()
+*/
+void ScheduleCore::skip(uint32_t n) { _nextFireMs += n * getIntervalMs(); }
+
+/**
+ * Time the next firing is due, within the window. At FIRE the time
+ * it was due, so the lateness of the firing is nowMs - getDueMs().
+*/
+int64_t ScheduleCore::getDueMs() { return _nextFireMs; }
+
+uint32_t ScheduleCore::getCycle() { return _cycle; }
+
+uint32_t ScheduleCore::getFiringCount() { return _firings; }
+
+/**
+ * Number of times the callback is called in one cycle, i.e. how
+ * many task intervals fit between start and stop of the cycle.
+*/
+uint32_t ScheduleCore::getFiringsPerCycle()
+{
+    uint64_t windowMs   = 1000ULL * (_tStop - _tStart);
+    uint64_t intervalMs = getIntervalMs();
+
+    if (_tStop <= _tStart || intervalMs == 0) return 0;
+    return (windowMs + intervalMs - 1) / intervalMs;
+}
+
+/**
+ * Number of firings still to come according to the schedule. The
+ * count is incremented before the callback is called, so within the
+ * callback the current firing is no longer included. Since the time
+ * spent in the callback stretches the interval, the real number of
+ * firings may be smaller, i.e. the estimate errs on the safe side.
+*/
+uint32_t ScheduleCore::getRemainingFirings()
+{
+    uint64_t planned = static_cast<uint64_t>(getFiringsPerCycle()) * _nbrOfCycles;
+    return planned > _firings ? planned - _firings : 0;
+}
+
+/**
+ * The complete state, e.g. for the checkpoints of a recording
+*/
+ScheduleCore::State ScheduleCore::getState()
+{
+    return { _tStart, _tStop, _tInterval, _intervalMultiplier, _tCyclePeriod, _nbrOfCycles,
+             _cycle, _inWindow, _nextFireMs, _firings, _tExtension };
+}
+
+void ScheduleCore::setState(const State &state)
+{
+    _tStart             = state.tStart;
+    _tStop              = state.tStop;
+    _tInterval          = state.tInterval;
+    _intervalMultiplier = state.intervalMultiplier;
+    _tCyclePeriod       = state.tCyclePeriod;
+    _nbrOfCycles        = state.nbrOfCycles;
+    _cycle              = state.cycle;
+    _inWindow           = state.inWindow;
+    _nextFireMs         = state.nextFireMs;
+    _firings            = state.firings;
+    _tExtension         = state.tExtension;
+}
+
+bool ScheduleCore::_parseDateTime(const char dateTime[], time_t &t)
+{
+    tm td = {};
+
+    if (sscanf(dateTime, "%d-%d-%d %d:%d", &td.tm_year, &td.tm_mon, &td.tm_mday, &td.tm_hour, &td.tm_min) != 5) return false;
+    td.tm_year -= 1900;
+    td.tm_mon  -= 1;
+    td.tm_isdst = -1;
+    t = mktime(&td);
+    return t != -1;
+}
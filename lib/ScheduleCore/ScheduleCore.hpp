@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <ctime>
+
+/**
+ * Schedule of a StartStopTimer without any dependency on FreeRTOS or
+ * Arduino: the cycles with start and stop time, the task interval and
+ * the firings. The task of the timer asks the schedule what to do at
+ * the current time and waits, fires or ends accordingly. The same code
+ * runs in the host benchmarks and simulations under a fake clock.
+ *
+ * Times are epoch seconds for the schedule and epoch milliseconds for
+ * the clock readings passed in. The interval counts from the end of
+ * the callback (the time passed to fired()), as the task always did.
+ *
+ * Example:
+ *      ScheduleCore::Step step = schedule.next(nowMs);
+ *      if (step.action == ScheduleCore::FIRE) { callback(); schedule.fired(nowMs); }
+ *      else wait step.waitMs
+*/
+class ScheduleCore
+{
+    public:
+        enum Action { WAIT_START, WAIT, FIRE, DONE };
+
+        using Step = struct { Action action; int64_t waitMs; };
+
+        using State = struct { time_t tStart; time_t tStop; time_t tInterval; uint32_t intervalMultiplier;
+                               time_t tCyclePeriod; uint32_t nbrOfCycles; uint32_t cycle; bool inWindow;
+                               int64_t nextFireMs; uint32_t firings; time_t tExtension; };
+
+        ScheduleCore(){}
+
+        bool parse(const char startDateTime[], const char stopDateTime[], const char taskInterval[]);
+        void setStart(time_t tsecStart);
+        void setStop(time_t tsecStop);
+        void setInterval(time_t tsecInterval);
+        void setCyclePeriod(time_t tsecCyclePeriod);
+        void setNbrOfCycles(uint32_t nbrOfCycles);
+        void setIntervalMultiplier(uint32_t factor);
+        void extendWindow(time_t tsec);
+        time_t getStart();
+        time_t getStop();
+        time_t getInterval();
+        time_t getCyclePeriod();
+        uint32_t getNbrOfCycles();
+        int64_t getIntervalMs();
+
+        void reset();
+        Step next(int64_t nowMs, int64_t leadMs=0);
+        void fired(int64_t nowMs);
+        void skip(uint32_t n);
+        int64_t getDueMs();
+        uint32_t getCycle();
+        uint32_t getFiringCount();
+        uint32_t getFiringsPerCycle();
+        uint32_t getRemainingFirings();
+        State getState();
+        void setState(const State &state);
+
+    private:
+        time_t      _tStart             = 0;
+        time_t      _tStop              = 0;
+        time_t      _tInterval          = 1;
+        uint32_t    _intervalMultiplier = 1000;  // interval unit in ms
+        time_t      _tCyclePeriod       = 86400;
+        uint32_t    _nbrOfCycles        = 1;
+        uint32_t    _cycle              = 0;     // current cycle
+        bool        _inWindow           = false; // between start and stop of the cycle
+        int64_t     _nextFireMs         = 0;
+        uint32_t    _firings            = 0;
+        time_t      _tExtension         = 0;     // of the current window
+
+        static bool _parseDateTime(const char dateTime[], time_t &t);
+};
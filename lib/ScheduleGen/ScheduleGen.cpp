@@ -0,0 +1,64 @@
+#include <cmath>
+#include "ScheduleGen.hpp"
+
+const GenConfig ScheduleGen::DAY    = { 1000, 3600000, 3600, 86400, 86400, 7, 86400, 5000, 5 };
+const GenConfig ScheduleGen::STRESS = { 50, 2000, 30, 30, 0, 1, 30, 500, 5 };
+
+void ScheduleGen::init(uint32_t seed, const GenConfig &config)
+{
+    _state  = seed ? seed : 1;
+    _config = config;
+}
+
+/**
+ * Next random timer configuration
+*/
+TimerSpec ScheduleGen::next()
+{
+    const GenConfig &c = _config;
+    TimerSpec spec;
+
+    float logMin = logf(c.minIntervalMs);
+    float logMax = logf(c.maxIntervalMs);
+    spec.intervalMs     = expf(logMin + uniform() * (logMax - logMin));
+    spec.windowSec      = c.minWindowSec + random() % (c.maxWindowSec - c.minWindowSec + 1);
+    spec.startSec       = c.maxStartSec ? random() % (c.maxStartSec + 1) : 0;
+    spec.nbrOfCycles    = 1 + random() % (c.maxCycles ? c.maxCycles : 1);
+    spec.cyclePeriodSec = c.cyclePeriodSec;
+    spec.costUs         = random() % 100 < c.heavyTailPercent ? 10 * c.meanCostUs : c.meanCostUs;
+    return spec;
+}
+
+/**
+ * Cost of a firing in microseconds, exponentially distributed
+*/
+uint32_t ScheduleGen::cost(const TimerSpec &spec)
+{
+    return static_cast<uint32_t>(-logf(1.0f - uniform()) * spec.costUs);
+}
+
+uint32_t ScheduleGen::random()
+{
+    _state ^= _state << 13;
+    _state ^= _state >> 17;
+    _state ^= _state << 5;
+    return _state;
+}
+
+/**
+ * Uniform in [0, 1)
+*/
+float ScheduleGen::uniform() { return (random() >> 8) * (1.0f / 16777216.0f); }
+
+/**
+ * Configure a schedule with the spec, starting at t0 + startSec
+*/
+void ScheduleGen::apply(const TimerSpec &spec, ScheduleCore &schedule, time_t t0)
+{
+    schedule.setStart(t0 + spec.startSec);
+    schedule.setStop(t0 + spec.startSec + spec.windowSec);
+    schedule.setIntervalMultiplier(1);
+    schedule.setInterval(spec.intervalMs);
+    schedule.setCyclePeriod(spec.cyclePeriodSec);
+    schedule.setNbrOfCycles(spec.nbrOfCycles);
+}
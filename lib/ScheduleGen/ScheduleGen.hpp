@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <ctime>
+#include "ScheduleCore.hpp"
+
+/**
+ * Ranges of the random timer configurations. Intervals are drawn
+ * log-uniformly, so short and long intervals are equally frequent,
+ * windows and starts uniformly.
+*/
+using GenConfig = struct genc
+{
+    uint32_t minIntervalMs; uint32_t maxIntervalMs;
+    uint32_t minWindowSec;  uint32_t maxWindowSec;
+    uint32_t maxStartSec;           // latest start after t0
+    uint32_t maxCycles;  uint32_t cyclePeriodSec;
+    uint32_t meanCostUs;            // mean callback cost
+    uint8_t  heavyTailPercent;      // callbacks 10 times as expensive as the mean
+};
+
+/**
+ * Configuration of one random timer. The cost of each firing is drawn
+ * from an exponential distribution with the mean costUs, a few percent
+ * of the timers have a ten times heavier mean.
+*/
+using TimerSpec = struct tspec
+{
+    uint32_t startSec; uint32_t windowSec; uint32_t intervalMs;
+    uint32_t nbrOfCycles; uint32_t cyclePeriodSec; uint32_t costUs;
+};
+
+/**
+ * Seeded generator of random timer configurations for stress and
+ * scaling tests. The generator has its own PRNG (xorshift32), so a seed
+ * gives the same timers on the host and on the ESP32.
+ *
+ * Example:
+ *      ScheduleGen gen;
+ *      gen.init(42, ScheduleGen::DAY);
+ *      TimerSpec spec = gen.next();
+ *      gen.apply(spec, timer.getSchedule(), time(nullptr));
+*/
+class ScheduleGen
+{
+    public:
+        static const GenConfig DAY;     // realistic mix over a day, for the host simulation
+        static const GenConfig STRESS;  // short intervals for a stress run on the device
+
+        ScheduleGen(){}
+
+        void init(uint32_t seed, const GenConfig &config);
+        TimerSpec next();
+        uint32_t cost(const TimerSpec &spec);
+        uint32_t random();
+        float uniform();
+        static void apply(const TimerSpec &spec, ScheduleCore &schedule, time_t t0);
+
+    private:
+        uint32_t    _state  = 1;
+        GenConfig   _config = {};
+};
@@ -0,0 +1,397 @@
+#include <cstring>
+#include "ScheduleRecorder.hpp"
+
+/**
+ * Start an empty log in the buffer, which must stay valid while
+ * recording. The buffer should be 4-byte aligned.
+*/
+bool ScheduleRecorder::init(void *buf, size_t size, uint32_t nbrOfSegments)
+{
+    if (nbrOfSegments < 2 || size < sizeof(Header)) return false;
+    _segmentSize = (size - sizeof(Header)) / nbrOfSegments & ~3U;
+    if (_segmentSize < sizeof(Segment) + 4 * MAX_RECORD) return false;
+
+    _buf           = static_cast<uint8_t *>(buf);
+    _size          = size;
+    _nbrOfSegments = nbrOfSegments;
+    memset(_buf, 0, _size);
+    Header hdr = { MAGIC_LOG, _segmentSize, _nbrOfSegments, 0 };
+    memcpy(_buf, &hdr, sizeof(hdr));
+
+    for (int id = 0; id < MAX_TIMERS; id++) _cores[id] = nullptr;
+    _current      = 0;
+    _seq          = 0;
+    _lastMs       = 0;
+    _nbrOfRecords = 0;
+    _suppressed   = 0;
+    *_segment(_current) = { MAGIC_SEGMENT, _seq, sizeof(Segment), 0 };
+    _checkpoint();
+    return true;
+}
+
+/**
+ * Take over a log left in the buffer, e.g. in RTC memory after a crash
+ * or in a dump read on the host. Returns false if there is no valid log.
+ * Schedules attached afterwards get their state recorded as usual.
+*/
+bool ScheduleRecorder::load(void *buf, size_t size)
+{
+    Header hdr;
+    Record rec;
+
+    if (size < sizeof(Header)) return false;
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (hdr.magic != MAGIC_LOG || hdr.nbrOfSegments < 2 || hdr.segmentSize < sizeof(Segment) + 4 * MAX_RECORD) return false;
+    if (sizeof(Header) + static_cast<uint64_t>(hdr.segmentSize) * hdr.nbrOfSegments > size) return false;
+
+    _buf           = static_cast<uint8_t *>(buf);
+    _size          = size;
+    _segmentSize   = hdr.segmentSize;
+    _nbrOfSegments = hdr.nbrOfSegments;
+    for (int id = 0; id < MAX_TIMERS; id++) _cores[id] = nullptr;
+
+    bool found = false;
+    for (uint32_t i = 0; i < _nbrOfSegments; i++)
+    {
+        Segment *seg = _segment(i);
+        if (seg->magic != MAGIC_SEGMENT || seg->used < sizeof(Segment) || seg->used > _segmentSize) continue;
+        if (! found || seg->seq > _seq) { _current = i; _seq = seg->seq; }
+        found = true;
+    }
+    if (! found) return false;
+
+    _nbrOfRecords = 0;
+    _suppressed   = 0;
+    _lastMs       = 0;
+    for (bool ok = first(rec); ok; ok = next(rec))
+    {
+        _nbrOfRecords++;
+        if (rec.kind == CLOCK || rec.kind == FIRED || rec.kind == STEP || rec.kind == CHECKPOINT) _lastMs = rec.ms;
+    }
+    return true;
+}
+
+/**
+ * Record the schedule from now on, its state is written at once and
+ * at every checkpoint. Returns the id of the timer for the other calls
+ * or -1 if all ids are taken or the checkpoints would get too large.
+*/
+int ScheduleRecorder::attach(ScheduleCore &core)
+{
+    uint8_t rec[MAX_RECORD];
+    size_t  checkpointLen = MAX_RECORD;
+    int     id = -1;
+
+    if (! _buf) return -1;
+    for (int i = 0; i < MAX_TIMERS; i++)
+    {
+        if (_cores[i]) checkpointLen += _encodeState(rec, i);
+        else if (id < 0) id = i;
+    }
+    if (id < 0 || checkpointLen + MAX_RECORD > (_segmentSize - sizeof(Segment)) / 2) return -1;
+
+    _cores[id]      = &core;
+    _lastAction[id] = -1;
+    _append(rec, _encodeState(rec, id));
+    return id;
+}
+
+/**
+ * Stop recording the schedule, e.g. before its timer is destroyed
+*/
+void ScheduleRecorder::detach(int id)
+{
+    if (id >= 0 && id < MAX_TIMERS) _cores[id] = nullptr;
+}
+
+/**
+ * The schedule was asked what to do at nowMs (with leadMs) and answered with action
+*/
+void ScheduleRecorder::clock(int id, int64_t nowMs, ScheduleCore::Action action, int64_t leadMs)
+{
+    uint8_t rec[MAX_RECORD] = { CLOCK, static_cast<uint8_t>(id), static_cast<uint8_t>(action) };
+
+    if (id < 0 || id >= MAX_TIMERS || ! _cores[id]) return;
+    uint32_t cycle = _cores[id]->getCycle();
+    if (action == ScheduleCore::WAIT_START && _lastAction[id] == ScheduleCore::WAIT_START && cycle == _lastCycle[id])
+    {
+        _suppressed++;      // still waiting for the start, nothing changed
+        return;
+    }
+    _lastAction[id] = action;
+    _lastCycle[id]  = cycle;
+    size_t len = 3 + _putVarint(rec + 3, nowMs - _lastMs);
+    if (leadMs)
+    {
+        rec[2] |= WITH_LEAD;
+        len += _putVarint(rec + len, leadMs);
+    }
+    _lastMs = nowMs;        // before a checkpoint is written by _append()
+    _append(rec, len);
+}
+
+/**
+ * The callback of the schedule has returned at nowMs
+*/
+void ScheduleRecorder::fired(int id, int64_t nowMs)
+{
+    uint8_t rec[MAX_RECORD] = { FIRED, static_cast<uint8_t>(id), 0 };
+
+    if (id < 0 || id >= MAX_TIMERS || ! _cores[id]) return;
+    size_t len = 3 + _putVarint(rec + 3, nowMs - _lastMs);
+    _lastMs = nowMs;
+    _append(rec, len);
+}
+
+/**
+ * An API call on the schedule or its timer: a setter (SET_... with the
+ * new value), EXTEND (with the seconds), RESET, RESUME, SUSPEND, DELETE,
+ * TRIGGER (a firing outside the schedule), SKIP (with the number of
+ * firings) or STOP (the callback has ended the timer)
+*/
+void ScheduleRecorder::call(int id, Kind kind, int64_t value)
+{
+    uint8_t rec[MAX_RECORD] = { static_cast<uint8_t>(kind), static_cast<uint8_t>(id), 0 };
+    size_t  len = 3;
+
+    if (id < 0 || id >= MAX_TIMERS || ! _cores[id]) return;
+    if (_hasValue(kind)) len += _putVarint(rec + len, value);
+    _lastAction[id] = -1;
+    _append(rec, len);
+}
+
+/**
+ * Record the complete state of the schedule, e.g. after it has been
+ * changed in a way not covered by call()
+*/
+void ScheduleRecorder::snapshot(int id)
+{
+    uint8_t rec[MAX_RECORD];
+
+    if (id < 0 || id >= MAX_TIMERS || ! _cores[id]) return;
+    _lastAction[id] = -1;
+    _append(rec, _encodeState(rec, id));
+}
+
+/**
+ * The wall clock has been stepped by stepMs (e.g. by NTP), noticed at nowMs
+*/
+void ScheduleRecorder::step(int64_t nowMs, int64_t stepMs)
+{
+    uint8_t rec[MAX_RECORD] = { STEP, 0xFF, 0 };
+    size_t  len = 3;
+
+    if (! _buf) return;
+    len += _putVarint(rec + len, nowMs - _lastMs);
+    len += _putVarint(rec + len, stepMs);
+    _lastMs = nowMs;
+    _append(rec, len);
+}
+
+/**
+ * The oldest record left in the log
+*/
+bool ScheduleRecorder::first(Record &rec)
+{
+    _readSegment = 0;
+    _readPos     = sizeof(Segment);
+    _readMs      = 0;
+    return next(rec);
+}
+
+/**
+ * The next record, the segments are read from the oldest to the newest.
+ * The clock differences are resolved, ms is the absolute time in ms,
+ * value the new value of a setter, the lead of a clock reading or the
+ * step of a clock step.
+*/
+bool ScheduleRecorder::next(Record &rec)
+{
+    Segment *seg = nullptr;
+
+    if (! _buf) return false;
+    while (_readSegment < _nbrOfSegments)
+    {
+        seg = _segment((_current + 1 + _readSegment) % _nbrOfSegments);
+        if (seg->magic == MAGIC_SEGMENT && seg->used <= _segmentSize && _readPos < seg->used) break;
+        _readSegment++;
+        _readPos = sizeof(Segment);
+        _readMs  = 0;
+        seg      = nullptr;
+    }
+    if (! seg) return false;
+
+    const uint8_t *base = reinterpret_cast<const uint8_t *>(seg);
+    const uint8_t *p    = base + _readPos;
+    const uint8_t *end  = base + seg->used;
+    int64_t        v[STATE_VALUES];
+    int            nbrOfValues = 0;
+    size_t         n;
+
+    if (end - p < 3) return false;
+    rec        = {};
+    rec.kind   = static_cast<Kind>(p[0]);
+    rec.timer  = p[1] == 0xFF ? -1 : p[1];
+    rec.action = p[2] & ~WITH_LEAD;
+    bool withLead = p[2] & WITH_LEAD;
+    p += 3;
+
+    switch (rec.kind)
+    {
+        case STATE:      nbrOfValues = STATE_VALUES; break;
+        case STEP:       nbrOfValues = 2;  break;
+        case CHECKPOINT:
+        case CLOCK:      nbrOfValues = withLead ? 2 : 1; break;
+        case FIRED:      nbrOfValues = 1;  break;
+        default:         nbrOfValues = _hasValue(rec.kind) ? 1 : 0;
+                         if (rec.kind > STOP) return false;
+    }
+    for (int i = 0; i < nbrOfValues; i++)
+    {
+        if ((n = _getVarint(p, end, v[i])) == 0) return false;
+        p += n;
+    }
+
+    switch (rec.kind)
+    {
+        case CHECKPOINT: _readMs = rec.ms = v[0]; break;
+        case CLOCK:      _readMs = rec.ms = _readMs + v[0]; rec.value = nbrOfValues > 1 ? v[1] : 0; break;
+        case FIRED:      _readMs = rec.ms = _readMs + v[0]; break;
+        case STEP:       _readMs = rec.ms = _readMs + v[0]; rec.value = v[1]; break;
+        case STATE:      rec.ms    = _readMs;
+                         rec.state = { static_cast<time_t>(v[0]), static_cast<time_t>(v[1]), static_cast<time_t>(v[2]),
+                                       static_cast<uint32_t>(v[3]), static_cast<time_t>(v[4]), static_cast<uint32_t>(v[5]),
+                                       static_cast<uint32_t>(v[6]), v[7] != 0, v[8], static_cast<uint32_t>(v[9]),
+                                       static_cast<time_t>(v[10]) };
+                         break;
+        default:         rec.ms    = _readMs;
+                         rec.value = nbrOfValues ? v[0] : 0;
+    }
+    _readPos = p - base;
+    return true;
+}
+
+/**
+ * The whole buffer, to be written to a file for the replay
+*/
+const void *ScheduleRecorder::data() { return _buf; }
+
+size_t ScheduleRecorder::size() { return _size; }
+
+uint32_t ScheduleRecorder::getNbrOfRecords() { return _nbrOfRecords; }
+
+/**
+ * Polls not recorded since they did not change the schedule
+*/
+uint32_t ScheduleRecorder::getNbrOfSuppressed() { return _suppressed; }
+
+uint32_t ScheduleRecorder::getNbrOfSegments() { return _nbrOfSegments; }
+
+const char *ScheduleRecorder::kindName(Kind kind)
+{
+    static const char *names[] = { "checkpoint", "state", "clock", "fired", "step", "setStart", "setStop",
+                                   "setInterval", "setPeriod", "setCycles", "setMultiplier", "extend", "reset",
+                                   "resume", "suspend", "delete", "trigger", "skip", "stop" };
+    return kind <= STOP ? names[kind] : "?";
+}
+
+/**
+ * Kinds of call() with a value
+*/
+bool ScheduleRecorder::_hasValue(Kind kind)
+{
+    return (kind >= SET_START && kind <= EXTEND) || kind == SKIP;
+}
+
+ScheduleRecorder::Segment *ScheduleRecorder::_segment(uint32_t index)
+{
+    return reinterpret_cast<Segment *>(_buf + sizeof(Header) + index * _segmentSize);
+}
+
+/**
+ * The clock base and the state of all attached schedules, written at
+ * the start of a segment so that the replay can start there
+*/
+void ScheduleRecorder::_checkpoint()
+{
+    uint8_t rec[MAX_RECORD] = { CHECKPOINT, 0xFF, 0 };
+
+    _append(rec, 3 + _putVarint(rec + 3, _lastMs));
+    for (int id = 0; id < MAX_TIMERS; id++)
+    {
+        if (_cores[id]) _append(rec, _encodeState(rec, id));
+    }
+}
+
+/**
+ * Append the record to the current segment. When there is no room
+ * left for a further record, the next segment is started with a
+ * checkpoint. At that point all recorded inputs have been applied
+ * to the schedules, so the checkpoint matches the replay.
+*/
+void ScheduleRecorder::_append(const uint8_t *rec, size_t len)
+{
+    Segment *seg = _segment(_current);
+
+    memcpy(reinterpret_cast<uint8_t *>(seg) + seg->used, rec, len);
+    seg->used += len;
+    _nbrOfRecords++;
+    if (seg->used + MAX_RECORD <= _segmentSize) return;
+
+    _current = (_current + 1) % _nbrOfSegments;
+    *_segment(_current) = { MAGIC_SEGMENT, ++_seq, sizeof(Segment), 0 };
+    _checkpoint();
+}
+
+size_t ScheduleRecorder::_encodeState(uint8_t *rec, int id)
+{
+    ScheduleCore::State s = _cores[id]->getState();
+    int64_t v[STATE_VALUES] = { s.tStart, s.tStop, s.tInterval, s.intervalMultiplier, s.tCyclePeriod, s.nbrOfCycles,
+                                s.cycle, s.inWindow, s.nextFireMs, s.firings, s.tExtension };
+    size_t  len = 3;
+
+    rec[0] = STATE;
+    rec[1] = id;
+    rec[2] = 0;
+    for (int i = 0; i < STATE_VALUES; i++) len += _putVarint(rec + len, v[i]);
+    return len;
+}
+
+/**
+ * Zigzag varint, small values of either sign take few bytes
+*/
+size_t ScheduleRecorder::_putVarint(uint8_t *p, int64_t v)
+{
+    uint64_t u = (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+    size_t   n = 0;
+
+    while (u >= 0x80)
+    {
+        p[n++] = static_cast<uint8_t>(u) | 0x80;
+        u >>= 7;
+    }
+    p[n++] = static_cast<uint8_t>(u);
+    return n;
+}
+
+/**
+ * Returns the number of bytes read, 0 if the varint is truncated
+*/
+size_t ScheduleRecorder::_getVarint(const uint8_t *p, const uint8_t *end, int64_t &v)
+{
+    uint64_t u = 0;
+    size_t   n = 0;
+
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (p + n >= end) return 0;
+        uint8_t b = p[n++];
+        u |= static_cast<uint64_t>(b & 0x7F) << shift;
+        if (! (b & 0x80))
+        {
+            v = static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+            return n;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include "ScheduleCore.hpp"
+
+/**
+ * Ring log of the external inputs of a set of schedules: the clock
+ * readings passed to next() and fired(), the API calls (setters,
+ * resume, suspend, delete, triggers, control codes of the callbacks)
+ * and the time steps, e.g. by NTP. A host
+ * replayer feeds the log into the same ScheduleCore code and gets the
+ * same decisions, so a timing bug seen once on the device can be
+ * stepped through and profiled offline.
+ *
+ * The buffer is divided into segments which are used in turn, the
+ * oldest is overwritten when the last one is full. Each segment starts
+ * with a checkpoint, the state of all attached schedules, so replay
+ * can start at the oldest segment left. Records are a kind byte, the
+ * timer id and zigzag varints; clock readings are stored as the
+ * difference to the previous one, i.e. mostly 4 or 5 bytes. The lead
+ * passed to next() is stored only if there is one.
+ *
+ * Polls which do not change a schedule (WAIT_START again while the
+ * timer waits for its cycle) are not recorded, they would only flood
+ * the log and the replay does not need them.
+ *
+ * The recorder is not thread safe, the caller serializes the calls.
+ *
+ * Example:
+ *      recorder.init(buf, sizeof(buf));
+ *      int id = recorder.attach(schedule);
+ *      ScheduleCore::Step step = schedule.next(nowMs);
+ *      recorder.clock(id, nowMs, step.action);
+*/
+class ScheduleRecorder
+{
+    public:
+        static const int MAX_TIMERS = 8;
+
+        enum Kind { CHECKPOINT, STATE, CLOCK, FIRED, STEP, SET_START, SET_STOP, SET_INTERVAL,
+                    SET_PERIOD, SET_CYCLES, SET_MULTIPLIER, EXTEND, RESET, RESUME, SUSPEND, DELETE, TRIGGER,
+                    SKIP, STOP };
+
+        using Record = struct { Kind kind; int timer; int action; int64_t ms; int64_t value;
+                                ScheduleCore::State state; };
+
+        ScheduleRecorder(){}
+
+        bool init(void *buf, size_t size, uint32_t nbrOfSegments=4);
+        bool load(void *buf, size_t size);
+        int attach(ScheduleCore &core);
+        void detach(int id);
+        void clock(int id, int64_t nowMs, ScheduleCore::Action action, int64_t leadMs=0);
+        void fired(int id, int64_t nowMs);
+        void call(int id, Kind kind, int64_t value=0);
+        void snapshot(int id);
+        void step(int64_t nowMs, int64_t stepMs);
+        bool first(Record &rec);
+        bool next(Record &rec);
+        const void *data();
+        size_t size();
+        uint32_t getNbrOfRecords();
+        uint32_t getNbrOfSuppressed();
+        uint32_t getNbrOfSegments();
+        static const char *kindName(Kind kind);
+
+    private:
+        static const uint32_t MAGIC_LOG     = 0x314C5253;  // "SRL1"
+        static const uint32_t MAGIC_SEGMENT = 0x31474553;  // "SEG1"
+        static const int      STATE_VALUES  = 11;
+        static const size_t   MAX_RECORD    = 3 + STATE_VALUES * 10; // kind, timer, action, varints
+        static const uint8_t  WITH_LEAD     = 0x80;        // flag of the action of a clock record
+
+        using Header  = struct { uint32_t magic; uint32_t segmentSize; uint32_t nbrOfSegments; uint32_t reserved; };
+        using Segment = struct { uint32_t magic; uint32_t seq; uint32_t used; uint32_t reserved; };
+
+        uint8_t      *_buf           = nullptr;
+        size_t        _size          = 0;
+        uint32_t      _segmentSize   = 0;
+        uint32_t      _nbrOfSegments = 0;
+        uint32_t      _current       = 0;     // segment written to
+        uint32_t      _seq           = 0;     // of the current segment
+        int64_t       _lastMs        = 0;     // base of the clock differences
+        ScheduleCore *_cores[MAX_TIMERS] = {};
+        int8_t        _lastAction[MAX_TIMERS];
+        uint32_t      _lastCycle[MAX_TIMERS];
+        uint32_t      _nbrOfRecords  = 0;
+        uint32_t      _suppressed    = 0;
+        // reader
+        uint32_t      _readSegment   = 0;     // segments read so far, oldest first
+        uint32_t      _readPos       = 0;
+        int64_t       _readMs        = 0;
+
+        Segment      *_segment(uint32_t index);
+        void          _checkpoint();
+        void          _append(const uint8_t *rec, size_t len);
+        size_t        _encodeState(uint8_t *rec, int id);
+        static bool   _hasValue(Kind kind);
+        static size_t _putVarint(uint8_t *p, int64_t v);
+        static size_t _getVarint(const uint8_t *p, const uint8_t *end, int64_t &v);
+};
@@ -0,0 +1,80 @@
+#include <esp_heap_caps.h>
+#include <soc/soc_memory_layout.h>
+#include "SdRawCard.hpp"
+#include "BlockLog.hpp"
+
+/**
+ * Initialize the card in 1-bit mode (GPIO 4 remains free for the
+ * flash led) and find the log partition
+*/
+bool SdRawCard::begin(bool mode1bit)
+{
+    sdmmc_host_t        host = SDMMC_HOST_DEFAULT();
+    sdmmc_slot_config_t slot = SDMMC_SLOT_CONFIG_DEFAULT();
+
+    host.max_freq_khz = SDMMC_FREQ_HIGHSPEED;
+    if (mode1bit) 
+    {
+        host.flags = SDMMC_HOST_FLAG_1BIT;
+        slot.width = 1;
+    }
+    slot.flags |= SDMMC_SLOT_FLAG_INTERNAL_PULLUP;
+
+    if (! _bounce) _bounce = static_cast<uint8_t *>(heap_caps_malloc(BOUNCE_BLOCKS * BLOCK_SIZE, MALLOC_CAP_DMA));
+    if (! _bounce || sdmmc_host_init() != ESP_OK) return false;
+    _started = true;
+    if (sdmmc_host_init_slot(host.slot, &slot) != ESP_OK || sdmmc_card_init(&host, &_card) != ESP_OK)
+    {
+        log_e("no SD card");
+        end();
+        return false;
+    }
+
+    _first       = 0;
+    _nbrOfBlocks = _card.csd.capacity;
+    if (sdmmc_read_sectors(&_card, _bounce, 0, 1) != ESP_OK || ! BlockLog::findPartition(_bounce, _first, _nbrOfBlocks))
+    {
+        log_e("no partition of type 0x%02X on the card", BlockLog::PARTITION_TYPE);
+        end();
+        return false;
+    }
+    log_i("log partition: %u MB at block %u", _nbrOfBlocks / 2048, _first);
+    log_i("==> done");
+    return true;
+}
+
+void SdRawCard::end()
+{
+    if (_started) sdmmc_host_deinit();
+    _started     = false;
+    _nbrOfBlocks = 0;
+}
+
+uint32_t SdRawCard::getNbrOfBlocks() { return _nbrOfBlocks; }
+
+bool SdRawCard::readBlocks(uint32_t lba, void *buf, uint32_t n)
+{
+    if (lba + n > _nbrOfBlocks) return false;
+    return sdmmc_read_sectors(&_card, buf, _first + lba, n) == ESP_OK;
+}
+
+bool SdRawCard::writeBlocks(uint32_t lba, const void *buf, uint32_t n)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(buf);
+
+    if (lba + n > _nbrOfBlocks) return false;
+    if (esp_ptr_dma_capable(p) && reinterpret_cast<uintptr_t>(p) % 4 == 0)
+    {
+        return sdmmc_write_sectors(&_card, p, _first + lba, n) == ESP_OK;
+    }
+    while (n > 0)
+    {
+        uint32_t chunk = min(n, BOUNCE_BLOCKS);
+        memcpy(_bounce, p, chunk * BLOCK_SIZE);
+        if (sdmmc_write_sectors(&_card, _bounce, _first + lba, chunk) != ESP_OK) return false;
+        p   += chunk * BLOCK_SIZE;
+        lba += chunk;
+        n   -= chunk;
+    }
+    return true;
+}
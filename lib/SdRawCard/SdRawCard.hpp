@@ -0,0 +1,41 @@
+#pragma once
+#include <Arduino.h>
+#include <driver/sdmmc_host.h>
+#include <sdmmc_cmd.h>
+#include "BlockDevice.hpp"
+
+/**
+ * The raw log partition of the SD card as block device. The card is
+ * initialized without file system (SD_MMC must not be mounted) and the
+ * partition of type 0xDA is looked up in the master boot record, so the
+ * card can still have a FAT partition in front of it.
+ *
+ * Buffers in PSRAM (camera frames) are not DMA capable, the SDMMC
+ * driver would write them one block per command. They are copied in
+ * chunks to an internal buffer instead, so the card gets multi-block
+ * writes.
+ *
+ * Example:
+ *      rawCard.begin();
+ *      if (! rawLog.mount(&rawCard)) rawLog.format(&rawCard);
+*/
+class SdRawCard : public BlockDevice
+{
+    public:
+        SdRawCard(){}
+
+        bool begin(bool mode1bit=true);
+        void end();
+        uint32_t getNbrOfBlocks() override;
+        bool readBlocks(uint32_t lba, void *buf, uint32_t n) override;
+        bool writeBlocks(uint32_t lba, const void *buf, uint32_t n) override;
+
+    private:
+        static const uint32_t BOUNCE_BLOCKS = 32;
+
+        sdmmc_card_t  _card;
+        uint8_t      *_bounce      = nullptr;
+        uint32_t      _first       = 0;   // first block of the partition
+        uint32_t      _nbrOfBlocks = 0;
+        bool          _started     = false;
+};
@@ -0,0 +1,45 @@
+#include "SeqAllocator.hpp"
+
+/**
+ * Open the NVS namespace of the sequence and reserve the first block.
+ * The name must not be longer than 15 characters.
+*/
+void SeqAllocator::init(const char name[], uint32_t blockSize)
+{
+    _blockSize = max(blockSize, 1U);
+    _mutex = xSemaphoreCreateMutex();
+    _prefs.begin(name, false);
+    _next = _prefs.getUInt("reserved", 0);
+    _reserve();
+    log_i("%s: resume at %u", name, _next);
+}
+
+/**
+ * Next sequence number, NVS is only written when a new block is needed
+*/
+uint32_t SeqAllocator::next()
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (_next >= _reserved) _reserve();
+    uint32_t nbr = _next++;
+    _nbrOfNumbers++;
+    xSemaphoreGive(_mutex);
+    return nbr;
+}
+
+uint32_t SeqAllocator::getNbrOfNumbers() { return _nbrOfNumbers; }
+
+uint32_t SeqAllocator::getNvsWrites() { return _nvsWrites; }
+
+void SeqAllocator::printStats()
+{
+    log_i("numbers: %u, NVS writes: %u (%.1f per 1000 numbers)", _nbrOfNumbers, _nvsWrites, 
+          _nbrOfNumbers ? 1000.0f * _nvsWrites / _nbrOfNumbers : 0.0f);
+}
+
+void SeqAllocator::_reserve()
+{
+    _reserved = _next + _blockSize;
+    if (_prefs.putUInt("reserved", _reserved) == 0) log_e("NVS write failed");
+    _nvsWrites++;
+}
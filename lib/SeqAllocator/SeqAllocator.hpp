@@ -0,0 +1,40 @@
+#pragma once
+#include <Arduino.h>
+#include <Preferences.h>
+
+/**
+ * Sequence numbers which survive a reboot, e.g. for the file names of
+ * the photos. Writing the counter to NVS on every capture would wear
+ * the flash, so blocks of numbers are reserved in NVS and handed out
+ * from RAM. Only the end of the reserved block is stored. After a
+ * reboot or crash the numbering resumes with the next block, the
+ * unused rest of the previous block is skipped.
+ *
+ * With a block size of 100 there are 10 NVS writes per 1000 numbers.
+ * The allocator may be shared by several tasks.
+ *
+ * Example:
+ *      photoSeq.init("photos");
+ *      snprintf(path, sizeof(path), "/photo%05u.jpg", photoSeq.next());
+*/
+class SeqAllocator
+{
+    public:
+        SeqAllocator(){}
+
+        void init(const char name[], uint32_t blockSize=100);
+        uint32_t next();
+        uint32_t getNbrOfNumbers();
+        uint32_t getNvsWrites();
+        void printStats();
+
+    private:
+        Preferences       _prefs;
+        SemaphoreHandle_t _mutex     = nullptr;
+        uint32_t          _blockSize = 100;
+        uint32_t          _next      = 0;    // next number to hand out
+        uint32_t          _reserved  = 0;    // end of the reserved block (exclusive)
+        uint32_t          _nbrOfNumbers = 0; // numbers handed out since boot
+        uint32_t          _nvsWrites = 0;    // NVS writes since boot
+        void              _reserve();
+};
@@ -0,0 +1,102 @@
+#include <cstring>
+#include "Sharpness.hpp"
+
+static const uint32_t LANES = 0x00FF00FF;  // bytes 0 and 2 of a word in 16-bit lanes
+static const uint32_t BIAS  = 0x03FC03FC;  // 1020 per lane keeps the lanes positive
+static const int      BIAS1 = 0x03FC;
+
+static inline uint32_t load32(const uint8_t *p)
+{
+    uint32_t w;
+    memcpy(&w, p, sizeof(w));   // unaligned load
+    return w;
+}
+
+static inline float variance(int64_t sum, uint64_t sumSq, uint64_t n)
+{
+    if (n == 0) return 0.0f;
+    double mean = static_cast<double>(sum) / n;
+    return static_cast<float>(static_cast<double>(sumSq) / n - mean * mean);
+}
+
+/**
+ * Variance of the 4-neighbour Laplacian over the interior of the image.
+ * Per lane 4 * c + 1020 - (l + r + u + d) lies within 0..2040, so the
+ * lanes can neither carry nor borrow into each other.
+*/
+float Sharpness::laplacianVariance(const uint8_t *gray, int width, int height, int stride)
+{
+    int64_t  sum   = 0;
+    uint64_t sumSq = 0;
+
+    for (int y = 1; y < height - 1; y++)
+    {
+        const uint8_t *row  = gray + y * stride;
+        const uint8_t *up   = row - stride;
+        const uint8_t *down = row + stride;
+        int x = 1;
+
+        for ( ; x + 4 < width; x += 4)
+        {
+            uint32_t c = load32(row + x);
+            uint32_t l = load32(row + x - 1);
+            uint32_t r = load32(row + x + 1);
+            uint32_t u = load32(up + x);
+            uint32_t d = load32(down + x);
+
+            uint32_t even = ((c & LANES) << 2) + BIAS
+                          - ((l & LANES) + (r & LANES) + (u & LANES) + (d & LANES));
+            uint32_t odd  = (((c >> 8) & LANES) << 2) + BIAS
+                          - (((l >> 8) & LANES) + ((r >> 8) & LANES) + ((u >> 8) & LANES) + ((d >> 8) & LANES));
+
+            int v0 = static_cast<int>(even & 0xFFFF) - BIAS1;
+            int v1 = static_cast<int>(odd & 0xFFFF)  - BIAS1;
+            int v2 = static_cast<int>(even >> 16)    - BIAS1;
+            int v3 = static_cast<int>(odd >> 16)     - BIAS1;
+            sum   += v0 + v1 + v2 + v3;
+            sumSq += v0 * v0 + v1 * v1 + v2 * v2 + v3 * v3;
+        }
+        for ( ; x < width - 1; x++)
+        {
+            int v = 4 * row[x] - row[x - 1] - row[x + 1] - up[x] - down[x];
+            sum   += v;
+            sumSq += v * v;
+        }
+    }
+    return variance(sum, sumSq, static_cast<uint64_t>(width - 2) * (height - 2));
+}
+
+/**
+ * Reference implementation, one pixel at a time
+*/
+float Sharpness::laplacianVarianceScalar(const uint8_t *gray, int width, int height, int stride)
+{
+    int64_t  sum   = 0;
+    uint64_t sumSq = 0;
+
+    for (int y = 1; y < height - 1; y++)
+    {
+        const uint8_t *row = gray + y * stride;
+        for (int x = 1; x < width - 1; x++)
+        {
+            int v = 4 * row[x] - row[x - 1] - row[x + 1] - row[x - stride] - row[x + stride];
+            sum   += v;
+            sumSq += v * v;
+        }
+    }
+    return variance(sum, sumSq, static_cast<uint64_t>(width - 2) * (height - 2));
+}
+
+/**
+ * Convert big endian RGB565 (as delivered by jpg2rgb565) to 8-bit luminance
+*/
+void Sharpness::rgb565ToGray(const uint8_t *rgb565, uint8_t *gray, size_t nbrOfPixels)
+{
+    for (size_t i = 0; i < nbrOfPixels; i++, rgb565 += 2)
+    {
+        uint32_t r = rgb565[0] & 0xF8;
+        uint32_t g = ((rgb565[0] & 0x07) << 5) | ((rgb565[1] & 0xE0) >> 3);
+        uint32_t b = (rgb565[1] & 0x1F) << 3;
+        gray[i] = (77 * r + 150 * g + 29 * b) >> 8;
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Focus metric for selecting the sharpest frame of a burst. The score
+ * is the variance of the Laplacian of a (downscaled) grayscale image,
+ * blurred frames have less high frequency content and a lower score.
+ *
+ * The Laplacian is computed with SWAR (SIMD within a register) integer
+ * kernels, four pixels per iteration in two 32-bit words of 16-bit lanes.
+ * The scalar reference gives identical results and is used by the host
+ * benchmark. There are no dependencies on Arduino.
+ *
+ * Example:
+ *      Sharpness::rgb565ToGray(rgb, gray, width * height);
+ *      float score = Sharpness::laplacianVariance(gray, width, height, width);
+*/
+class Sharpness
+{
+    public:
+        static float laplacianVariance(const uint8_t *gray, int width, int height, int stride);
+        static float laplacianVarianceScalar(const uint8_t *gray, int width, int height, int stride);
+        static void rgb565ToGray(const uint8_t *rgb565, uint8_t *gray, size_t nbrOfPixels);
+};
@@ -0,0 +1,250 @@
+#include <esp_timer.h>
+#include "StagePipeline.hpp"
+
+/**
+ * Reserve the jobs and their contexts. At most nbrOfJobs firings are
+ * in flight at once, each with a context of ctxSize bytes.
+*/
+bool StagePipeline::init(uint32_t nbrOfJobs, size_t ctxSize)
+{
+    _nbrOfJobs = constrain(nbrOfJobs, 1U, static_cast<uint32_t>(MAX_JOBS));
+    _ctxSize   = ctxSize;
+    if (ctxSize)
+    {
+        _ctx = static_cast<uint8_t *>(calloc(_nbrOfJobs, ctxSize));
+        if (! _ctx)
+        {
+            log_e("no memory for the job contexts");
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < _nbrOfJobs; i++)
+    {
+        _jobs[i] = {};
+        _jobs[i].job.ctx = _ctx ? _ctx + i * ctxSize : nullptr;
+    }
+    return true;
+}
+
+/**
+ * Declare a worker task, it is created by begin(). Returns
+ * the worker id for addStage(), -1 if there are too many.
+*/
+int StagePipeline::addWorker(const char name[], uint32_t stackDepth, UBaseType_t priority, BaseType_t core)
+{
+    if (_started || _nbrOfWorkers >= MAX_WORKERS)
+    {
+        log_e("worker %s not added", name);
+        return -1;
+    }
+    _workers[_nbrOfWorkers] = { name, stackDepth, priority, core, nullptr, this };
+    return _nbrOfWorkers++;
+}
+
+/**
+ * Declare a stage running on the worker after the stages in the mask
+ * after (bit n for stage id n), which must have been added before.
+ * Stages with always run even if a stage before them failed.
+ * Returns the stage id, -1 if the stage is not valid.
+*/
+int StagePipeline::addStage(const char name[], Stage stage, int worker, uint32_t after, bool always)
+{
+    if (_started || _nbrOfStages >= MAX_STAGES || ! stage || worker < 0 || worker >= _nbrOfWorkers
+        || (after >> _nbrOfStages) != 0)
+    {
+        log_e("stage %s not added", name);
+        return -1;
+    }
+    _stages[_nbrOfStages] = { name, stage, worker, after, always };
+    if (after == 0) _roots |= 1U << _nbrOfStages;
+    _allStages |= 1U << _nbrOfStages;
+    return _nbrOfStages++;
+}
+
+/**
+ * Create the queues and tasks of the workers. A queue holds all
+ * stages of the worker for all jobs, so queueing never blocks.
+*/
+bool StagePipeline::begin()
+{
+    if (_started || _nbrOfJobs == 0 || _nbrOfStages == 0) return false;
+    for (int w = 0; w < _nbrOfWorkers; w++)
+    {
+        uint32_t n = 0;
+        for (int s = 0; s < _nbrOfStages; s++) if (_stages[s].worker == w) n++;
+        _workers[w].queue = xQueueCreate(max(n, 1U) * _nbrOfJobs, sizeof(Item));
+        if (! _workers[w].queue
+            || xTaskCreatePinnedToCore(_taskFunction, _workers[w].name, _workers[w].stackDepth, &_workers[w],
+                                       _workers[w].priority, nullptr, _workers[w].core) != pdPASS)
+        {
+            log_e("worker %s not created", _workers[w].name);
+            return false;
+        }
+    }
+    _started = true;
+    log_i("==> done");
+    return true;
+}
+
+/**
+ * Start a firing through the stages without waiting for it.
+ * Returns false if all jobs are in flight and the firing is dropped.
+*/
+bool StagePipeline::fire()
+{
+    int job = -1;
+
+    if (! _started) return false;
+    portENTER_CRITICAL(&_mux);
+    for (uint32_t i = 0; i < _nbrOfJobs && job < 0; i++) if (! (_busy & (1U << i))) job = i;
+    if (job < 0)
+    {
+        _dropped++;
+        portEXIT_CRITICAL(&_mux);
+        return false;
+    }
+    _busy |= 1U << job;
+    _jobs[job].queued  = _roots;
+    _jobs[job].done    = 0;
+    _jobs[job].failed  = 0;
+    _jobs[job].job.seq = _seq++;
+    _fired++;
+    _maxInFlight = max(_maxInFlight, static_cast<uint32_t>(__builtin_popcount(_busy)));
+    portEXIT_CRITICAL(&_mux);
+
+    if (_ctxSize) memset(_jobs[job].job.ctx, 0, _ctxSize);
+    _jobs[job].job.startUs = esp_timer_get_time();
+    _enqueue(job, _roots, _jobs[job].job.startUs);
+    return true;
+}
+
+uint32_t StagePipeline::getNbrOfInFlight()
+{
+    portENTER_CRITICAL(&_mux);
+    uint32_t n = __builtin_popcount(_busy);
+    portEXIT_CRITICAL(&_mux);
+    return n;
+}
+
+uint32_t StagePipeline::getNbrOfDropped() { return _dropped; }
+
+StageStats StagePipeline::getStats(int stage)
+{
+    return stage >= 0 && stage < _nbrOfStages ? _stats[stage] : StageStats{};
+}
+
+/**
+ * Firings and, per stage, the mean and max of wait, run time and queue depth
+*/
+void StagePipeline::printStats(const char name[])
+{
+    log_i("%s: %u fired, %u dropped, %u completed, %u failed, %u in flight max, latency mean %lld max %lld us",
+          name, _fired, _dropped, _completed, _failed, _maxInFlight,
+          _completed + _failed ? _sumLatencyUs / (_completed + _failed) : 0, _maxLatencyUs);
+    for (int s = 0; s < _nbrOfStages; s++)
+    {
+        StageStats st = _stats[s];
+        uint32_t   n  = max(st.runs, 1U);
+        log_i("%s: %-10s on %-8s %u runs, %u skipped, wait mean %lld max %lld us, run mean %lld max %lld us, queue mean %.1f max %u",
+              name, _stages[s].name, _workers[_stages[s].worker].name, st.runs, st.skipped, st.sumWaitUs / n, st.maxWaitUs,
+              st.sumRunUs / n, st.maxRunUs, st.queued ? static_cast<float>(st.sumDepth) / st.queued : 0.0f, st.maxDepth);
+    }
+}
+
+/**
+ * Run the stages queued for the worker, in the order they got ready
+*/
+void StagePipeline::_taskFunction(void *params)
+{
+    Worker *w = static_cast<Worker *>(params);
+    Item    item;
+
+    for (;;)
+    {
+        if (xQueueReceive(w->queue, &item, portMAX_DELAY) == pdTRUE) w->pipeline->_run(item);
+    }
+}
+
+/**
+ * Run one stage of a job, or skip it if a stage it comes after has
+ * failed or was skipped. A skipped stage counts as failed for its
+ * successors. Each stage runs on one worker only, so its run
+ * statistics are not shared.
+*/
+void StagePipeline::_run(const Item &item)
+{
+    const StageDef &def = _stages[item.stage];
+    StageStats     &st  = _stats[item.stage];
+    Job            &job = _jobs[item.job];
+    int64_t         t0  = esp_timer_get_time();
+    bool            ok  = true;
+
+    if ((job.failed & def.after) && ! def.always)
+    {
+        st.skipped++;
+        ok = false;
+    }
+    else
+    {
+        ok = def.stage(job.job);
+        int64_t runUs  = esp_timer_get_time() - t0;
+        int64_t waitUs = t0 - item.readyUs;
+        st.runs++;
+        st.sumRunUs  += runUs;
+        st.maxRunUs   = max(st.maxRunUs, runUs);
+        st.sumWaitUs += waitUs;
+        st.maxWaitUs  = max(st.maxWaitUs, waitUs);
+    }
+    _complete(item.job, item.stage, ok, esp_timer_get_time());
+}
+
+/**
+ * Hand the stages of a job, which are ready now, to their workers
+*/
+void StagePipeline::_enqueue(int job, uint32_t stages, int64_t nowUs)
+{
+    for (int s = 0; stages; s++, stages >>= 1)
+    {
+        if (! (stages & 1)) continue;
+        Item          item  = { static_cast<uint8_t>(job), static_cast<uint8_t>(s), nowUs };
+        QueueHandle_t queue = _workers[_stages[s].worker].queue;
+        uint32_t      depth = uxQueueMessagesWaiting(queue) + 1;
+
+        portENTER_CRITICAL(&_mux);
+        _stats[s].queued++;
+        _stats[s].sumDepth += depth;
+        _stats[s].maxDepth  = max(_stats[s].maxDepth, depth);
+        portEXIT_CRITICAL(&_mux);
+        xQueueSend(queue, &item, 0);
+    }
+}
+
+/**
+ * Mark the stage of the job done and queue the stages whose
+ * predecessors are all done. After the last stage the job is free.
+*/
+void StagePipeline::_complete(int job, int stage, bool ok, int64_t nowUs)
+{
+    Job     &j     = _jobs[job];
+    uint32_t ready = 0;
+
+    portENTER_CRITICAL(&_mux);
+    j.done   |= 1U << stage;
+    if (! ok) j.failed |= 1U << stage;
+    for (int s = 0; s < _nbrOfStages; s++)
+    {
+        if (! (j.queued & (1U << s)) && (_stages[s].after & ~j.done) == 0) ready |= 1U << s;
+    }
+    j.queued |= ready;
+    if (j.done == _allStages)
+    {
+        int64_t latencyUs = nowUs - j.job.startUs;
+        if (j.failed) _failed++;
+        else _completed++;
+        _sumLatencyUs += latencyUs;
+        _maxLatencyUs  = max(_maxLatencyUs, latencyUs);
+        _busy &= ~(1U << job);
+    }
+    portEXIT_CRITICAL(&_mux);
+    _enqueue(job, ready, nowUs);
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <Arduino.h>
+
+/**
+ * One firing on its way through a pipeline, handed to each of its stages.
+ * ctx points to the job's own context of ctxSize bytes (zeroed when the
+ * firing starts), in which the stages pass their results on.
+*/
+using PipelineJob = struct pljb { uint32_t seq; void *ctx; int64_t startUs; };
+
+// a stage returns false if it failed, its successors are skipped then
+using Stage = bool(*)(PipelineJob &job);
+
+using StageStats = struct stst { uint32_t queued; uint32_t runs; uint32_t skipped; int64_t sumWaitUs; int64_t maxWaitUs;
+                                 int64_t sumRunUs; int64_t maxRunUs; uint32_t sumDepth; uint32_t maxDepth; };
+
+/**
+ * Graph of stages started by a firing, e.g. by the callback of a timer.
+ * Each stage runs on a worker task and starts as soon as the stages it
+ * comes after have completed. A worker runs its stages one after the
+ * other (in the order they got ready), different workers in parallel,
+ * so the firings overlap: the photo of one firing is stored while the
+ * next one is captured. Stages can only come after stages added before
+ * them, so the graph has no cycles.
+ *
+ * A firing takes one of nbrOfJobs jobs until its last stage has run.
+ * fire() does not block, if all jobs are busy the firing is dropped and
+ * counted. If a stage fails, the stages after it are skipped, except
+ * those added with always (e.g. to turn the flash off or free a buffer).
+ * Stages of other branches, which do not come after it, still run.
+ *
+ * For each stage the time from ready to start (wait), the run time and
+ * the depth of the worker's queue when it got ready are kept, for the
+ * pipeline the time of the firings from start to end.
+ *
+ * Example:
+ *      pipeline.init(2, sizeof(PhotoJob));
+ *      int camera  = pipeline.addWorker("camera", 8192, 2);
+ *      int storage = pipeline.addWorker("storage", 4096, 1);
+ *      int capture = pipeline.addStage("capture", captureStage, camera);
+ *      int store   = pipeline.addStage("store", storeStage, storage, 1 << capture);
+ *      pipeline.addStage("release", releaseStage, storage, 1 << store, true);
+ *      pipeline.begin();
+ *      ...
+ *      pipeline.fire();    // in the timer callback
+*/
+class StagePipeline
+{
+    public:
+        static const int MAX_STAGES  = 16;
+        static const int MAX_WORKERS = 4;
+        static const int MAX_JOBS    = 8;
+
+        StagePipeline(){}
+
+        bool init(uint32_t nbrOfJobs=2, size_t ctxSize=0);
+        int addWorker(const char name[], uint32_t stackDepth=4096, UBaseType_t priority=1, BaseType_t core=tskNO_AFFINITY);
+        int addStage(const char name[], Stage stage, int worker, uint32_t after=0, bool always=false);
+        bool begin();
+        bool fire();
+        uint32_t getNbrOfInFlight();
+        uint32_t getNbrOfDropped();
+        StageStats getStats(int stage);
+        void printStats(const char name[]);
+
+    private:
+        using StageDef = struct { const char *name; Stage stage; int worker; uint32_t after; bool always; };
+        using Worker   = struct { const char *name; uint32_t stackDepth; UBaseType_t priority; BaseType_t core;
+                                  QueueHandle_t queue; StagePipeline *pipeline; };
+        using Job      = struct { PipelineJob job; uint32_t queued; uint32_t done; uint32_t failed; };  // failed or skipped stages
+        using Item     = struct { uint8_t job; uint8_t stage; int64_t readyUs; };
+
+        portMUX_TYPE _mux         = portMUX_INITIALIZER_UNLOCKED;   // jobs and counters
+        StageDef     _stages[MAX_STAGES];
+        Worker       _workers[MAX_WORKERS];
+        Job          _jobs[MAX_JOBS];
+        StageStats   _stats[MAX_STAGES] = {};
+        int          _nbrOfStages  = 0;
+        int          _nbrOfWorkers = 0;
+        uint32_t     _nbrOfJobs    = 0;
+        uint8_t     *_ctx          = nullptr;
+        size_t       _ctxSize      = 0;
+        bool         _started      = false;
+        uint32_t     _roots        = 0;     // stages without predecessors
+        uint32_t     _allStages    = 0;
+        uint32_t     _busy         = 0;     // jobs in flight
+        uint32_t     _seq          = 0;
+        uint32_t     _fired        = 0;
+        uint32_t     _dropped      = 0;
+        uint32_t     _completed    = 0;
+        uint32_t     _failed       = 0;
+        uint32_t     _maxInFlight  = 0;
+        int64_t      _sumLatencyUs = 0;
+        int64_t      _maxLatencyUs = 0;
+
+        static void  _taskFunction(void *params);
+        void         _run(const Item &item);
+        void         _enqueue(int job, uint32_t stages, int64_t nowUs);
+        void         _complete(int job, int stage, bool ok, int64_t nowUs);
+};
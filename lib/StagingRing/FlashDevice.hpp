@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Raw NOR flash as seen by the staging ring. Erasing sets all bits of
+ * whole sectors to 1, writing can only clear bits. The ESP32 implements
+ * it on a flash partition, the host programs on a file.
+*/
+class FlashDevice
+{
+    public:
+        virtual ~FlashDevice(){}
+
+        virtual size_t getSize() = 0;
+        virtual size_t getSectorSize() = 0;
+        virtual bool read(size_t addr, void *buf, size_t len) = 0;
+        virtual bool write(size_t addr, const void *buf, size_t len) = 0;
+        virtual bool erase(size_t addr, size_t len) = 0;
+};
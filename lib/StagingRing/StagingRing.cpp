@@ -0,0 +1,227 @@
+#include <cstring>
+#include <cstddef>
+#include "StagingRing.hpp"
+#include "Crc32.hpp"
+
+/**
+ * Scan the flash for committed records, restore their order by the
+ * sequence numbers and erase all sectors which do not belong to a
+ * record, e.g. the rest of a record torn by a reset.
+*/
+bool StagingRing::mount(FlashDevice *flash)
+{
+    uint32_t block[16];
+    Header   hdr;
+
+    _flash        = flash;
+    _sectorSize   = flash->getSectorSize();
+    _nbrOfSectors = flash->getSize() / _sectorSize;
+    _head    = 0;
+    _seq     = 0;
+    _first   = 0;
+    _count   = 0;
+    _dropped = 0;
+    if (_nbrOfSectors < 2 || _sectorSize < sizeof(Header)) return false;
+
+    for (uint32_t s = 0; s < _nbrOfSectors; )
+    {
+        if (! _valid(s, hdr)) { s++; continue; }
+        if (_count == MAX_RECORDS)
+        {
+            _dropped++;
+        }
+        else
+        {
+            uint32_t i = _count++;
+            for ( ; i > 0 && _records[i - 1].seq > hdr.seq; i--) _records[i] = _records[i - 1];
+            _records[i] = { s, hdr.seq, hdr.len };
+        }
+        s += _span(hdr.len);
+    }
+
+    if (_count > 0)
+    {
+        const Record &last = _records[_count - 1];
+        _head = (last.sector + _span(last.len)) % _nbrOfSectors;
+        _seq  = last.seq + 1;
+    }
+
+    for (uint32_t s = 0; s < _nbrOfSectors; s++)
+    {
+        bool used = false;
+        for (uint32_t i = 0; i < _count && ! used; i++)
+        {
+            used = (s + _nbrOfSectors - _records[i].sector) % _nbrOfSectors < _span(_records[i].len);
+        }
+        if (used) continue;
+
+        bool blank = true;
+        for (size_t offset = 0; offset < _sectorSize && blank; offset += sizeof(block))
+        {
+            if (! _flash->read(s * _sectorSize + offset, block, sizeof(block))) return false;
+            for (uint32_t w : block) blank = blank && w == 0xFFFFFFFF;
+        }
+        if (! blank)
+        {
+            if (! _eraseSectors(s, 1)) return false;
+            _dropped++;
+        }
+    }
+    return true;
+}
+
+/**
+ * Append a record, the name is used for the file on the SD card.
+ * Returns false if there is not enough space, nothing is written then.
+*/
+bool StagingRing::append(const char name[], const void *data, size_t len)
+{
+    Header   hdr;
+    uint32_t span = _span(len);
+
+    if (! _flash || strlen(name) > MAX_NAME || _count == MAX_RECORDS) return false;
+    if (span > _nbrOfSectors - _usedSectors()) return false;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic  = MAGIC;
+    hdr.seq    = _seq;
+    hdr.len    = len;
+    hdr.crc    = Crc32::compute(data, len);
+    strncpy(hdr.name, name, MAX_NAME);
+    hdr.hdrCrc = Crc32::compute(&hdr, offsetof(Header, hdrCrc));
+    hdr.commit = 0xFFFFFFFF;    // left erased until the data is written
+
+    uint32_t commit = COMMIT;
+    if (! _access(true, _head, 0, &hdr, sizeof(hdr)) ||
+        ! _access(true, _head, sizeof(hdr), const_cast<void *>(data), len) ||
+        ! _access(true, _head, offsetof(Header, commit), &commit, sizeof(commit)))
+    {
+        _eraseSectors(_head, span);
+        return false;
+    }
+
+    _records[(_first + _count) % MAX_RECORDS] = { _head, _seq, static_cast<uint32_t>(len) };
+    _count++;
+    _head = (_head + span) % _nbrOfSectors;
+    _seq++;
+    return true;
+}
+
+/**
+ * Name and length of the oldest record
+*/
+bool StagingRing::peek(char name[], size_t &len)
+{
+    Header hdr;
+
+    if (_count == 0) return false;
+    if (! _access(false, _records[_first].sector, 0, &hdr, sizeof(hdr))) return false;
+    memcpy(name, hdr.name, MAX_NAME + 1);
+    name[MAX_NAME] = '\0';
+    len = hdr.len;
+    return true;
+}
+
+/**
+ * Read a part of the data of the oldest record
+*/
+bool StagingRing::read(size_t offset, void *buf, size_t len)
+{
+    if (_count == 0 || offset + len > _records[_first].len) return false;
+    return _access(false, _records[_first].sector, sizeof(Header) + offset, buf, len);
+}
+
+/**
+ * Remove the oldest record. The sector with the header is erased
+ * first, so the record is gone even if the reset comes before the
+ * remaining sectors are erased.
+*/
+bool StagingRing::pop()
+{
+    if (_count == 0) return false;
+
+    const Record &rec = _records[_first];
+    uint32_t span = _span(rec.len);
+    if (! _eraseSectors(rec.sector, 1) || ! _eraseSectors((rec.sector + 1) % _nbrOfSectors, span - 1)) return false;
+    _first = (_first + 1) % MAX_RECORDS;
+    _count--;
+    return true;
+}
+
+uint32_t StagingRing::getNbrOfRecords() { return _count; }
+
+/**
+ * Torn or corrupt records and surplus records dropped when mounting
+*/
+uint32_t StagingRing::getNbrOfDropped() { return _dropped; }
+
+size_t StagingRing::getCapacity() { return _nbrOfSectors * _sectorSize; }
+
+/**
+ * Longest record which can be appended now
+*/
+size_t StagingRing::getFree()
+{
+    uint32_t sectors = _nbrOfSectors - _usedSectors();
+    return sectors ? sectors * _sectorSize - sizeof(Header) : 0;
+}
+
+uint32_t StagingRing::_span(size_t len)
+{
+    return (sizeof(Header) + len + _sectorSize - 1) / _sectorSize;
+}
+
+uint32_t StagingRing::_usedSectors()
+{
+    if (_count == 0) return 0;
+    uint32_t used = (_head + _nbrOfSectors - _records[_first].sector) % _nbrOfSectors;
+    return used ? used : _nbrOfSectors;
+}
+
+/**
+ * Check the header of a record starting at the sector and the CRC of its data
+*/
+bool StagingRing::_valid(uint32_t sector, Header &hdr)
+{
+    uint8_t chunk[256];
+
+    if (! _flash->read(sector * _sectorSize, &hdr, sizeof(hdr))) return false;
+    if (hdr.magic != MAGIC || hdr.commit != COMMIT) return false;
+    if (hdr.hdrCrc != Crc32::compute(&hdr, offsetof(Header, hdrCrc))) return false;
+    if (hdr.name[MAX_NAME] != '\0' || _span(hdr.len) > _nbrOfSectors) return false;
+
+    uint32_t crc = 0;
+    for (size_t offset = 0; offset < hdr.len; offset += sizeof(chunk))
+    {
+        size_t n = hdr.len - offset < sizeof(chunk) ? hdr.len - offset : sizeof(chunk);
+        if (! _access(false, sector, sizeof(hdr) + offset, chunk, n)) return false;
+        crc = Crc32::compute(chunk, n, crc);
+    }
+    return crc == hdr.crc;
+}
+
+/**
+ * Read or write at an offset from the start of a sector,
+ * at the end of the flash the access wraps around to the start
+*/
+bool StagingRing::_access(bool write, uint32_t sector, size_t offset, void *buf, size_t len)
+{
+    size_t   size  = getCapacity();
+    size_t   addr  = (sector * _sectorSize + offset) % size;
+    size_t   first = len < size - addr ? len : size - addr;
+    uint8_t *p     = static_cast<uint8_t *>(buf);
+
+    if (write)
+    {
+        return _flash->write(addr, p, first) && (first == len || _flash->write(0, p + first, len - first));
+    }
+    return _flash->read(addr, p, first) && (first == len || _flash->read(0, p + first, len - first));
+}
+
+bool StagingRing::_eraseSectors(uint32_t sector, uint32_t n)
+{
+    uint32_t first = n < _nbrOfSectors - sector ? n : _nbrOfSectors - sector;
+
+    if (first && ! _flash->erase(sector * _sectorSize, first * _sectorSize)) return false;
+    return first == n || _flash->erase(0, (n - first) * _sectorSize);
+}
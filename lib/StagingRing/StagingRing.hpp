@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include "FlashDevice.hpp"
+
+/**
+ * Log-structured ring of files on raw flash, used as a fast staging
+ * tier in front of the SD card. Each record starts on a sector boundary
+ * with a header (name, length, sequence number, CRC) followed by the
+ * data. Records are appended at the head and removed at the tail after
+ * they have been migrated, so the sectors are worn evenly.
+ *
+ * Free sectors are kept erased: the tail erases the sectors of a record
+ * when it is removed, so appending only writes and its latency depends
+ * on the length only. A record counts after its commit word has been
+ * cleared as last write. When mounting, records without commit word or
+ * with a wrong CRC are dropped and their sectors erased.
+ *
+ * The ring is not thread safe, the caller serializes the access.
+ *
+ * Example:
+ *      ring.mount(&flash);
+ *      ring.append("/photo00042.jpg", fb->buf, fb->len);
+ *      ...
+ *      while (ring.peek(name, len)) { ring.read(...); ...; ring.pop(); }
+*/
+class StagingRing
+{
+    public:
+        static const size_t MAX_NAME    = 39;   // characters of a record name
+        static const size_t MAX_RECORDS = 64;
+
+        StagingRing(){}
+
+        bool mount(FlashDevice *flash);
+        bool append(const char name[], const void *data, size_t len);
+        bool peek(char name[], size_t &len);
+        bool read(size_t offset, void *buf, size_t len);
+        bool pop();
+        uint32_t getNbrOfRecords();
+        uint32_t getNbrOfDropped();
+        size_t getCapacity();
+        size_t getFree();
+
+    private:
+        static const uint32_t MAGIC  = 0x31475453;  // "STG1"
+        static const uint32_t COMMIT = 0;
+
+        using Header = struct 
+        { 
+            uint32_t magic; uint32_t seq; uint32_t len; uint32_t crc; 
+            char name[MAX_NAME + 1]; uint32_t hdrCrc; uint32_t commit; 
+        };
+        using Record = struct { uint32_t sector; uint32_t seq; uint32_t len; };
+
+        FlashDevice *_flash         = nullptr;
+        size_t       _sectorSize    = 0;
+        uint32_t     _nbrOfSectors  = 0;
+        uint32_t     _head          = 0;    // first sector of the next record
+        uint32_t     _seq           = 0;    // sequence number of the next record
+        Record       _records[MAX_RECORDS];
+        uint32_t     _first         = 0;    // index of the oldest record
+        uint32_t     _count         = 0;
+        uint32_t     _dropped       = 0;    // records dropped when mounting
+
+        uint32_t     _span(size_t len);
+        uint32_t     _usedSectors();
+        bool         _valid(uint32_t sector, Header &hdr);
+        bool         _access(bool write, uint32_t sector, size_t offset, void *buf, size_t len);
+        bool         _eraseSectors(uint32_t sector, uint32_t n);
+};
@@ -1,11 +1,169 @@
+#include <sys/time.h>
+#include <esp_timer.h>
 #include "StartStopTimer.hpp"
 
+ScheduleRecorder *StartStopTimer::_recorder   = nullptr;
+SemaphoreHandle_t StartStopTimer::_recMutex   = nullptr;
+int64_t           StartStopTimer::_lastWallMs = 0;
+int64_t           StartStopTimer::_lastMonoUs = 0;
+uint32_t          StartStopTimer::_speedup    = 1;
+int64_t           StartStopTimer::_originMs   = 0;
+int64_t           StartStopTimer::_originUs   = 0;
+QueueHandle_t     StartStopTimer::_actionQueue = nullptr;
+std::atomic<TaskParams *> StartStopTimer::_timers[MAX_TIMERS] = {};
+portMUX_TYPE      StartStopTimer::_timersMux  = portMUX_INITIALIZER_UNLOCKED;
+
 void StartStopTimer::init(Callback cb, uint32_t stackDepth, UBaseType_t tskPriority)
 {
-    TaskParams *p = &_tskParams;
+    _tskParams.callback = cb;
+    _create(stackDepth, tskPriority);
+}
+
+/**
+ * The callback returns a control code, which the task applies right
+ * after it, together with the end of the firing, see control()
+*/
+void StartStopTimer::init(ControlCallback cb, uint32_t stackDepth, UBaseType_t tskPriority)
+{
+    _tskParams.control = cb;
+    _create(stackDepth, tskPriority);
+}
+
+/**
+ * Control code for the return of a ControlCallback, the operation in
+ * the upper 8 bits, the argument in the lower 24 bits (signed):
+ *   CONTINUE               nothing changes
+ *   SKIP, n                leave out the next n firings
+ *   EXTEND_WINDOW, tsec    move the stop of the current window (see extendWindow)
+ *   STOP_CYCLE             end the current window now, go on with the next cycle
+ *   STOP_TIMER             end the timer, the task deletes itself
+ *   SET_INTERVAL, interval new task interval (see setTaskInterval), from this firing on,
+ *                          ignored if not positive
+ * Example:
+ *      if (SD_MMC.cardType() == CARD_NONE) return StartStopTimer::control(StartStopTimer::SKIP, 5);
+*/
+Control StartStopTimer::control(ControlOp op, int32_t arg)
+{
+    return static_cast<Control>(op) << 24 | (static_cast<Control>(arg) & 0xFFFFFF);
+}
+
+/**
+ * Add a callback to each firing, after the callback of init() and the
+ * actions added before. So several actions share one wakeup and stay
+ * in phase, without a timer and task of their own. A parallel action
+ * is handed to the shared workers (see startWorkers()) and runs there
+ * while the timer goes on; if the workers are busy, it is dropped and
+ * counted. Without workers it runs in order as well. Call it before
+ * resume(). Returns false if the list is full.
+*/
+bool StartStopTimer::addAction(Callback cb, bool parallel)
+{
+    Actions &a = _tskParams.actions;
+
+    if (! cb || a.nbrOfActions >= MAX_ACTIONS) return false;
+    if (parallel) a.parallel |= 1U << a.nbrOfActions;
+    a.callbacks[a.nbrOfActions++] = cb;
+    return true;
+}
+
+/**
+ * Call onOpen when a window of the schedule opens, before its first
+ * firing, and onClose when it closes: at its stop time, also if the
+ * timer is stopped or deleted in the window. So a sensor or sampler
+ * runs only within the windows. Either may be nullptr. Call it
+ * before resume().
+*/
+void StartStopTimer::setWindowActions(Callback onOpen, Callback onClose)
+{
+    _tskParams.actions.onOpen  = onOpen;
+    _tskParams.actions.onClose = onClose;
+}
+
+/**
+ * Consistent copy of the state and statistics of the timer as of the
+ * last step of its task, without a lock: the task publishes them with a
+ * sequence number (seqlock), which is odd while it writes; the copy is
+ * taken again if the number was odd or has changed meanwhile. So a UI
+ * or exporter can poll any time without stopping the timers. Changes by
+ * the setters show after the next step of the task. Returns false if
+ * the task kept writing during all tries.
+*/
+bool StartStopTimer::getSnapshot(TimerSnapshot &snap)
+{
+    bool ok = _readSnapshot(&_tskParams, snap);
+    snap.id = _id;
+    return ok;
+}
+
+/**
+ * Snapshots of all timers initialized and not deleted, e.g. for a shell
+ * or metrics exporter. Each snapshot is consistent in itself. Returns
+ * the number of snapshots copied.
+*/
+int StartStopTimer::getSnapshots(TimerSnapshot snaps[], int maxSnaps)
+{
+    int n = 0;
+
+    for (int i = 0; i < MAX_TIMERS && n < maxSnaps; i++)
+    {
+        TaskParams *p = _timers[i].load(std::memory_order_acquire);
+        if (p && _readSnapshot(p, snaps[n]))
+        {
+            snaps[n++].id = i;
+        }
+    }
+    return n;
+}
+
+const char *StartStopTimer::phaseName(TimerPhase phase)
+{
+    static const char *names[] = { "idle", "waiting start", "in window", "between cycles", "finished" };
+    return phase <= FINISHED ? names[phase] : "?";
+}
+
+/**
+ * Start the worker tasks running the parallel actions of all timers
+*/
+bool StartStopTimer::startWorkers(uint32_t nbrOfWorkers, uint32_t stackDepth, UBaseType_t priority)
+{
+    if (_actionQueue) return false;
+    _actionQueue = xQueueCreate(2 * MAX_ACTIONS, sizeof(Callback));
+    if (! _actionQueue) return false;
+    for (uint32_t i = 0; i < nbrOfWorkers; i++)
+    {
+        if (xTaskCreate(_workerFunction, "Actions", stackDepth, nullptr, priority, nullptr) != pdPASS)
+        {
+            log_e("action worker %u not created", i);
+            return i > 0;
+        }
+    }
+    log_i("==> done");
+    return true;
+}
+
+void StartStopTimer::_create(uint32_t stackDepth, UBaseType_t tskPriority)
+{
     _tskPriority = tskPriority;
     _stackDepth = stackDepth;
-    _tskParams.callback = cb;
+    _tskParams.comp.init();
+    if (! _recMutex) _recMutex = xSemaphoreCreateMutex();   // schedule changes against the task, also without recorder
+    portENTER_CRITICAL(&_timersMux);
+    for (int i = 0; i < MAX_TIMERS && _id < 0; i++)
+    {
+        if (! _timers[i].load(std::memory_order_relaxed))
+        {
+            _timers[i].store(&_tskParams, std::memory_order_release);
+            _id = i;
+        }
+    }
+    portEXIT_CRITICAL(&_timersMux);
+    if (_recorder)
+    {
+        _lock();
+        _tskParams.recId = _recorder->attach(_tskParams.schedule);
+        _unlock();
+        if (_tskParams.recId < 0) log_w("schedule not recorded");
+    }
 
     BaseType_t res = xTaskCreate
     (
@@ -43,82 +201,636 @@ void StartStopTimer::init(Callback cb, uint32_t stackDepth, UBaseType_t tskPrior
 void StartStopTimer::setCycleStartStop(const char startDateTime[], const char stopDateTime[], const char taskInterval[]) 
 {
     char buf[20];
-    tm td = {0};
-    int tskHH;
-    int tskMM;
-    
-    sscanf(taskInterval, "%d:%d", &tskHH, &tskMM);
-    _tskParams.tInterval = 60 * (60 * tskHH + tskMM);
-    
-    sscanf(startDateTime, "%d-%d-%d %d:%d", &td.tm_year, &td.tm_mon, &td.tm_mday, &td.tm_hour, &td.tm_min);
-    td.tm_year -= 1900;
-    td.tm_mon -= 1;
-    td.tm_isdst = -1;
-    _tskParams.tStart = mktime(&td);
-    strftime(buf, sizeof(buf), "%F %H:%M", &td);
-    log_i("%s", buf);
+    ScheduleCore &s = _tskParams.schedule;
+    time_t t;
 
-    sscanf(stopDateTime, "%d-%d-%d %d:%d", &td.tm_year, &td.tm_mon, &td.tm_mday, &td.tm_hour, &td.tm_min);
-    td.tm_year -= 1900;
-    td.tm_mon -= 1;
-    td.tm_isdst = -1;
-    _tskParams.tStop = mktime(&td);
-    strftime(buf, sizeof(buf), "%F %H:%M", &td);
+    _lock();
+    bool valid = s.parse(startDateTime, stopDateTime, taskInterval);
+    if (valid && _recorder) _recorder->snapshot(_tskParams.recId);
+    _unlock();
+    if (! valid)
+    {
+        log_e("invalid schedule: %s - %s every %s", startDateTime, stopDateTime, taskInterval);
+        return;
+    }
+    t = s.getStart();
+    strftime(buf, sizeof(buf), "%F %H:%M", localtime(&t));
+    log_i("%s", buf);
+    t = s.getStop();
+    strftime(buf, sizeof(buf), "%F %H:%M", localtime(&t));
     log_i("%s", buf);
 
-    _tskParams.tCyclePeriod = 86400;
-    _tskParams.nbrOfCycles = 1 + (_tskParams.tStop - _tskParams.tStart) / _tskParams.tCyclePeriod;
-    log_i("start: %d, stop: %d, diff: %d", _tskParams.tStart, _tskParams.tStop, _tskParams.tStop - _tskParams.tStart);
-    log_i("taskInterval: %d", _tskParams.tInterval);
-    log_i("nbrOfCycles: %d", _tskParams.nbrOfCycles); 
+    log_i("start: %d, stop: %d, diff: %d", s.getStart(), s.getStop(), s.getStop() - s.getStart());
+    log_i("taskInterval: %d", s.getInterval());
+    log_i("nbrOfCycles: %d", s.getNbrOfCycles()); 
 };
 
-void StartStopTimer::setCycleStart(time_t tsecStart)  { _tskParams.tStart = tsecStart; }
+void StartStopTimer::setCycleStart(time_t tsecStart)  { _set(ScheduleRecorder::SET_START, tsecStart); }
+
+void StartStopTimer::setCycleStop(time_t tsecStop)    { _set(ScheduleRecorder::SET_STOP, tsecStop); }
 
-void StartStopTimer::setCycleStop(time_t tsecStop)    { _tskParams.tStop = tsecStop; }
+void StartStopTimer::setTaskInterval(time_t tsecInterval)  { _set(ScheduleRecorder::SET_INTERVAL, tsecInterval); }
 
-void StartStopTimer::setTaskInterval(time_t tsecInterval)  { _tskParams.tInterval = tsecInterval; }
+void StartStopTimer::setCyclePeriod(time_t tsecPeriod)      { _set(ScheduleRecorder::SET_PERIOD, tsecPeriod); }
 
-void StartStopTimer::setCyclePeriod(time_t tsecPeriod)      { _tskParams.tCyclePeriod = tsecPeriod; }
+void StartStopTimer::setNbrOfCycles(uint32_t nbrOfCycles)   { _set(ScheduleRecorder::SET_CYCLES, nbrOfCycles); }
 
-void StartStopTimer::setNbrOfCycles(uint32_t nbrOfCycles)   { _tskParams.nbrOfCycles = nbrOfCycles; }
+void StartStopTimer::setIntervalMultiplier(uint32_t factor) { _set(ScheduleRecorder::SET_MULTIPLIER, factor); }
 
-void StartStopTimer::setIntervalMultiplier(uint32_t factor) { _tskParams.intervalMultiplier = factor; }
+/**
+ * Move the stop of the current window by tsec, the following
+ * windows keep their length
+*/
+void StartStopTimer::extendWindow(time_t tsec) { _set(ScheduleRecorder::EXTEND, tsec); }
+
+void StartStopTimer::resume()  { _record(ScheduleRecorder::RESUME); vTaskResume(_tskParams.tskHandle); }
+
+/**
+ * The task is suspended and deleted under the lock of the recorder,
+ * so it cannot be stopped while it holds the lock. A task suspending
+ * itself (e.g. from its callback) records first and releases the lock
+ * before, else the other timers would wait for it until its resume.
+*/
+void StartStopTimer::suspend()
+{
+    _lock();
+    if (_recorder) _recorder->call(_tskParams.recId, ScheduleRecorder::SUSPEND);
+    if (_tskParams.tskHandle == xTaskGetCurrentTaskHandle())
+    {
+        _unlock();
+        vTaskSuspend(nullptr);
+        return;
+    }
+    vTaskSuspend(_tskParams.tskHandle);
+    _unlock();
+}
+
+/**
+ * The task and the slot of the snapshots refer to the timer, also
+ * after the task has ended on its own
+*/
+StartStopTimer::~StartStopTimer() { deleteTask(); }
+
+/**
+ * Delete the task, record it and close the window. The close action
+ * runs after the lock, it is code of the user. A task deleting itself
+ * (e.g. from its callback) does so only at the end, after the lock
+ * has been released.
+*/
+void StartStopTimer::deleteTask()
+{
+    _lock();
+    TaskHandle_t handle = _takeHandle(&_tskParams);
+    bool         self   = handle && handle == xTaskGetCurrentTaskHandle();
+    if (handle && ! self) vTaskDelete(handle);      // not if the timer has ended
+    if (_recorder && _tskParams.recId >= 0)
+    {
+        _recorder->call(_tskParams.recId, ScheduleRecorder::DELETE);
+        _recorder->detach(_tskParams.recId);
+        _tskParams.recId = -1;
+    }
+    _unlock();
+    if (handle) _window(&_tskParams, false);        // else the task closes it at its end
+    if (_id >= 0) _timers[_id].store(nullptr, std::memory_order_release);
+    _id = -1;
+    if (self) vTaskDelete(nullptr);
+}
 
-void StartStopTimer::resume()  { vTaskResume(_tskParams.tskHandle); }
+/**
+ * Fire the callback as soon as possible, in addition to the schedule.
+ * Safe to call from an interrupt: the request is noted and the task is
+ * woken with a notification. If the task has a higher priority than the
+ * interrupted one, it runs right after the ISR. Triggers arriving before
+ * the callback runs are merged into one firing. With woken the caller
+ * yields at the end of its ISR (portYIELD_FROM_ISR), else this function
+ * does. Returns false if the task has ended.
+ *
+ * The handle is read and used under isr.mux, under which the task and
+ * deleteTask() clear it before the delete, so the task exists while it
+ * is notified.
+*/
+bool IRAM_ATTR StartStopTimer::triggerFromISR(BaseType_t *woken)
+{
+    BaseType_t yield = pdFALSE;
+
+    portENTER_CRITICAL_ISR(&_tskParams.isr.mux);
+    TaskHandle_t handle = _tskParams.tskHandle;
+    if (handle)
+    {
+        if (_tskParams.isr.triggers++ == 0) _tskParams.isr.triggerUs = esp_timer_get_time();
+        vTaskNotifyGiveFromISR(handle, &yield);
+    }
+    portEXIT_CRITICAL_ISR(&_tskParams.isr.mux);
+    return _yieldFromISR(handle, yield, woken);
+}
+
+/**
+ * resume() for interrupts, the task must have been suspended
+*/
+bool IRAM_ATTR StartStopTimer::resumeFromISR(BaseType_t *woken)
+{
+    BaseType_t yield = pdFALSE;
+
+    portENTER_CRITICAL_ISR(&_tskParams.isr.mux);
+    TaskHandle_t handle = _tskParams.tskHandle;
+    if (handle)
+    {
+        _tskParams.isr.resumed = true;
+        yield = xTaskResumeFromISR(handle);
+    }
+    portEXIT_CRITICAL_ISR(&_tskParams.isr.mux);
+    return _yieldFromISR(handle, yield, woken);
+}
 
-void StartStopTimer::suspend() { vTaskSuspend(_tskParams.tskHandle); }
+/**
+ * extendWindow() for interrupts, the task applies it at its next step
+*/
+bool IRAM_ATTR StartStopTimer::extendWindowFromISR(int32_t tsec, BaseType_t *woken)
+{
+    BaseType_t yield = pdFALSE;
 
-void StartStopTimer::deleteTask() { vTaskDelete(_tskParams.tskHandle); _tskParams.tskHandle = nullptr; }
+    portENTER_CRITICAL_ISR(&_tskParams.isr.mux);
+    TaskHandle_t handle = _tskParams.tskHandle;
+    if (handle)
+    {
+        _tskParams.isr.extendSec += tsec;
+        vTaskNotifyGiveFromISR(handle, &yield);
+    }
+    portEXIT_CRITICAL_ISR(&_tskParams.isr.mux);
+    return _yieldFromISR(handle, yield, woken);
+}
 
 TaskHandle_t StartStopTimer::getTaskHandle() { return _tskParams.tskHandle; }
 
+/**
+ * The schedule of the timer, e.g. to configure it from a generator.
+ * Changes while the task is running take effect at its next step.
+*/
+ScheduleCore &StartStopTimer::getSchedule() { return _tskParams.schedule; }
+
+uint32_t StartStopTimer::getFiringCount() { return _tskParams.schedule.getFiringCount(); }
+
+/**
+ * Number of times the callback is called in one cycle, i.e. how
+ * many task intervals fit between start and stop of the cycle.
+*/
+uint32_t StartStopTimer::getFiringsPerCycle() { return _tskParams.schedule.getFiringsPerCycle(); }
+
+/**
+ * Number of firings still to come according to the schedule,
+ * see ScheduleCore::getRemainingFirings()
+*/
+uint32_t StartStopTimer::getRemainingFirings() { return _tskParams.schedule.getRemainingFirings(); }
+
+/**
+ * Lateness, callback durations and overruns of the firings so far,
+ * in ms of the timeline of the timers (virtual with a speedup)
+*/
+TimerStats StartStopTimer::getStats() { return _tskParams.stats; }
+
+/**
+ * Learn how late the callback starts after a wait and wake up that
+ * much earlier (on by default), see LatencyCompensator
+*/
+void StartStopTimer::setCompensation(bool on) { _tskParams.compensate = on; }
+
+/**
+ * How much earlier than due the timer currently wakes up
+*/
+int64_t StartStopTimer::getLeadMs() { return _tskParams.compensate ? _tskParams.comp.getLeadMs() : 0; }
+
+void StartStopTimer::printStats(const char name[])
+{
+    TimerStats s = _tskParams.stats;
+    char       buf[20] = "-";
+    time_t     t = s.firstOverrunMs / 1000;
+
+    if (s.overruns) strftime(buf, sizeof(buf), "%F %H:%M", localtime(&t));
+    log_i("%s: %u firings, late mean %lld max %lld ms, lead %lld ms, callback max %lld ms, %u overruns (first %s), %u lost", 
+          name, s.firings, s.firings ? s.sumLateMs / s.firings : 0, s.maxLateMs, getLeadMs(), s.maxCallbackMs, 
+          s.overruns, buf, s.lost);
+    if (s.triggers) log_i("%s: %u triggers, ISR to callback mean %lld max %lld us", 
+                          name, s.triggers, s.sumTriggerUs / s.triggers, s.maxTriggerUs);
+    if (s.dropped) log_i("%s: %u parallel actions dropped, the workers were busy", name, s.dropped);
+}
+
+/**
+ * Record the clock readings, API calls and clock steps of all timers
+ * initialized from now on into the recorder, see ScheduleRecorder.
+ * Call it before the init() of the timers.
+*/
+void StartStopTimer::setRecorder(ScheduleRecorder *recorder)
+{
+    if (! _recMutex) _recMutex = xSemaphoreCreateMutex();
+    _recorder = recorder;
+}
+
+/**
+ * Run the clock of all timers factor times faster from the epoch time
+ * origin (now if 0), e.g. to check the schedule of a week within some
+ * minutes. The callbacks still take their real time, so they appear
+ * factor times longer on the virtual timeline; the statistics of the
+ * timers tell where they cannot keep up. The clock is derived from
+ * esp_timer, NTP has no effect. Call it before resuming the timers.
+*/
+void StartStopTimer::setSpeedup(uint32_t factor, time_t origin)
+{
+    _originUs = esp_timer_get_time();
+    _originMs = 0;
+    _speedup  = 1;
+    _originMs = origin ? 1000LL * origin : _nowMs();
+    _speedup  = max(factor, 1U);
+    log_i("speedup %u from %lld", _speedup, _originMs / 1000);
+}
+
+uint32_t StartStopTimer::getSpeedup() { return _speedup; }
+
+/**
+ * Epoch time of the timers in ms, with a speedup the virtual time
+*/
+int64_t StartStopTimer::getNowMs() { return _nowMs(); }
+
+/**
+ * Resolution of the waits on the timeline of the timers, one tick
+ * of FreeRTOS times the speedup
+*/
+uint32_t StartStopTimer::getResolutionMs() { return portTICK_PERIOD_MS * _speedup; }
+
+/**
+ * The schedule decides, the task only waits and calls the callback.
+ * Until the start of a cycle the clock is polled every 10 ms, so a
+ * time set by NTP in the meantime is taken into account. The lateness
+ * of the firings after a wait teaches the compensator how much
+ * earlier the task has to wake up. The waits end early when an
+ * interrupt has a request for the task.
+*/
 void StartStopTimer::_taskFunction(void *params)
 {
     TaskParams *p = static_cast<TaskParams *>(params);
+    int64_t     nowMs;
+    bool        waited = false;
     
-    //log_i("nbrOfCycles=%d", p->nbrOfCycles);
-
-    for (uint32_t n = 0; n < p->nbrOfCycles; n++)
+    while (true)
     {
-        //log_i("cycle: %d", n);
-        // Wait until start time of 1st cycle is reached
-        while (p->tStart > time(nullptr)) { vTaskDelay(pdMS_TO_TICKS(10)); } 
-        p->tStart = time(nullptr);  // remember start time of cycle
+        if (! _deferred(p)) break;
+        ScheduleCore::Step step = _next(p, nowMs);
+        _publish(p, step, nowMs);
+        _window(p, step.action == ScheduleCore::WAIT || step.action == ScheduleCore::FIRE);
 
-        // Do task until stop time is reached
-        while (time(nullptr) < p->tStop)
+        if (step.action == ScheduleCore::DONE) break;
+        if (step.action == ScheduleCore::WAIT_START)
         {
-            p->callback(); // call the function supplied by the user
-            //log_i("wait interval: %d * %d", p->intervalMultiplier, p->tInterval);
-            vTaskDelay(pdMS_TO_TICKS(p->intervalMultiplier * p->tInterval));
+            _wait(min<int64_t>(step.waitMs, 10 * _speedup));
+            waited = false;
+        }
+        else if (step.action == ScheduleCore::WAIT)
+        {
+            int64_t waitMs = step.waitMs;
+            if (p->actions.onClose) waitMs = min<int64_t>(waitMs, 1000LL * p->schedule.getStop() - nowMs);  // close in time
+            waited = ! _wait(waitMs);           // not if woken early
+        }
+        else
+        {
+            int64_t lateMs = nowMs - p->schedule.getDueMs();
+            if (p->compensate && waited) p->comp.add(lateMs);
+            waited = false;
+            Control c = _call(p); // call the function supplied by the user
+            _account(p, lateMs, _fired(p, c) - nowMs, nowMs);
+            if (c >> 24 == STOP_TIMER) break;
         }
-        p->tStart += p->tCyclePeriod;
-        p->tStop  += p->tCyclePeriod;        
     }
 
-    vTaskDelete(p->tskHandle); p->tskHandle = nullptr; // delete task
+    p->stats.lost = p->schedule.getRemainingFirings();
+    _publish(p, { ScheduleCore::DONE, 0 }, _nowMs());
+    // the handle is cleared before the delete, the task does not run afterwards
+    if (! _takeHandle(p)) vTaskSuspend(nullptr);    // deleteTask() took it, closes and deletes
+    _window(p, false);
+    vTaskDelete(nullptr);       // delete task
     //vTaskSuspend(p->tskHandle); // suspend the task until resume is called by the user
 };
 
+/**
+ * Epoch time in milliseconds, with a speedup the virtual time
+*/
+int64_t StartStopTimer::_nowMs()
+{
+    if (_speedup > 1) return _originMs + (esp_timer_get_time() - _originUs) * _speedup / 1000;
+
+    timeval tv;
+    gettimeofday(&tv, nullptr);
+    return 1000LL * tv.tv_sec + tv.tv_usec / 1000;
+}
+
+/**
+ * Wait for a time of the schedule, at least one tick, so that a
+ * short virtual wait does not turn into a busy loop. Returns true
+ * if the wait was ended early by a notification.
+*/
+bool StartStopTimer::_wait(int64_t waitMs)
+{
+    TickType_t ticks = pdMS_TO_TICKS((waitMs + _speedup - 1) / _speedup);
+    return ulTaskNotifyTake(pdTRUE, ticks ? ticks : 1) > 0;
+}
+
+/**
+ * Apply the requests of interrupts: resume (recorded only), window
+ * extension and triggered firing. Returns false if the callback of
+ * the triggered firing has ended the timer.
+*/
+bool StartStopTimer::_deferred(TaskParams *p)
+{
+    portENTER_CRITICAL(&p->isr.mux);
+    IsrRequests req = p->isr;
+    p->isr.triggers  = 0;
+    p->isr.extendSec = 0;
+    p->isr.resumed   = false;
+    portEXIT_CRITICAL(&p->isr.mux);
+
+    if (req.resumed || req.extendSec)
+    {
+        // EXTEND right after the extension, a checkpoint of RESUME contains it
+        _lock();
+        if (req.extendSec) p->schedule.extendWindow(req.extendSec);
+        if (_recorder && req.extendSec) _recorder->call(p->recId, ScheduleRecorder::EXTEND, req.extendSec);
+        if (_recorder && req.resumed)   _recorder->call(p->recId, ScheduleRecorder::RESUME);
+        _unlock();
+    }
+    if (req.triggers)
+    {
+        int64_t latencyUs = esp_timer_get_time() - req.triggerUs;
+        TimerStats &s = p->stats;
+        s.triggers++;
+        s.sumTriggerUs += latencyUs;
+        s.maxTriggerUs  = max(s.maxTriggerUs, latencyUs);
+        if (_recorder)
+        {
+            _lock();
+            _recorder->call(p->recId, ScheduleRecorder::TRIGGER);
+            _unlock();
+        }
+        Control c = _call(p);
+        _lock();
+        _apply(p, c, _nowMs());
+        _unlock();
+        return c >> 24 != STOP_TIMER;
+    }
+    return true;
+}
+
+/**
+ * A callback overruns when it takes longer than the interval, the
+ * firings are then stretched and fewer than planned fit in the window
+*/
+void StartStopTimer::_account(TaskParams *p, int64_t lateMs, int64_t callbackMs, int64_t nowMs)
+{
+    TimerStats &s = p->stats;
+
+    s.firings++;
+    s.sumLateMs    += lateMs;
+    s.maxLateMs     = max(s.maxLateMs, lateMs);
+    s.maxCallbackMs = max(s.maxCallbackMs, callbackMs);
+    if (callbackMs >= p->schedule.getIntervalMs())
+    {
+        if (s.overruns == 0) s.firstOverrunMs = nowMs;
+        s.overruns++;
+    }
+}
+
+/**
+ * Ask the schedule what to do now, with a recorder under the lock,
+ * so that the records of all timers are in the order of the calls
+*/
+ScheduleCore::Step StartStopTimer::_next(TaskParams *p, int64_t &nowMs)
+{
+    int64_t leadMs = p->compensate ? p->comp.getLeadMs() : 0;
+
+    if (! _recorder) return p->schedule.next(nowMs = _nowMs(), leadMs);
+
+    _lock();
+    nowMs = _recordedNowMs();
+    ScheduleCore::Step step = p->schedule.next(nowMs, leadMs);
+    _recorder->clock(p->recId, nowMs, step.action, leadMs);
+    _unlock();
+    return step;
+}
+
+/**
+ * End the firing and apply the control code of the callback in one
+ * step, a new interval before the next firing is planned, the other
+ * codes after it
+*/
+int64_t StartStopTimer::_fired(TaskParams *p, Control c)
+{
+    int64_t nowMs;
+    bool    interval = c >> 24 == SET_INTERVAL;
+
+    _lock();
+    nowMs = _recorder ? _recordedNowMs() : _nowMs();
+    if (interval) _apply(p, c, nowMs);
+    p->schedule.fired(nowMs);
+    if (_recorder) _recorder->fired(p->recId, nowMs);
+    if (! interval) _apply(p, c, nowMs);
+    _unlock();
+    return nowMs;
+}
+
+/**
+ * Call the callback and then the actions of the firing, the
+ * parallel ones are only queued for the workers
+*/
+Control StartStopTimer::_call(TaskParams *p)
+{
+    Control  c = CONTINUE;
+    Actions &a = p->actions;
 
+    if (p->control) c = p->control();
+    else if (p->callback) p->callback();
+    for (int i = 0; i < a.nbrOfActions; i++)
+    {
+        if (! (a.parallel & (1U << i)) || ! _actionQueue) a.callbacks[i]();
+        else if (xQueueSend(_actionQueue, &a.callbacks[i], 0) != pdTRUE) p->stats.dropped++;
+    }
+    return c;
+}
+
+/**
+ * Write the snapshot of the timer, only the task of the timer does.
+ * The sequence number is odd while the snapshot is written.
+*/
+void StartStopTimer::_publish(TaskParams *p, ScheduleCore::Step step, int64_t nowMs)
+{
+    ScheduleCore  &s    = p->schedule;
+    TimerSnapshot &snap = p->snap;
+    uint32_t       seq  = p->snapSeq.load(std::memory_order_relaxed);
+
+    p->snapSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    switch (step.action)
+    {
+        case ScheduleCore::WAIT_START: snap.phase = s.getCycle() ? BETWEEN_CYCLES : WAITING_START; break;
+        case ScheduleCore::DONE:       snap.phase = FINISHED; break;
+        default:                       snap.phase = IN_WINDOW;
+    }
+    snap.cycle       = s.getCycle();
+    snap.nbrOfCycles = s.getNbrOfCycles();
+    snap.tStart      = s.getStart();
+    snap.tStop       = s.getStop();
+    snap.intervalMs  = s.getIntervalMs();
+    snap.nextFireMs  = step.action == ScheduleCore::DONE ? 0 : nowMs + step.waitMs;
+    snap.firings     = s.getFiringCount();
+    snap.remaining   = s.getRemainingFirings();
+    snap.leadMs      = p->compensate ? p->comp.getLeadMs() : 0;
+    snap.updatedMs   = nowMs;
+    snap.stats       = p->stats;
+    p->snapSeq.store(seq + 2, std::memory_order_release);
+}
+
+/**
+ * Call the window action if the task has entered or left the window
+*/
+void StartStopTimer::_window(TaskParams *p, bool inWindow)
+{
+    Actions &a = p->actions;
+
+    if (inWindow == a.open) return;
+    a.open = inWindow;
+    if (inWindow && a.onOpen) a.onOpen();
+    if (! inWindow && a.onClose) a.onClose();
+}
+
+bool StartStopTimer::_readSnapshot(TaskParams *p, TimerSnapshot &snap)
+{
+    for (int i = 0; i < SNAP_TRIES; i++)
+    {
+        uint32_t seq = p->snapSeq.load(std::memory_order_acquire);
+        if (seq & 1) continue;
+        snap = p->snap;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (p->snapSeq.load(std::memory_order_relaxed) == seq) return true;
+    }
+    return false;
+}
+
+void StartStopTimer::_workerFunction(void *params)
+{
+    Callback cb;
+
+    for (;;)
+    {
+        if (xQueueReceive(_actionQueue, &cb, portMAX_DELAY) == pdTRUE) cb();
+    }
+}
+
+/**
+ * Change the schedule as told by the control code of the callback
+ * and record it, under the lock. Ending the cycle is a window
+ * extension up to now, so the replay sees the same change. The value
+ * recorded is the one applied, an interval that is not positive is
+ * rejected (the task would fire without waiting).
+*/
+void StartStopTimer::_apply(TaskParams *p, Control c, int64_t nowMs)
+{
+    ScheduleCore          &s     = p->schedule;
+    int32_t                arg   = static_cast<int32_t>(c << 8) >> 8;
+    int64_t                value = arg;
+    ScheduleRecorder::Kind kind;
+
+    switch (c >> 24)
+    {
+        case SKIP:          value = max(arg, 0);
+                            s.skip(value); kind = ScheduleRecorder::SKIP; break;
+        case EXTEND_WINDOW: s.extendWindow(arg); kind = ScheduleRecorder::EXTEND; break;
+        case STOP_CYCLE:    value = nowMs / 1000 - s.getStop();
+                            s.extendWindow(value); kind = ScheduleRecorder::EXTEND; break;
+        case STOP_TIMER:    kind = ScheduleRecorder::STOP; break;
+        case SET_INTERVAL:  if (arg <= 0)
+                            {
+                                log_w("interval %d not positive, rejected", arg);
+                                return;
+                            }
+                            s.setInterval(arg); kind = ScheduleRecorder::SET_INTERVAL; break;
+        default:            return;
+    }
+    if (_recorder) _recorder->call(p->recId, kind, value);
+}
+
+/**
+ * Epoch time in milliseconds. A step of the wall clock against the
+ * monotonic esp_timer since the previous reading (e.g. by NTP or
+ * settimeofday) is recorded before the reading.
+*/
+int64_t StartStopTimer::_recordedNowMs()
+{
+    int64_t wallMs = _nowMs();
+    int64_t monoUs = esp_timer_get_time();
+    int64_t limit  = STEP_MS * _speedup;
+
+    if (_lastMonoUs)
+    {
+        int64_t stepMs = (wallMs - _lastWallMs) - (monoUs - _lastMonoUs) * _speedup / 1000;
+        if (stepMs > limit || stepMs < -limit) _recorder->step(wallMs, stepMs);
+    }
+    _lastWallMs = wallMs;
+    _lastMonoUs = monoUs;
+    return wallMs;
+}
+
+void StartStopTimer::_lock()   { if (_recMutex) xSemaphoreTake(_recMutex, portMAX_DELAY); }
+
+void StartStopTimer::_unlock() { if (_recMutex) xSemaphoreGive(_recMutex); }
+
+/**
+ * Change the schedule by the setter of kind and record the call
+*/
+void StartStopTimer::_set(ScheduleRecorder::Kind kind, int64_t value)
+{
+    ScheduleCore &s = _tskParams.schedule;
+
+    _lock();
+    switch (kind)
+    {
+        case ScheduleRecorder::SET_START:      s.setStart(value); break;
+        case ScheduleRecorder::SET_STOP:       s.setStop(value); break;
+        case ScheduleRecorder::SET_INTERVAL:   s.setInterval(value); break;
+        case ScheduleRecorder::SET_PERIOD:     s.setCyclePeriod(value); break;
+        case ScheduleRecorder::SET_CYCLES:     s.setNbrOfCycles(value); break;
+        case ScheduleRecorder::SET_MULTIPLIER: s.setIntervalMultiplier(value); break;
+        case ScheduleRecorder::EXTEND:         s.extendWindow(value); break;
+        default:                               break;
+    }
+    if (_recorder) _recorder->call(_tskParams.recId, kind, value);
+    _unlock();
+}
+
+void StartStopTimer::_record(ScheduleRecorder::Kind kind)
+{
+    if (! _recorder) return;
+    _lock();
+    _recorder->call(_tskParams.recId, kind);
+    _unlock();
+}
+
+/**
+ * Clear the handle of the task and return it, under isr.mux against
+ * the interrupts using it
+*/
+TaskHandle_t StartStopTimer::_takeHandle(TaskParams *p)
+{
+    portENTER_CRITICAL(&p->isr.mux);
+    TaskHandle_t handle = p->tskHandle;
+    p->tskHandle = nullptr;
+    portEXIT_CRITICAL(&p->isr.mux);
+    return handle;
+}
+
+/**
+ * End of the ISR functions, after the critical section: pass on or do
+ * the yield, false if there was no task
+*/
+bool IRAM_ATTR StartStopTimer::_yieldFromISR(TaskHandle_t handle, BaseType_t yield, BaseType_t *woken)
+{
+    if (! handle) return false;
+    if (woken) *woken |= yield;
+    else if (yield) portYIELD_FROM_ISR();
+    return true;
+}
@@ -1,19 +1,57 @@
 #pragma once
 #include <Arduino.h>
+#include <atomic>
+#include "ScheduleCore.hpp"
+#include "ScheduleRecorder.hpp"
+#include "LatencyCompensator.hpp"
 
 using Callback = void(*)();
 
-using TaskParams = struct tskp { time_t tStart; time_t tStop; time_t tInterval; uint32_t intervalMultiplier;
-                                 time_t tCyclePeriod; uint32_t nbrOfCycles;
-                                 TaskHandle_t tskHandle; Callback callback;
-                                } ;
+// callback telling its timer how to go on, see StartStopTimer::control()
+using Control         = uint32_t;
+using ControlCallback = Control(*)();
+
+using TimerStats = struct tsts { uint32_t firings; uint32_t overruns; uint32_t lost; int64_t sumLateMs; 
+                                 int64_t maxLateMs; int64_t maxCallbackMs; int64_t firstOverrunMs;
+                                 uint32_t triggers; int64_t sumTriggerUs; int64_t maxTriggerUs; uint32_t dropped; };
+
+// further callbacks of each firing, see StartStopTimer::addAction(), and of
+// the window, see StartStopTimer::setWindowActions()
+const int MAX_ACTIONS = 8;
+using Actions = struct actn { Callback callbacks[MAX_ACTIONS]; uint32_t parallel; int nbrOfActions;
+                              Callback onOpen; Callback onClose; bool open; };
+
+// state of a timer as of the last step of its task, see StartStopTimer::getSnapshot()
+enum TimerPhase { IDLE, WAITING_START, IN_WINDOW, BETWEEN_CYCLES, FINISHED };
+
+using TimerSnapshot = struct tsnp { int id; TimerPhase phase; uint32_t cycle; uint32_t nbrOfCycles; time_t tStart; 
+                                    time_t tStop; int64_t intervalMs; int64_t nextFireMs; uint32_t firings; 
+                                    uint32_t remaining; int64_t leadMs; int64_t updatedMs; TimerStats stats; };
+
+// requests of interrupts, applied by the task (under mux)
+using IsrRequests = struct isrq { portMUX_TYPE mux; uint32_t triggers; int64_t triggerUs; int32_t extendSec; bool resumed; };
+
+using TaskParams = struct tskp { ScheduleCore schedule; TaskHandle_t tskHandle; Callback callback; ControlCallback control;
+                                 int recId; TimerStats stats; LatencyCompensator comp; bool compensate; IsrRequests isr;
+                                 Actions actions; std::atomic<uint32_t> snapSeq; TimerSnapshot snap; } ;
 
 class StartStopTimer
 {
     public:
+        enum ControlOp { CONTINUE, SKIP, EXTEND_WINDOW, STOP_CYCLE, STOP_TIMER, SET_INTERVAL };
+
         StartStopTimer(){}
+        ~StartStopTimer();
 
         void init(Callback cb, uint32_t stackDepth=1000, UBaseType_t tskPriority=1);
+        void init(ControlCallback cb, uint32_t stackDepth=1000, UBaseType_t tskPriority=1);
+        static Control control(ControlOp op, int32_t arg=0);
+        bool addAction(Callback cb, bool parallel=false);
+        void setWindowActions(Callback onOpen, Callback onClose);
+        bool getSnapshot(TimerSnapshot &snap);
+        static int getSnapshots(TimerSnapshot snaps[], int maxSnaps);
+        static const char *phaseName(TimerPhase phase);
+        static bool startWorkers(uint32_t nbrOfWorkers=2, uint32_t stackDepth=4096, UBaseType_t priority=1);
         void setCycleStart(time_t tsecStart);
         void setCycleStop(time_t tsecStop);
         void setCycleStartStop(const char startDateTime[], const char stopDateTime[], const char tskInterval[]); 
@@ -21,14 +59,67 @@ class StartStopTimer
         void setCyclePeriod(time_t tsecCyclePeriod);
         void setNbrOfCycles(uint32_t nbrOfCycles);
         void setIntervalMultiplier(uint32_t factor);
+        void extendWindow(time_t tsec);
         void resume();
         void suspend();
+        bool triggerFromISR(BaseType_t *woken=nullptr);
+        bool resumeFromISR(BaseType_t *woken=nullptr);
+        bool extendWindowFromISR(int32_t tsec, BaseType_t *woken=nullptr);
         void deleteTask();
         TaskHandle_t getTaskHandle();
+        ScheduleCore &getSchedule();
+        uint32_t getFiringCount();
+        uint32_t getFiringsPerCycle();
+        uint32_t getRemainingFirings();
+        TimerStats getStats();
+        void setCompensation(bool on);
+        int64_t getLeadMs();
+        void printStats(const char name[]);
+        static void setRecorder(ScheduleRecorder *recorder);
+        static void setSpeedup(uint32_t factor, time_t origin=0);
+        static uint32_t getSpeedup();
+        static int64_t getNowMs();
+        static uint32_t getResolutionMs();
 
     private:
-        TaskParams     _tskParams = { 0, 0, 1, 1000, 86400, 1, nullptr, nullptr };
+        static const int64_t STEP_MS = 100;   // wall clock steps recorded
+        static const int MAX_TIMERS  = 32;    // registered for the snapshots
+        static const int SNAP_TRIES  = 100;   // reads of a snapshot while the task writes it
+
+        TaskParams     _tskParams = { ScheduleCore(), nullptr, nullptr, nullptr, -1, {}, LatencyCompensator(), true,
+                                      { portMUX_INITIALIZER_UNLOCKED, 0, 0, 0, false }, {}, {0}, {} };
         UBaseType_t    _tskPriority;
+        int            _id = -1;        // in _timers, for the snapshots
         uint32_t       _stackDepth;
+        static ScheduleRecorder *_recorder;
+        static SemaphoreHandle_t _recMutex;
+        static int64_t _lastWallMs;
+        static int64_t _lastMonoUs;
+        static uint32_t _speedup;
+        static QueueHandle_t _actionQueue;   // parallel actions of all timers to the workers
+        static std::atomic<TaskParams *> _timers[MAX_TIMERS];
+        static portMUX_TYPE _timersMux;      // registering and removing
+        static int64_t _originMs;       // virtual clock at _originUs
+        static int64_t _originUs;
+        void           _create(uint32_t stackDepth, UBaseType_t tskPriority);
         static void    _taskFunction(void *params);
+        static Control _call(TaskParams *p);
+        static void    _workerFunction(void *params);
+        static void    _publish(TaskParams *p, ScheduleCore::Step step, int64_t nowMs);
+        static void    _window(TaskParams *p, bool inWindow);
+        static bool    _readSnapshot(TaskParams *p, TimerSnapshot &snap);
+        static void    _apply(TaskParams *p, Control c, int64_t nowMs);
+        static int64_t _nowMs();
+        static bool    _wait(int64_t waitMs);
+        static bool    _deferred(TaskParams *p);
+        static ScheduleCore::Step _next(TaskParams *p, int64_t &nowMs);
+        static int64_t _fired(TaskParams *p, Control c);
+        static void    _account(TaskParams *p, int64_t lateMs, int64_t callbackMs, int64_t nowMs);
+        static int64_t _recordedNowMs();
+        static void    _lock();
+        static void    _unlock();
+        void           _set(ScheduleRecorder::Kind kind, int64_t value);
+        void           _record(ScheduleRecorder::Kind kind);
+        static TaskHandle_t _takeHandle(TaskParams *p);
+        static bool    _yieldFromISR(TaskHandle_t handle, BaseType_t yield, BaseType_t *woken);
 };
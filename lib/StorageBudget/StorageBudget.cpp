@@ -0,0 +1,138 @@
+#include "StorageBudget.hpp"
+
+void StorageBudget::init(sensor_t *sensor, framesize_t maxFramesize, int quality)
+{
+    _sensor = sensor;
+    _maxFramesize = maxFramesize;
+    if (_minFramesize > _maxFramesize) _minFramesize = _maxFramesize;
+    _applyFramesize(maxFramesize);
+    _applyQuality(quality);
+    log_i("==> done");
+}
+
+/**
+ * Use another sensor instance, e.g. after the camera has been
+ * reinitialized, and apply the current quality and framesize
+*/
+void StorageBudget::setSensor(sensor_t *sensor)
+{
+    _sensor = sensor;
+    if (! _sensor) return;
+    _sensor->set_framesize(_sensor, _framesize);
+    _sensor->set_quality(_sensor, _quality);
+}
+
+/**
+ * Bytes kept free on the card, e.g. for log files
+*/
+void StorageBudget::setReserve(uint64_t reserveBytes) { _reserve = reserveBytes; }
+
+/**
+ * JPEG quality range of the OV2640, 0..63 where a lower value
+ * means better quality and bigger files.
+*/
+void StorageBudget::setQualityRange(int bestQuality, int worstQuality)
+{
+    _bestQuality  = bestQuality;
+    _worstQuality = worstQuality;
+    _applyQuality(constrain(_quality, _bestQuality, _worstQuality));
+}
+
+void StorageBudget::setMinFramesize(framesize_t minFramesize) { _minFramesize = minFramesize; }
+
+/**
+ * Bytes allowed per frame so that the free capacity lasts
+ * for all remaining firings.
+*/
+uint32_t StorageBudget::bytesPerFrame(uint64_t freeBytes, uint32_t remainingFirings)
+{
+    if (freeBytes <= _reserve) return 0;
+    if (remainingFirings == 0) return UINT32_MAX;
+    uint64_t bytes = (freeBytes - _reserve) / remainingFirings;
+    return bytes > UINT32_MAX ? UINT32_MAX : bytes;
+}
+
+/**
+ * Feed the controller with the size of the last frame and the
+ * current storage situation. Quality and framesize are adjusted
+ * for the next frame if the mean size of the frames taken since
+ * the last adjustment deviates from the budget.
+*/
+void StorageBudget::update(size_t frameLen, uint64_t freeBytes, uint32_t remainingFirings)
+{
+    _sizes[_head] = frameLen;
+    _head = (_head + 1) % HISTORY;
+    if (_nbrOfSizes < HISTORY) _nbrOfSizes++;
+
+    _budget = bytesPerFrame(freeBytes, remainingFirings);
+    if (_nbrOfSizes < MIN_SAMPLES) return;
+
+    float ratio = _budget == 0 ? 100.0f : static_cast<float>(getMeanFrameSize()) / _budget;
+    int   midQuality = (_bestQuality + _worstQuality) / 2;
+
+    if (ratio > 1.05f)          // too big, compress more
+    {
+        int step = constrain(static_cast<int>(ceilf((ratio - 1.0f) * 10.0f)), 1, 8);
+        if (_quality + step <= _worstQuality)
+        {
+            _applyQuality(_quality + step);
+        }
+        else if (_framesize > _minFramesize)
+        {
+            _applyFramesize(static_cast<framesize_t>(_framesize - 1));
+            _applyQuality(midQuality);
+        }
+        else if (_quality != _worstQuality)
+        {
+            _applyQuality(_worstQuality);
+        }
+    }
+    else if (ratio < 0.80f)     // budget left, improve quality
+    {
+        if (_quality > _bestQuality)
+        {
+            _applyQuality(_quality - 1);
+        }
+        else if (ratio < 0.5f && _framesize < _maxFramesize)
+        {
+            _applyFramesize(static_cast<framesize_t>(_framesize + 1));
+            _applyQuality(midQuality);
+        }
+    }
+}
+
+uint32_t StorageBudget::getBudget() { return _budget; }
+
+uint32_t StorageBudget::getMeanFrameSize()
+{
+    uint64_t sum = 0;
+
+    if (_nbrOfSizes == 0) return 0;
+    for (int i = 0; i < _nbrOfSizes; i++) sum += _sizes[i];
+    return sum / _nbrOfSizes;
+}
+
+int StorageBudget::getQuality() { return _quality; }
+
+framesize_t StorageBudget::getFramesize() { return _framesize; }
+
+/**
+ * Frame sizes taken with other settings are no longer
+ * representative, so the history is cleared on each change
+*/
+void StorageBudget::_applyQuality(int quality)
+{
+    _quality = quality;
+    _nbrOfSizes = 0;
+    _head = 0;
+    if (_sensor) _sensor->set_quality(_sensor, quality);
+    log_i("quality: %d, framesize: %d, budget: %u", _quality, _framesize, _budget);
+}
+
+void StorageBudget::_applyFramesize(framesize_t framesize)
+{
+    _framesize = framesize;
+    _nbrOfSizes = 0;
+    _head = 0;
+    if (_sensor) _sensor->set_framesize(_sensor, framesize);
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <Arduino.h>
+#include <esp_camera.h>
+
+/**
+ * Closed loop controller which keeps the JPEG size of the photos
+ * within the storage budget. The budget in bytes per frame is the
+ * free capacity of the card (less a reserve) divided by the number
+ * of firings still to come, as reported by StartStopTimer.
+ *
+ * After each photo the controller is fed with the size of the frame.
+ * The mean size of the recent frames is compared with the budget and
+ * the JPEG quality is adjusted accordingly. If the quality reaches
+ * the worst acceptable value the framesize is reduced, if it reaches
+ * the best value with plenty of budget left, the framesize is increased.
+ *
+ * Example:
+ *      budget.init(esp_camera_sensor_get(), FRAMESIZE_UXGA);
+ *      ...
+ *      budget.update(fb->len, freeBytes, task4.getRemainingFirings());
+*/
+class StorageBudget
+{
+    public:
+        StorageBudget(){}
+
+        void init(sensor_t *sensor, framesize_t maxFramesize, int quality=12);
+        void setSensor(sensor_t *sensor);
+        void setReserve(uint64_t reserveBytes);
+        void setQualityRange(int bestQuality, int worstQuality);
+        void setMinFramesize(framesize_t minFramesize);
+        uint32_t bytesPerFrame(uint64_t freeBytes, uint32_t remainingFirings);
+        void update(size_t frameLen, uint64_t freeBytes, uint32_t remainingFirings);
+        uint32_t getBudget();
+        uint32_t getMeanFrameSize();
+        int getQuality();
+        framesize_t getFramesize();
+
+    private:
+        static const int HISTORY = 8;     // number of recent frame sizes considered
+        static const int MIN_SAMPLES = 2; // frames needed before the next adjustment
+
+        sensor_t      *_sensor       = nullptr;
+        uint64_t       _reserve      = 64 * 1024 * 1024;
+        int            _bestQuality  = 10;  // OV2640: lower value means better quality
+        int            _worstQuality = 40;
+        int            _quality      = 12;
+        framesize_t    _minFramesize = FRAMESIZE_VGA;
+        framesize_t    _maxFramesize = FRAMESIZE_UXGA;
+        framesize_t    _framesize    = FRAMESIZE_UXGA;
+        uint32_t       _sizes[HISTORY];
+        int            _nbrOfSizes   = 0;
+        int            _head         = 0;
+        uint32_t       _budget       = 0;
+        void           _applyQuality(int quality);
+        void           _applyFramesize(framesize_t framesize);
+};
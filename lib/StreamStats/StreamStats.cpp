@@ -0,0 +1,75 @@
+#include <cmath>
+#include "StreamStats.hpp"
+
+void StreamStats::init(uint32_t decimation, uint16_t mask)
+{
+    _decimation = decimation ? decimation : 1;
+    _mask       = mask;
+    _blockSum   = 0;
+    _blockCount = 0;
+    take();
+}
+
+/**
+ * Add the samples, a block may continue over several calls
+*/
+void StreamStats::add(const uint16_t *samples, size_t n)
+{
+    uint64_t sum      = _sum;
+    uint64_t sumSq    = _sumSq;
+    uint32_t blockSum = _blockSum;
+    uint32_t blockCnt = _blockCount;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t v = samples[i] & _mask;
+        sum      += v;
+        sumSq    += v * v;
+        blockSum += v;
+        if (++blockCnt == _decimation)
+        {
+            if (blockSum < _minBlock) _minBlock = blockSum;
+            if (blockSum > _maxBlock) _maxBlock = blockSum;
+            blockSum = 0;
+            blockCnt = 0;
+        }
+    }
+    _sum        = sum;
+    _sumSq      = sumSq;
+    _blockSum   = blockSum;
+    _blockCount = blockCnt;
+    _count     += n;
+}
+
+/**
+ * The record of the samples since the last one, and start over.
+ * A block not complete yet belongs to the next record. Without a
+ * complete block min and max are the mean.
+*/
+SampleRecord StreamStats::take()
+{
+    SampleRecord rec = {};
+
+    if (_count)
+    {
+        double mean = static_cast<double>(_sum) / _count;     // once per record, the
+        double sq   = static_cast<double>(_sumSq) / _count;   // variance needs double
+        bool   full = _minBlock != UINT32_MAX;
+        rec.count   = _count;
+        rec.mean    = mean;
+        rec.rms     = sqrt(sq);
+        rec.acRms   = sqrt(fmax(sq - mean * mean, 0.0));
+        rec.min     = full ? static_cast<float>(_minBlock) / _decimation : rec.mean;
+        rec.max     = full ? static_cast<float>(_maxBlock) / _decimation : rec.mean;
+    }
+    _count    = 0;
+    _sum      = 0;
+    _sumSq    = 0;
+    _minBlock = UINT32_MAX;
+    _maxBlock = 0;
+    return rec;
+}
+
+uint32_t StreamStats::getCount() { return _count; }
+
+uint32_t StreamStats::getDecimation() { return _decimation; }
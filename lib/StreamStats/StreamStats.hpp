@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Aggregate of the samples of one firing: the number of samples, min
+ * and max of the decimated samples, mean, RMS and the RMS of the AC
+ * part (the standard deviation), in raw ADC units
+*/
+using SampleRecord = struct smpr { uint32_t count; float min; float max; float mean; float rms; float acRms; };
+
+/**
+ * Streaming statistics of ADC samples at kHz rates. The samples are
+ * decimated by averaging blocks of decimation samples (boxcar), which
+ * lowers the noise; min and max are taken of the block means, so a
+ * single noisy sample does not make the extremes. Mean and RMS are
+ * taken of all samples. The kernel only adds integers per sample (the
+ * squares in 64 bits), the floats are computed once per record.
+ * mask selects the bits of the value, e.g. 0x0FFF for the samples of
+ * the I2S ADC mode, which carry the channel in the upper bits.
+ * There are no dependencies on Arduino.
+ *
+ * Example:
+ *      stats.init(16, 0x0FFF);
+ *      stats.add(dmaBuf, n);       // for each DMA buffer
+ *      SampleRecord rec = stats.take();
+*/
+class StreamStats
+{
+    public:
+        StreamStats(){}
+
+        void init(uint32_t decimation=1, uint16_t mask=0xFFFF);
+        void add(const uint16_t *samples, size_t n);
+        SampleRecord take();
+        uint32_t getCount();
+        uint32_t getDecimation();
+
+    private:
+        uint32_t    _decimation = 1;
+        uint16_t    _mask       = 0xFFFF;
+        uint32_t    _count      = 0;
+        uint64_t    _sum        = 0;
+        uint64_t    _sumSq      = 0;
+        uint32_t    _blockSum   = 0;     // of the current block
+        uint32_t    _blockCount = 0;
+        uint32_t    _minBlock   = UINT32_MAX;   // block sums
+        uint32_t    _maxBlock   = 0;
+};
@@ -0,0 +1,331 @@
+#include "TieredStore.hpp"
+#include "Crc32.hpp"
+
+bool PartitionFlash::begin(const char label[])
+{
+    _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    return _partition != nullptr;
+}
+
+size_t PartitionFlash::getSize() { return _partition->size; }
+
+size_t PartitionFlash::getSectorSize() { return SPI_FLASH_SEC_SIZE; }
+
+bool PartitionFlash::read(size_t addr, void *buf, size_t len)
+{
+    return esp_partition_read(_partition, addr, buf, len) == ESP_OK;
+}
+
+bool PartitionFlash::write(size_t addr, const void *buf, size_t len)
+{
+    return esp_partition_write(_partition, addr, buf, len) == ESP_OK;
+}
+
+bool PartitionFlash::erase(size_t addr, size_t len)
+{
+    return esp_partition_erase_range(_partition, addr, len) == ESP_OK;
+}
+
+/**
+ * Mount the staging ring on the partition and start the migration task.
+ * Photos staged before a reset are migrated by the first batch. The
+ * partition must not be used by a file system (SPIFFS is not mounted).
+*/
+bool TieredStore::init(fs::FS &bulk, const char partition[], uint32_t batchSize, uint32_t intervalMs)
+{
+    _bulk       = &bulk;
+    _batchSize  = max(batchSize, 1U);
+    _intervalMs = intervalMs;
+    _mutex      = xSemaphoreCreateMutex();
+    _health.init();
+    _prefs.begin("health", false);      // the card is identified at its first file
+
+    if (! _flash.begin(partition) || ! _ring.mount(&_flash))
+    {
+        log_e("partition %s not usable, photos are written directly", partition);
+        return false;
+    }
+    log_i("%s: %u KB, %u photos staged, %u dropped", partition, _ring.getCapacity() / 1024, 
+          _ring.getNbrOfRecords(), _ring.getNbrOfDropped());
+
+    if (xTaskCreate(_taskFunction, "Migrate", 4096, this, 1, &_task) != pdPASS)
+    {
+        log_e("migration task not created");
+        return false;
+    }
+    log_i("==> done");
+    return true;
+}
+
+/**
+ * Stage a photo in the ring and wake the migration task. If the
+ * ring has no space, the photo is written to the card directly.
+*/
+bool TieredStore::store(const char path[], const uint8_t *buf, size_t len)
+{
+    bool staged = false;
+
+    if (_task)
+    {
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+        int64_t t0 = esp_timer_get_time();
+        staged = _ring.append(path, buf, len);
+        uint32_t us = esp_timer_get_time() - t0;
+        xSemaphoreGive(_mutex);
+        if (staged)
+        {
+            _staged++;
+            _stagingUs += us;
+            _maxStagingUs = max(_maxStagingUs, us);
+            migrate();
+            return true;
+        }
+    }
+    if (_writeBulk(path, buf, len))
+    {
+        _direct++;
+        return true;
+    }
+    _failed++;
+    log_e("%s not saved", path);
+    return false;
+}
+
+/**
+ * Wake the migration task before its interval has elapsed
+*/
+void TieredStore::migrate()
+{
+    if (_task) xTaskNotifyGive(_task);
+}
+
+uint32_t TieredStore::getNbrOfStaged()
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    uint32_t n = _ring.getNbrOfRecords();
+    xSemaphoreGive(_mutex);
+    return n;
+}
+
+/**
+ * Mean time to stage a photo in microseconds
+*/
+uint32_t TieredStore::getMeanStagingLatency() { return _staged ? _stagingUs / _staged : 0; }
+
+uint32_t TieredStore::getMaxStagingLatency() { return _maxStagingUs; }
+
+/**
+ * Bytes per second copied from the ring to the card, 
+ * including the erasing of the sectors freed
+*/
+float TieredStore::getMigrationThroughput()
+{
+    return _migrationUs ? 1e6f * _migratedBytes / _migrationUs : 0.0f;
+}
+
+/**
+ * Health of the card, 1.0 (as new) .. 0.0, see WriteHealth
+*/
+float TieredStore::getHealth() { return _health.getHealth(); }
+
+/**
+ * True if the card has degraded and the photos are read back
+*/
+bool TieredStore::isDegraded() { return _health.isDegraded(); }
+
+void TieredStore::printStats()
+{
+    log_i("staged: %u (mean %u us, max %u us), migrated: %u (%.1f KB/s), direct: %u, failed: %u, in ring: %u",
+          _staged, getMeanStagingLatency(), _maxStagingUs, _migrated, getMigrationThroughput() / 1024,
+          _direct, _failed, getNbrOfStaged());
+    HealthReference ref;
+    _health.getReference(ref);
+    log_i("card health: %.2f%s, write p50: %u us, p99: %u us (new: %u us), verified: %u",
+          _health.getHealth(), _health.isDegraded() ? " (degraded)" : "", _health.getQuantile(0.5f),
+          _health.getQuantile(0.99f), ref.p99Us, _verified);
+}
+
+/**
+ * Wait for a photo or the interval, then migrate a batch. The
+ * task has a low priority, the capture tasks are not delayed.
+*/
+void TieredStore::_taskFunction(void *p)
+{
+    TieredStore *store = static_cast<TieredStore *>(p);
+
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(store->_intervalMs));
+        while (store->_migrateBatch() == store->_batchSize) { vTaskDelay(1); }
+    }
+}
+
+/**
+ * Copy up to a batch of the oldest photos to the card,
+ * returns the number of photos migrated
+*/
+uint32_t TieredStore::_migrateBatch()
+{
+    uint32_t n = 0;
+
+    while (n < _batchSize && getNbrOfStaged() > 0 && _copyOldest()) n++;
+    return n;
+}
+
+bool TieredStore::_copyOldest()
+{
+    char    path[StagingRing::MAX_NAME + 1];
+    size_t  len;
+    bool    ok;
+
+    // the appending task waits for the mutex during a chunk at most
+    int64_t t0 = esp_timer_get_time();
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    ok = _ring.peek(path, len);
+    xSemaphoreGive(_mutex);
+    if (! ok) return false;
+
+    File file = _bulk->open(path, FILE_WRITE);
+    if (! file) return false;
+    _identifyCard();
+    uint32_t crc = 0;
+    for (size_t offset = 0; ok && offset < len; offset += CHUNK)
+    {
+        size_t n = min(CHUNK, len - offset);
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+        ok = _ring.read(offset, _chunk, n);
+        xSemaphoreGive(_mutex);
+        ok = ok && _write(file, _chunk, n);
+        crc = Crc32::compute(_chunk, n, crc);
+    }
+    file.close();
+    if (ok && _health.isDegraded()) ok = _verify(path, len, crc);
+    if (! ok)
+    {
+        log_w("%s not migrated, retried later", path);
+        return false;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _ring.pop();
+    xSemaphoreGive(_mutex);
+    _migrated++;
+    _migratedBytes += len;
+    _migrationUs   += esp_timer_get_time() - t0;
+    return true;
+}
+
+bool TieredStore::_writeBulk(const char path[], const uint8_t *buf, size_t len)
+{
+    File file = _bulk->open(path, FILE_WRITE);
+    if (! file) return false;
+    _identifyCard();
+    bool ok = true;
+    for (size_t offset = 0; ok && offset < len; offset += CHUNK)
+    {
+        ok = _write(file, buf + offset, min(CHUNK, len - offset));
+    }
+    file.close();
+    return ok && (! _health.isDegraded() || _verify(path, len, Crc32::compute(buf, len)));
+}
+
+/**
+ * Write a chunk and count its latency
+*/
+bool TieredStore::_write(File &file, const uint8_t *buf, size_t len)
+{
+    int64_t t0 = esp_timer_get_time();
+    bool    ok = file.write(buf, len) == len;
+    uint32_t us = esp_timer_get_time() - t0;
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _health.add(us);
+    _saveReference();
+    xSemaphoreGive(_mutex);
+    return ok;
+}
+
+/**
+ * Read a file back and compare its CRC
+*/
+bool TieredStore::_verify(const char path[], size_t len, uint32_t crc)
+{
+    uint8_t buf[512];
+    uint32_t check = 0;
+
+    File file = _bulk->open(path, FILE_READ);
+    if (! file || file.size() != len) return false;
+    for (size_t offset = 0; offset < len; offset += sizeof(buf))
+    {
+        size_t n = min(sizeof(buf), len - offset);
+        if (file.read(buf, n) != n) break;
+        check = Crc32::compute(buf, n, check);
+    }
+    file.close();
+    _verified++;
+    if (check != crc) log_e("%s: read back differs", path);
+    return check == crc;
+}
+
+/**
+ * Restore the reference latencies from NVS if they were measured on
+ * this card. Called after a file of the card has been opened, so the
+ * card is mounted, until the card is known. A card is told by a random
+ * id in a file on it, a card without one gets a new id. The stored
+ * reference is replaced only for another id read or written, it is
+ * kept if the id cannot be read or written.
+*/
+void TieredStore::_identifyCard()
+{
+    HealthReference ref;
+    uint32_t        id = 0;
+    size_t          n  = 0;
+
+    if (_cardId) return;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (_bulk->exists(CARD_ID))
+    {
+        File file = _bulk->open(CARD_ID, FILE_READ);
+        if (file) n = file.read(reinterpret_cast<uint8_t *>(&id), sizeof(id));
+        if (file) file.close();
+    }
+    else
+    {
+        id = esp_random() | 1;
+        File file = _bulk->open(CARD_ID, FILE_WRITE);
+        if (file) n = file.write(reinterpret_cast<const uint8_t *>(&id), sizeof(id));
+        if (file) file.close();
+    }
+    if (n != sizeof(id) || ! id)
+    {
+        xSemaphoreGive(_mutex);
+        return;
+    }
+
+    _cardId = id;
+    if (id == _prefs.getUInt("card", 0) && _prefs.getBytes("reference", &ref, sizeof(ref)) == sizeof(ref))
+    {
+        _health.setReference(ref);
+        _referenceSaved = true;
+        log_i("card %08x: write p99 as new %u us", id, ref.p99Us);
+    }
+    else
+    {
+        _prefs.remove("reference");
+        _prefs.putUInt("card", id);
+        log_i("card %08x: new reference", id);
+    }
+    xSemaphoreGive(_mutex);
+}
+
+/**
+ * Store the reference once it is complete, called under _mutex
+*/
+void TieredStore::_saveReference()
+{
+    HealthReference ref;
+
+    if (_referenceSaved || ! _cardId || ! _health.getReference(ref)) return;
+    if (_prefs.putBytes("reference", &ref, sizeof(ref)) != sizeof(ref)) log_e("NVS write failed");
+    _referenceSaved = true;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+#include <esp_partition.h>
+#include <Preferences.h>
+#include "StagingRing.hpp"
+#include "WriteHealth.hpp"
+
+/**
+ * Flash device on a data partition of the internal flash,
+ * e.g. the spiffs partition of the default partition table
+*/
+class PartitionFlash : public FlashDevice
+{
+    public:
+        PartitionFlash(){}
+
+        bool begin(const char label[]);
+        size_t getSize() override;
+        size_t getSectorSize() override;
+        bool read(size_t addr, void *buf, size_t len) override;
+        bool write(size_t addr, const void *buf, size_t len) override;
+        bool erase(size_t addr, size_t len) override;
+
+    private:
+        const esp_partition_t *_partition = nullptr;
+};
+
+/**
+ * Two storage tiers for the photos: a photo lands in the staging ring
+ * on the internal flash first, which is fast and does not depend on
+ * the SD card. A background task migrates the staged photos in batches
+ * to the bulk file system (the SD card). If the card is missing or
+ * fails, the photos stay in the ring until it works again. If the ring
+ * is full, the photo is written directly to the bulk file system.
+ *
+ * The latency of every chunk written to the card is fed to a health
+ * monitor. When the card degrades, each photo written is read back and
+ * checked before it is removed from the ring, so a failing card does
+ * not lose photos silently. The latencies of the card as new are kept
+ * in NVS with the id of the card (a file on it), so they survive a
+ * reboot and are only measured again for a new or replaced card.
+ *
+ * Example:
+ *      tiered.init(SD_MMC);
+ *      tiered.store("/photo00042.jpg", fb->buf, fb->len);
+*/
+class TieredStore
+{
+    public:
+        TieredStore(){}
+
+        bool init(fs::FS &bulk, const char partition[]="spiffs", uint32_t batchSize=4, uint32_t intervalMs=30000);
+        bool store(const char path[], const uint8_t *buf, size_t len);
+        void migrate();
+        uint32_t getNbrOfStaged();
+        uint32_t getMeanStagingLatency();
+        uint32_t getMaxStagingLatency();
+        float getMigrationThroughput();
+        float getHealth();
+        bool isDegraded();
+        void printStats();
+
+    private:
+        static const size_t CHUNK = 4096;   // bytes copied from flash to the card at once
+        static constexpr const char *CARD_ID = "/.cardid";
+
+        PartitionFlash    _flash;
+        StagingRing       _ring;
+        WriteHealth       _health;
+        Preferences       _prefs;             // id and reference latencies of the card
+        uint32_t          _cardId     = 0;    // 0 until identified, the reference is not stored
+        bool              _referenceSaved = false;
+        fs::FS           *_bulk       = nullptr;
+        SemaphoreHandle_t _mutex      = nullptr;
+        TaskHandle_t      _task       = nullptr;
+        uint32_t          _batchSize  = 4;
+        uint32_t          _intervalMs = 30000;
+        uint32_t          _staged     = 0;    // photos appended to the ring
+        uint32_t          _migrated   = 0;    // photos copied from the ring to the card
+        uint32_t          _direct     = 0;    // photos written directly, the ring was full
+        uint32_t          _failed     = 0;    // photos lost
+        uint32_t          _verified   = 0;    // photos read back in degraded mode
+        uint64_t          _stagingUs  = 0;    // sum of the append times
+        uint32_t          _maxStagingUs = 0;
+        uint64_t          _migratedBytes = 0;
+        uint64_t          _migrationUs   = 0;
+        uint8_t           _chunk[CHUNK];
+
+        static void       _taskFunction(void *p);
+        uint32_t          _migrateBatch();
+        bool              _copyOldest();
+        bool              _writeBulk(const char path[], const uint8_t *buf, size_t len);
+        bool              _write(File &file, const uint8_t *buf, size_t len);
+        bool              _verify(const char path[], size_t len, uint32_t crc);
+        void              _identifyCard();
+        void              _saveReference();
+};
@@ -0,0 +1,416 @@
+#include <cstring>
+#include <cstddef>
+#include "TimeSeries.hpp"
+#include "Crc32.hpp"
+
+/**
+ * Start an empty store of nbrOfSeries values per point. The store id
+ * is increased, so the blocks left over from the previous store are
+ * not mistaken as new ones.
+*/
+bool TimeSeries::format(BlockDevice *dev, int nbrOfSeries)
+{
+    Super sb;
+
+    if (! dev || nbrOfSeries < 1 || nbrOfSeries > MAX_SERIES || dev->getNbrOfBlocks() <= FIRST_BLOCK) return false;
+    _dev     = dev;
+    _storeId = 1;
+    if (_dev->readBlocks(0, _read, 1))
+    {
+        memcpy(&sb, _read, sizeof(sb));
+        if (sb.magic == MAGIC_SUPER && sb.crc == Crc32::compute(&sb, offsetof(Super, crc))) _storeId = sb.storeId + 1;
+    }
+    sb     = { MAGIC_SUPER, _storeId, static_cast<uint32_t>(nbrOfSeries), 0 };
+    sb.crc = Crc32::compute(&sb, offsetof(Super, crc));
+    memset(_read, 0, sizeof(_read));
+    memcpy(_read, &sb, sizeof(sb));
+    if (! _dev->writeBlocks(0, _read, 1)) return false;
+
+    _nbrOfSeries = nbrOfSeries;
+    _head        = FIRST_BLOCK;
+    _nbrOfPoints = 0;
+    _hdr         = {};
+    _dirty       = false;
+    return true;
+}
+
+/**
+ * Read the superblock and find the last block by binary search (the
+ * valid blocks are the ones before the end). The points are appended
+ * to the last block until it is full. Returns false if there is no
+ * store on the device.
+*/
+bool TimeSeries::mount(BlockDevice *dev)
+{
+    Super    sb;
+    uint32_t lo = FIRST_BLOCK;
+    uint32_t hi;
+    uint32_t n  = 0;
+
+    _dev = dev;
+    if (! dev || ! dev->readBlocks(0, _read, 1)) return false;
+    memcpy(&sb, _read, sizeof(sb));
+    if (sb.magic != MAGIC_SUPER || sb.crc != Crc32::compute(&sb, offsetof(Super, crc))
+        || sb.nbrOfSeries < 1 || sb.nbrOfSeries > MAX_SERIES) return false;
+    _storeId     = sb.storeId;
+    _nbrOfSeries = sb.nbrOfSeries;
+    _head        = FIRST_BLOCK;
+    _nbrOfPoints = 0;
+    _hdr         = {};
+    _dirty       = false;
+
+    hi = dev->getNbrOfBlocks();
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (_readBlock(mid)) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == FIRST_BLOCK) return true;
+
+    if (! _readBlock(lo - 1)) return false;
+    memcpy(_block, _read, sizeof(_block));
+    memcpy(&_hdr, _block, sizeof(_hdr));
+    _scan(_block, INT64_MIN, INT64_MAX, nullptr, nullptr, n, &_state);
+    _head        = lo - 1;
+    _nbrOfPoints = _hdr.firstPoint + _hdr.count;
+    return true;
+}
+
+/**
+ * Add a point with a value of each series, not older than the
+ * point before. The block is written when it is full, else it
+ * stays in memory until flush(). Returns false if the store is
+ * full or the block could not be written.
+*/
+bool TimeSeries::append(int64_t timeMs, const float values[])
+{
+    if (! _dev || _head >= _dev->getNbrOfBlocks()) return false;
+    if (_hdr.count && timeMs < _hdr.lastMs) return false;
+
+    if (! _hdr.count)
+    {
+        _start(timeMs, values);
+    }
+    else
+    {
+        State saved = _state;
+        if (_hdr.count == UINT16_MAX || ! _encode(timeMs, values))
+        {
+            _state = saved;             // the bits of the point are overwritten by the next one
+            if (! _writeHead()) return false;
+            _hdr = {};
+            if (++_head >= _dev->getNbrOfBlocks()) return false;
+            _start(timeMs, values);
+        }
+    }
+    _hdr.count++;
+    _hdr.lastMs = timeMs;
+    _nbrOfPoints++;
+    _dirty = true;
+    return true;
+}
+
+/**
+ * Write the block being filled, e.g. after each point if
+ * it must survive a reset
+*/
+bool TimeSeries::flush()
+{
+    if (! _dev) return false;
+    return ! _dirty || _writeHead();
+}
+
+/**
+ * Call the handler for each point from fromMs to toMs (inclusive) in
+ * time order, the block being filled included. Only the blocks of the
+ * range are decompressed. Returns the number of points handed to the
+ * handler.
+*/
+uint32_t TimeSeries::query(int64_t fromMs, int64_t toMs, PointHandler handler, void *ctx)
+{
+    uint32_t n      = 0;
+    uint32_t lo     = FIRST_BLOCK;
+    uint32_t hi     = _head;
+    uint32_t cached = 0;            // block in _read, 0 for none
+
+    _blocksRead = 0;
+    if (! _dev || ! handler || fromMs > toMs) return 0;
+    while (lo < hi)                 // first block ending at fromMs or later
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int64_t  lastMs;
+        if (! _readBlock(mid)) return 0;
+        memcpy(&lastMs, _read + offsetof(Header, lastMs), sizeof(lastMs));
+        cached = mid;
+        if (lastMs < fromMs) lo = mid + 1;
+        else hi = mid;
+    }
+    for (uint32_t lba = lo; lba < _head; lba++)
+    {
+        if (lba != cached && ! _readBlock(lba)) return n;
+        if (! _scan(_read, fromMs, toMs, handler, ctx, n)) return n;
+    }
+    if (_hdr.count && _hdr.firstMs <= toMs)
+    {
+        memcpy(_block, &_hdr, sizeof(_hdr));
+        _scan(_block, fromMs, toMs, handler, ctx, n);
+    }
+    return n;
+}
+
+int TimeSeries::getNbrOfSeries() { return _nbrOfSeries; }
+
+uint32_t TimeSeries::getNbrOfPoints() { return _nbrOfPoints; }
+
+/**
+ * Data blocks written or being filled
+*/
+uint32_t TimeSeries::getUsedBlocks() { return _head - FIRST_BLOCK + (_hdr.count ? 1 : 0); }
+
+uint32_t TimeSeries::getFreeBlocks()
+{
+    uint32_t nbrOfBlocks = _dev ? _dev->getNbrOfBlocks() : 0;
+    return nbrOfBlocks > FIRST_BLOCK + getUsedBlocks() ? nbrOfBlocks - FIRST_BLOCK - getUsedBlocks() : 0;
+}
+
+/**
+ * Blocks read by the last query, the binary search included
+*/
+uint32_t TimeSeries::getBlocksRead() { return _blocksRead; }
+
+/**
+ * Size of the points as binary records (time and floats) by the size
+ * of the blocks, the unused rest of the full blocks included
+*/
+float TimeSeries::getCompressionRatio()
+{
+    uint64_t raw    = static_cast<uint64_t>(_nbrOfPoints) * (sizeof(int64_t) + _nbrOfSeries * sizeof(float));
+    uint64_t stored = static_cast<uint64_t>(_head - FIRST_BLOCK) * BlockDevice::BLOCK_SIZE
+                      + (_hdr.count ? sizeof(Header) + (_state.pos + 7) / 8 : 0);
+    return stored ? static_cast<float>(raw) / stored : 0.0f;
+}
+
+/**
+ * Begin a new block with the full time and values of its first point
+*/
+void TimeSeries::_start(int64_t timeMs, const float values[])
+{
+    memset(_block, 0, sizeof(_block));
+    _hdr           = { timeMs, timeMs, MAGIC_BLOCK, _storeId, _nbrOfPoints, 0, 0, 0 };
+    _state.timeMs  = timeMs;
+    _state.deltaMs = 0;
+    _state.pos     = 0;
+    for (int i = 0; i < _nbrOfSeries; i++)
+    {
+        memcpy(&_state.values[i], &values[i], sizeof(float));
+        _state.leading[i]  = NO_WINDOW;
+        _state.trailing[i] = 0;
+        _put(_state.values[i], 32);
+    }
+}
+
+/**
+ * Append the bits of a point to the block. The delta-of-delta of the
+ * time takes 1, 9, 12 or 16 bits up to +-2 s, else 36 bits. A value
+ * unchanged takes 1 bit, else 2 bits and its meaningful bits if they
+ * fit into those of the value before, else 12 bits and the meaningful
+ * bits. Returns false if the point does not fit, the state is not
+ * valid then.
+*/
+bool TimeSeries::_encode(int64_t timeMs, const float values[])
+{
+    State  &s       = _state;
+    int64_t deltaMs = timeMs - s.timeMs;
+    int64_t dod     = deltaMs - s.deltaMs;
+    bool    ok;
+
+    if (dod == 0) ok = _put(0, 1);
+    else if (dod >= -63 && dod <= 64) ok = _put(0x2, 2) && _put(dod + 63, 7);
+    else if (dod >= -255 && dod <= 256) ok = _put(0x6, 3) && _put(dod + 255, 9);
+    else if (dod >= -2047 && dod <= 2048) ok = _put(0xE, 4) && _put(dod + 2047, 12);
+    else if (dod >= INT32_MIN && dod <= INT32_MAX) ok = _put(0xF, 4) && _put(static_cast<uint32_t>(dod), 32);
+    else return false;              // a gap of weeks, the next block starts with the full time
+    if (! ok) return false;
+    s.timeMs  = timeMs;
+    s.deltaMs = deltaMs;
+
+    for (int i = 0; i < _nbrOfSeries && ok; i++)
+    {
+        uint32_t v;
+        memcpy(&v, &values[i], sizeof(v));
+        uint32_t x = v ^ s.values[i];
+
+        if (x == 0)
+        {
+            ok = _put(0, 1);
+        }
+        else
+        {
+            uint8_t leading  = __builtin_clz(x);
+            uint8_t trailing = __builtin_ctz(x);
+            if (s.leading[i] != NO_WINDOW && leading >= s.leading[i] && trailing >= s.trailing[i])
+            {
+                ok = _put(0x2, 2) && _put(x >> s.trailing[i], 32 - s.leading[i] - s.trailing[i]);
+            }
+            else
+            {
+                uint32_t len = 32 - leading - trailing;
+                ok = _put(0x3, 2) && _put(leading, 5) && _put(len - 1, 5) && _put(x >> trailing, len);
+                s.leading[i]  = leading;
+                s.trailing[i] = trailing;
+            }
+        }
+        s.values[i] = v;
+    }
+    return ok;
+}
+
+/**
+ * Read the next point of a block, the inverse of _encode()
+*/
+void TimeSeries::_decode(const uint8_t *payload, State &s, float values[], bool first)
+{
+    if (first)
+    {
+        s.deltaMs = 0;
+        for (int i = 0; i < _nbrOfSeries; i++)
+        {
+            s.values[i]   = _get(payload, s.pos, 32);
+            s.leading[i]  = NO_WINDOW;
+            s.trailing[i] = 0;
+        }
+    }
+    else
+    {
+        int64_t dod;
+        if (! _get(payload, s.pos, 1)) dod = 0;
+        else if (! _get(payload, s.pos, 1)) dod = static_cast<int64_t>(_get(payload, s.pos, 7)) - 63;
+        else if (! _get(payload, s.pos, 1)) dod = static_cast<int64_t>(_get(payload, s.pos, 9)) - 255;
+        else if (! _get(payload, s.pos, 1)) dod = static_cast<int64_t>(_get(payload, s.pos, 12)) - 2047;
+        else dod = static_cast<int32_t>(_get(payload, s.pos, 32));
+        s.deltaMs += dod;
+        s.timeMs  += s.deltaMs;
+
+        for (int i = 0; i < _nbrOfSeries; i++)
+        {
+            if (! _get(payload, s.pos, 1)) continue;
+            if (_get(payload, s.pos, 1))
+            {
+                s.leading[i]  = _get(payload, s.pos, 5);
+                s.trailing[i] = 32 - s.leading[i] - (_get(payload, s.pos, 5) + 1);
+            }
+            s.values[i] ^= _get(payload, s.pos, 32 - s.leading[i] - s.trailing[i]) << s.trailing[i];
+        }
+    }
+    memcpy(values, s.values, _nbrOfSeries * sizeof(float));
+}
+
+/**
+ * Write the n lowest bits of value at the bit position of the head
+ * block, most significant first. The bits there are overwritten, so a
+ * point which did not fit leaves nothing behind. Returns false if the
+ * bits do not fit into the block.
+*/
+bool TimeSeries::_put(uint32_t value, uint32_t n)
+{
+    uint8_t *payload = _block + sizeof(Header);
+
+    if (_state.pos + n > PAYLOAD_BITS) return false;
+    while (n > 0)
+    {
+        uint32_t used  = _state.pos & 7;
+        uint32_t k     = 8 - used < n ? 8 - used : n;
+        uint32_t shift = 8 - used - k;
+        uint8_t  mask  = ((1U << k) - 1) << shift;
+        uint8_t  bits  = (static_cast<uint64_t>(value) >> (n - k)) & ((1U << k) - 1);
+        uint8_t &byte  = payload[_state.pos >> 3];
+
+        byte = (byte & ~mask) | bits << shift;
+        _state.pos += k;
+        n          -= k;
+    }
+    return true;
+}
+
+/**
+ * Read n bits (at most 32) at the bit position and advance it
+*/
+uint32_t TimeSeries::_get(const uint8_t *payload, uint32_t &pos, uint32_t n)
+{
+    uint32_t value = 0;
+
+    while (n > 0)
+    {
+        uint32_t used  = pos & 7;
+        uint32_t k     = 8 - used < n ? 8 - used : n;
+        uint32_t shift = 8 - used - k;
+
+        value  = static_cast<uint32_t>(static_cast<uint64_t>(value) << k) | ((payload[pos >> 3] >> shift) & ((1U << k) - 1));
+        pos   += k;
+        n     -= k;
+    }
+    return value;
+}
+
+/**
+ * Decode the points of a block and hand those from fromMs to toMs to
+ * the handler. Returns false if a point after toMs was reached or the
+ * handler has ended the query. With end the state after the last point.
+*/
+bool TimeSeries::_scan(const uint8_t *block, int64_t fromMs, int64_t toMs, PointHandler handler, void *ctx,
+                       uint32_t &n, State *end)
+{
+    Header hdr;
+    State  s;
+    float  values[MAX_SERIES];
+
+    memcpy(&hdr, block, sizeof(hdr));
+    s.timeMs = hdr.firstMs;
+    s.pos    = 0;
+    for (uint32_t i = 0; i < hdr.count; i++)
+    {
+        _decode(block + sizeof(Header), s, values, i == 0);
+        if (s.timeMs > toMs) return false;
+        if (s.timeMs < fromMs) continue;
+        n++;
+        if (handler && ! handler(s.timeMs, values, ctx)) return false;
+    }
+    if (end) *end = s;
+    return true;
+}
+
+/**
+ * Read a data block into _read, returns false if it is
+ * not a valid block of this store
+*/
+bool TimeSeries::_readBlock(uint32_t lba)
+{
+    Header hdr;
+
+    if (lba >= _dev->getNbrOfBlocks() || ! _dev->readBlocks(lba, _read, 1)) return false;
+    _blocksRead++;
+    memcpy(&hdr, _read, sizeof(hdr));
+    return hdr.magic == MAGIC_BLOCK && hdr.storeId == _storeId && hdr.count > 0 && hdr.bits <= PAYLOAD_BITS
+           && hdr.crc == _crc(_read);
+}
+
+bool TimeSeries::_writeHead()
+{
+    _hdr.bits = _state.pos;
+    memcpy(_block, &_hdr, sizeof(_hdr));
+    _hdr.crc = _crc(_block);
+    memcpy(_block, &_hdr, sizeof(_hdr));
+    if (! _dev->writeBlocks(_head, _block, 1)) return false;
+    _dirty = false;
+    return true;
+}
+
+/**
+ * CRC of the header without its CRC and of the payload
+*/
+uint32_t TimeSeries::_crc(const uint8_t *block)
+{
+    uint32_t crc = Crc32::compute(block, offsetof(Header, crc));
+    return Crc32::compute(block + sizeof(Header), PAYLOAD_BITS / 8, crc);
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include "BlockDevice.hpp"
+
+// called by TimeSeries::query() for each point, returns false to end the query
+using PointHandler = bool(*)(int64_t timeMs, const float values[], void *ctx);
+
+/**
+ * Append-only store of sensor readings (e.g. light level, temperature
+ * and battery voltage), compressed as in Facebook's Gorilla: a point is
+ * a time in ms and one float of each series. The time is stored as the
+ * difference of its delta to the delta before (delta-of-delta), which
+ * is a single bit for a regular interval and some bits for jitter. A
+ * value is stored as XOR with the value before: one bit if it has not
+ * changed, else only its meaningful bits. Slowly changing readings take
+ * a few bits instead of the dozens of a line of text.
+ *
+ * The points are packed into blocks of 512 bytes, each starting over
+ * with the full time and values of its first point and a header with
+ * the time range, so it decodes on its own. The blocks are in time
+ * order: a range query finds the first block of the range by binary
+ * search over the headers and decompresses only the blocks of the range.
+ *
+ * Layout: block 0 is the superblock (store id, number of series), the
+ * data blocks follow. The block being filled is kept in memory, flush()
+ * writes it, so it is rewritten until it is full (fine on the SD card
+ * or a file, on raw flash the device has to hide the erase). When
+ * mounting, the end of the store is found by binary search as well and
+ * the last block is continued.
+ *
+ * The store is not thread safe, the caller serializes the access. No
+ * dependency on Arduino, the benchmark runs on the host.
+ *
+ * Example:
+ *      if (! sensors.mount(&file)) sensors.format(&file, 3);
+ *      float values[] = { light, temperature, battery };
+ *      sensors.append(nowMs, values);
+ *      sensors.flush();
+ *      ...
+ *      sensors.query(nowMs - 3600000, nowMs, addPoint, &sums);
+*/
+class TimeSeries
+{
+    public:
+        static const int MAX_SERIES = 8;
+
+        TimeSeries(){}
+
+        bool format(BlockDevice *dev, int nbrOfSeries);
+        bool mount(BlockDevice *dev);
+        bool append(int64_t timeMs, const float values[]);
+        bool flush();
+        uint32_t query(int64_t fromMs, int64_t toMs, PointHandler handler, void *ctx=nullptr);
+        int getNbrOfSeries();
+        uint32_t getNbrOfPoints();
+        uint32_t getUsedBlocks();
+        uint32_t getFreeBlocks();
+        uint32_t getBlocksRead();
+        float getCompressionRatio();
+
+    private:
+        static const uint32_t MAGIC_SUPER = 0x31535354;  // "TSS1"
+        static const uint32_t MAGIC_BLOCK = 0x31425354;  // "TSB1"
+        static const uint32_t FIRST_BLOCK = 1;
+        static const uint8_t  NO_WINDOW   = 0xFF;        // no meaningful bits of a value yet
+
+        using Super  = struct { uint32_t magic; uint32_t storeId; uint32_t nbrOfSeries; uint32_t crc; };
+        using Header = struct { int64_t firstMs; int64_t lastMs; uint32_t magic; uint32_t storeId; uint32_t firstPoint;
+                                uint16_t count; uint16_t bits; uint32_t crc; };
+        // of the encoder and decoder, after the last point
+        using State  = struct { int64_t timeMs; int64_t deltaMs; uint32_t values[MAX_SERIES];
+                                uint8_t leading[MAX_SERIES]; uint8_t trailing[MAX_SERIES]; uint32_t pos; };
+
+        static const uint32_t PAYLOAD_BITS = 8 * (BlockDevice::BLOCK_SIZE - sizeof(Header));
+
+        BlockDevice *_dev         = nullptr;
+        uint32_t     _storeId     = 0;
+        int          _nbrOfSeries = 0;
+        uint32_t     _head        = FIRST_BLOCK;    // block being filled
+        uint32_t     _nbrOfPoints = 0;
+        uint32_t     _blocksRead  = 0;              // by the last query
+        bool         _dirty       = false;          // head block not flushed
+        Header       _hdr         = {};             // of the head block, count 0 if empty
+        State        _state;
+        uint8_t      _block[BlockDevice::BLOCK_SIZE];  // head block
+        uint8_t      _read[BlockDevice::BLOCK_SIZE];   // block of a query
+
+        void         _start(int64_t timeMs, const float values[]);
+        bool         _encode(int64_t timeMs, const float values[]);
+        void         _decode(const uint8_t *payload, State &s, float values[], bool first);
+        bool         _put(uint32_t value, uint32_t n);
+        static uint32_t _get(const uint8_t *payload, uint32_t &pos, uint32_t n);
+        bool         _scan(const uint8_t *block, int64_t fromMs, int64_t toMs, PointHandler handler, void *ctx,
+                           uint32_t &n, State *end=nullptr);
+        bool         _readBlock(uint32_t lba);
+        bool         _writeHead();
+        static uint32_t _crc(const uint8_t *block);
+};
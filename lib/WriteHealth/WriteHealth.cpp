@@ -0,0 +1,168 @@
+#include <cmath>
+#include <cstring>
+#include "WriteHealth.hpp"
+
+void WriteHealth::init(uint32_t windowSize, float degradedBelow)
+{
+    memset(_reference, 0, sizeof(_reference));
+    memset(_recent, 0, sizeof(_recent));
+    _windowSize     = windowSize < 16 ? 16 : windowSize;
+    _degradedBelow  = degradedBelow;
+    _referenceCount = 0;
+    _ref            = {};
+    _hasReference   = false;
+    _recentCount    = 0;
+    _windowCount    = 0;
+    _nbrOfWindows   = 0;
+    _nbrOfSamples   = 0;
+    _health         = 1.0f;
+    _trend          = 0.0f;
+    _degraded       = false;
+}
+
+/**
+ * Count a write latency in microseconds
+*/
+void WriteHealth::add(uint32_t us)
+{
+    int b = bucket(us);
+
+    _recent[b]++;
+    _recentCount++;
+    if (! _hasReference)
+    {
+        _reference[b]++;
+        if (++_referenceCount >= REFERENCE_WINDOWS * _windowSize)
+        {
+            _ref = { _quantile(_reference, _referenceCount, 0.5f), _quantile(_reference, _referenceCount, 0.99f),
+                     _quantile(_reference, _referenceCount, 0.999f) };
+            _hasReference = true;
+        }
+    }
+    _nbrOfSamples++;
+    if (++_windowCount >= _windowSize) _endWindow();
+}
+
+/**
+ * Quantile (0..1) of the recent latencies
+*/
+uint32_t WriteHealth::getQuantile(float q) { return _quantile(_recent, _recentCount, q); }
+
+/**
+ * Quantiles of the latencies of the first writes, returns
+ * false while the reference is not complete yet
+*/
+bool WriteHealth::getReference(HealthReference &ref)
+{
+    ref = _ref;
+    return _hasReference;
+}
+
+/**
+ * Use the reference of the device measured before, e.g. before the
+ * reboot, instead of taking the next writes as reference
+*/
+void WriteHealth::setReference(const HealthReference &ref)
+{
+    _ref          = ref;
+    _hasReference = true;
+}
+
+/**
+ * 1.0 for a healthy device down to 0.0, updated at the end of each window
+*/
+float WriteHealth::getHealth() { return _health; }
+
+/**
+ * Growth of the recent 99% quantile in octaves per window
+*/
+float WriteHealth::getTrend() { return _trend; }
+
+bool WriteHealth::isDegraded() { return _degraded; }
+
+uint32_t WriteHealth::getNbrOfSamples() { return _nbrOfSamples; }
+
+/**
+ * Bucket of a latency: 0..3 hold 0..3 us, above there are
+ * 4 buckets per octave selected by the 2 bits after the leading one
+*/
+int WriteHealth::bucket(uint32_t us)
+{
+    if (us < 4) return us;
+    int e = 31 - __builtin_clz(us);
+    return (e - 1) * 4 + ((us >> (e - 2)) & 3);
+}
+
+/**
+ * Mid value of a bucket in microseconds
+*/
+uint32_t WriteHealth::bucketValue(int bucket)
+{
+    if (bucket < 4) return bucket;
+    int e = bucket / 4 + 1;
+    uint32_t width = 1U << (e - 2);
+    return (4 + bucket % 4) * width + width / 2;
+}
+
+/**
+ * Judge the health: the recent 99% quantile above the 99.9% quantile
+ * of the reference (the rare spikes of the new device) and, if it is
+ * above, its rise over the last windows, both in octaves. 4 octaves
+ * together bring the health to 0.
+*/
+void WriteHealth::_endWindow()
+{
+    float p99 = log2f(_quantile(_recent, _recentCount, 0.99f) + 1.0f);
+
+    _windowCount = 0;
+    _p99[_nbrOfWindows % WINDOWS] = p99;
+    _nbrOfWindows++;
+
+    uint32_t n = _nbrOfWindows < WINDOWS ? _nbrOfWindows : WINDOWS;
+    if (n >= 3)
+    {
+        // least squares slope over the windows, oldest first
+        float sx = 0, sy = 0, sxx = 0, sxy = 0;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            float y = _p99[(_nbrOfWindows - n + i) % WINDOWS];
+            sx += i; sy += y; sxx += i * i; sxy += i * y;
+        }
+        _trend = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+    }
+
+    if (_hasReference)
+    {
+        float spike = fmaxf(p99 - log2f(_ref.p999Us + 1.0f), 0.0f);
+        float rise  = spike > 0.0f ? fmaxf(_trend * WINDOWS, 0.0f) : 0.0f;   // a rise within the reference is noise
+        _health = fminf(fmaxf(1.0f - (spike + rise) / 4.0f, 0.0f), 1.0f);
+        if (_health < _degradedBelow) _degraded = true;
+        else if (_health > _degradedBelow + 0.2f) _degraded = false;
+    }
+
+    // forget slowly: the recent histogram covers the last 8 to 16 windows
+    if (_recentCount >= 2 * WINDOWS * _windowSize)
+    {
+        _recentCount = 0;
+        for (int i = 0; i < BUCKETS; i++)
+        {
+            _recent[i] /= 2;
+            _recentCount += _recent[i];
+        }
+    }
+}
+
+uint32_t WriteHealth::_quantile(const uint32_t hist[], uint32_t count, float q)
+{
+    if (count == 0) return 0;
+    uint32_t rank = static_cast<uint32_t>(ceilf(q * count));
+    uint32_t sum  = 0;
+
+    if (rank < 1) rank = 1;
+    for (int i = 0; i < BUCKETS; i++)
+    {
+        sum += hist[i];
+        if (sum >= rank) return bucketValue(i);
+    }
+    return bucketValue(BUCKETS - 1);
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+
+// latencies of the first writes of a device, see WriteHealth::getReference()
+using HealthReference = struct hlrf { uint32_t p50Us; uint32_t p99Us; uint32_t p999Us; };
+
+/**
+ * Health of a storage device judged by its write latency. SD cards
+ * usually fail gradually: wear leveling and bad block management need
+ * more and more time, the latency spikes grow long before data is lost.
+ *
+ * The latencies are counted in fixed logarithmic buckets (4 per octave,
+ * 19% wide at most), so adding a sample is a count leading zeros and an
+ * increment. There are two histograms: the reference of the first writes
+ * of the device, of which the quantiles are kept once it is complete, and
+ * the recent one, which is halved now and then and so covers the last 8
+ * to 16 windows. The reference quantiles should be stored with the device
+ * (getReference()) and restored after a reboot (setReference()), else a
+ * worn device becomes its own reference.
+ *
+ * At the end of each window of samples the 99% quantile of the recent
+ * histogram is compared with the one of the reference, and its slope
+ * over the last windows is fitted. Both in octaves lower the health from
+ * 1 (as new) towards 0. Below a threshold the device is reported as
+ * degraded, so the caller can switch to a safer mode of writing before
+ * data is lost.
+ *
+ * Example:
+ *      uint32_t t0 = micros();
+ *      file.write(buf, len);
+ *      health.add(micros() - t0);
+ *      if (health.isDegraded()) ...
+*/
+class WriteHealth
+{
+    public:
+        static const int BUCKETS = 128;
+        static const int WINDOWS = 8;     // windows of the trend fit
+
+        WriteHealth(){}
+
+        void init(uint32_t windowSize=64, float degradedBelow=0.5f);
+        void add(uint32_t us);
+        uint32_t getQuantile(float q);
+        bool getReference(HealthReference &ref);
+        void setReference(const HealthReference &ref);
+        float getHealth();
+        float getTrend();
+        bool isDegraded();
+        uint32_t getNbrOfSamples();
+
+        static int bucket(uint32_t us);
+        static uint32_t bucketValue(int bucket);
+
+    private:
+        static const uint32_t REFERENCE_WINDOWS = 16;
+
+        uint32_t    _reference[BUCKETS] = {};
+        uint32_t    _recent[BUCKETS]    = {};
+        uint32_t    _referenceCount = 0;
+        HealthReference _ref        = {};
+        bool        _hasReference   = false;
+        uint32_t    _recentCount    = 0;
+        uint32_t    _windowCount    = 0;    // samples of the current window
+        uint32_t    _windowSize     = 64;
+        float       _degradedBelow  = 0.5f;
+        float       _p99[WINDOWS]   = {};   // log2 of the recent 99% quantile at the last windows
+        uint32_t    _nbrOfWindows   = 0;
+        uint32_t    _nbrOfSamples   = 0;
+        float       _health         = 1.0f;
+        float       _trend          = 0.0f; // octaves per window
+        bool        _degraded       = false;
+
+        void        _endWindow();
+        static uint32_t _quantile(const uint32_t hist[], uint32_t count, float q);
+};
@@ -11,6 +11,40 @@
  *                - task2: Print date and time every 5 seconds to the monitor
  *                - task3: Flash SOS signals, 3 times 4 signals in a task
  *                - task4: Take a photo every 5 minutes during a set period
+ *                         and save it to the SD card. JPEG quality and framesize
+ *                         are adapted so that the card lasts for the whole schedule.
+ *                         Converged exposure settings are cached per time of day,
+ *                         so the photos need less warm-up frames and flicker less.
+ *                         The remaining flicker is damped by adjusting the exposure
+ *                         target from the running mean of the photo luminance.
+ *                         Of a burst of photos only the sharpest one is saved.
+ *                         In the dark several grayscale frames are averaged
+ *                         into one photo to reduce the noise.
+ *                         The same firing blinks the red led and logs the free
+ *                         memory (on a worker), without timers of their own.
+ *                - task5: Take an exposure bracket for HDR every hour during the day
+ *                - task6: Take a photo of a region of interest (e.g. a gate) every 10 minutes,
+ *                         its callback tells the timer to skip some firings when
+ *                         the photo could not be stored
+ *              Photos are staged in a ring on the internal flash and migrated to the
+ *              SD card in the background, so a slow or missing card does not delay them.
+ *              With RAW_LOG set they, the brackets included, are appended to a raw log
+ *              partition of the card instead, without file system (see tools/logExtract.cpp).
+ *              The inputs of the timers are recorded in RTC memory; after a crash
+ *              the recording is saved to the SD card for the replay on the host
+ *              (see tools/scheduleReplay.cpp).
+ *              An overview of the timers is logged every 10 minutes from their snapshots.
+ *              With SPEEDUP set the timers run on a faster virtual clock, e.g. to
+ *              check a week of schedules in minutes, and their statistics are printed.
+ *              Photos, brackets and failures are published on an event bus, from
+ *              which they are counted and the failures logged.
+ *              With PHOTO_PIPELINE set the photos of task4 run through a pipeline of
+ *              stages on a camera and a storage worker, so that a photo is stored
+ *              while the next one is taken.
+ *              With SENSOR_LOG set each firing of task4 also appends the light level
+ *              (exposure index of the camera), the chip temperature and the battery
+ *              voltage to a compressed time series on the SD card, of which the last
+ *              day is summarized every hour.
  * 
  * Board        ESP32-CAM with builtin red led on GPIO 33 and white flash led on GPIO 4
  * 
@@ -23,7 +57,8 @@
  *              The task executes a callback function, which is supplied by the user when 
  *              calling the task initialization. 
  * 
- * Wiring       none
+ * Wiring       optional: battery through a 1:1 voltage divider to BATTERY_PIN (SENSOR_LOG),
+ *              not on the AI-Thinker ESP32-CAM (no free ADC pin, see BATTERY_PIN)
  * 
  * Reference    https://savjee.be/blog/multitasking-esp32-arduino-freertos/    
 */
@@ -32,13 +67,69 @@
 #include <soc/rtc_cntl_reg.h>	// bypass brownout problems (not activated in setup)
 #include <WiFi.h>
 #include <time.h>
+#include <esp_camera.h>
+#include <esp_timer.h>
+#include <FS.h>
+#include <SD_MMC.h>
+#include <img_converters.h>
 #include "StartStopTimer.hpp"
+#include "StorageBudget.hpp"
+#include "ExposureCache.hpp"
+#include "JpegScan.hpp"
+#include "Deflicker.hpp"
+#include "Sharpness.hpp"
+#include "FrameStack.hpp"
+#include "ExposureBracket.hpp"
+#include "RoiCapture.hpp"
+#include "SeqAllocator.hpp"
+#include "TieredStore.hpp"
+#include "BlockLog.hpp"
+#include "SdRawCard.hpp"
+#include "ScheduleRecorder.hpp"
+#include "StagePipeline.hpp"
+#include "EventBus.hpp"
+#include "Ov2640Exposure.hpp"
+#include "TimeSeries.hpp"
+#include "FileBlocks.hpp"
 
 const int LED_BUILTIN = 33; // GPIO of the red led
 const int FLASH_LED   = 4;  // GPIO of the white flash led
 const char NTP_SERVER_POOL[] = "ch.pool.ntp.org";
 const char TIME_ZONE[]       = "MEZ-1MESZ-2,M3.5.0/02:00:00,M10.5.0/03:00:00";
 const char HOST_NAME[]       = "ESP-CAM_TASK";
+const uint64_t SD_RESERVE    = 64 * 1024 * 1024; // bytes kept free on the SD card
+const bool RAW_LOG           = false;            // photos to the raw log partition instead of FAT files
+const bool RECORD_SCHEDULE   = true;             // record the timer inputs for tools/scheduleReplay.cpp
+const uint32_t SPEEDUP       = 1;                // e.g. 1000 runs the schedules 1000 times faster (acceptance test)
+const bool PHOTO_PIPELINE    = true;             // task4 captures and stores its photos in overlapping stages
+const bool SENSOR_LOG        = true;             // light, temperature and battery with each firing of task4
+const uint32_t SENSOR_LOG_BLOCKS = 2048;         // 1 MB file, years of readings every 5 minutes
+// -1: no battery reading (logged as 0). The AI-Thinker ESP32-CAM has no free ADC pin: GPIO 2, 12..15
+// are lines of the SD slot with pull-ups, also in 1-bit mode (GPIO 13 is DAT3), which bias a divider
+// and put the battery on the card; 32..39 are camera and red led. On other boards use ADC1 (GPIO 32..39).
+const int BATTERY_PIN        = -1;
+const float BATTERY_DIVIDER  = 2.0f;             // battery voltage / voltage at the pin
+const int GATE_BACKOFF       = 6;                // gate photos skipped when one could not be stored
+const framesize_t FRAMESIZE  = FRAMESIZE_UXGA;   // largest framesize used for the photos
+const int JPEG_QUALITY       = 12;               // initial JPEG quality (0..63, lower is better)
+const int AEW_NOMINAL        = 0x3E;             // OV2640 AE window at ae_level 0
+const int AEB_NOMINAL        = 0x38;
+const int BURST_SIZE         = 3;                // photos per firing, the sharpest is saved
+const int SCORE_SCALE        = 4;                // frames are scored at 1/4 of their size
+const int NIGHT_LIGHT_LEVEL  = 6;                // exposure cache light level considered night
+const int STACK_SIZE         = 8;                // grayscale frames averaged at night
+const framesize_t NIGHT_FRAMESIZE = FRAMESIZE_SVGA;
+const float BRACKET_EV[]     = { -2.0f, 0.0f, 2.0f }; // EV offsets of the HDR bracket
+const int GATE_ROI[]         = { 800, 400, 640, 480 }; // x, y, w, h in pixels of the UXGA frame
+
+
+// Events of the tasks on the event bus
+enum AppEvent { EV_PHOTO, EV_GATE_PHOTO, EV_BRACKET, EV_CAPTURE_FAILED, EV_STORE_FAILED, NBR_OF_EVENTS };
+const char *EVENT_NAMES[]    = { "photo", "gate photo", "bracket", "capture failed", "store failed" };
+
+// Series of the sensor log
+enum Sensor { SENSOR_EXPOSURE, SENSOR_TEMPERATURE, SENSOR_BATTERY, NBR_OF_SENSORS };
+const char *SENSOR_NAMES[]   = { "exposure index", "temperature [C]", "battery [V]" };
 
 
 // WiFi credentials 
@@ -49,20 +140,85 @@ const char PASSWORD[] = "your password";
 void initLeds();
 void initWiFi(const char hostname[], const char ssid[], const char password[]);
 void initRTC(const char timezone[], const char ntpserver[]);
+bool startCamera(pixformat_t format, framesize_t framesize);
+void restartCamera(pixformat_t format, framesize_t framesize);
+void initCamera();
+void initSDCard();
+void initRecorder();
+void initPhotoPipeline();
+void initEvents();
+void publishEvent(AppEvent type, int task, int64_t value=0, uint32_t arg=0);
+void countEvent(const Event &event, void *ctx);
+void logEvent(const Event &event, void *ctx);
+void printEventCounts();
+void initSensorLog();
+void logSensors();
+bool addReadings(int64_t timeMs, const float values[], void *ctx);
+void printSensorLog();
+void logMemory();
+void printTimerStats();
+void printTimers();
+void applyExposureTarget(float target);
+float sharpnessScore(camera_fb_t *fb);
+camera_fb_t *takeSharpest(int burstSize);
+bool takeStacked(int nbrOfFrames, uint8_t **jpg, size_t *jpgLen);
+bool storePhoto(const char path[], const uint8_t *buf, size_t len);
+bool storeBracket(uint32_t nbr);
+void savePhoto(uint32_t nbr, const uint8_t *buf, size_t len);
 void initTask1();
 void initTask2();
 void initTask3();
 void initTask4();
+void initTask5();
+void initTask6();
 
 void blinkLed();  // task1 callback
 void showTime();  // task2 callback
 void flashSOS();  // task3 callback
 void takePhoto(); // task4 callback
+void takeBracket(); // task5 callback
+Control takeGatePhoto(); // task6 callback, tells its timer to back off
+
+bool captureStage(PipelineJob &job);   // stages of the photo pipeline
+bool deflickerStage(PipelineJob &job);
+bool storeStage(PipelineJob &job);
+bool releaseStage(PipelineJob &job);
 
 StartStopTimer task1;
 StartStopTimer task2;
 StartStopTimer task3;
 StartStopTimer task4;
+StartStopTimer task5;
+StartStopTimer task6;
+StorageBudget  budget;
+ExposureCache  exposure;
+Deflicker      deflicker;
+FrameStack     nightStack;
+ExposureBracket bracket;
+RoiCapture     gate;
+SeqAllocator   photoSeq;        // file numbers of all photos, persistent across reboots
+TieredStore    tiered;          // flash staging ring in front of the SD card
+SdRawCard      rawCard;         // raw log partition of the SD card (RAW_LOG)
+BlockLog       rawLog;
+SemaphoreHandle_t rawLogMutex;  // task4 and task6 append to the raw log
+SemaphoreHandle_t cameraMutex;  // task4, task5 and task6 share the camera
+JpegScan       lumaScan;        // 8 KB of tables, too big for the stacks of the tasks (under cameraMutex)
+ScheduleRecorder scheduleRecorder;
+RTC_NOINIT_ATTR uint32_t scheduleLog[1024];   // 4 KB of RTC memory, kept across a crash or reset
+StagePipeline  photoPipeline;   // capture, deflicker and store of the photos of task4
+
+EventBus       events;          // photos and failures of the tasks to the counters and the log
+uint32_t       eventCounts[NBR_OF_EVENTS];
+
+FileBlocks     sensorFile;      // blocks of the sensor log in a file on the SD card
+TimeSeries     sensorLog;       // appended and queried by the worker of the timers only
+
+// context of a photo in the pipeline
+using PhotoJob = struct phjb { uint32_t nbr; uint8_t *jpg; size_t len; bool stacked; };
+
+// of the readings in a query of the sensor log
+using SensorSummary = struct snsm { uint32_t n; float min[NBR_OF_SENSORS]; float max[NBR_OF_SENSORS]; 
+                                    double sum[NBR_OF_SENSORS]; };
 
 
 void setup() 
@@ -72,10 +228,21 @@ void setup()
   initLeds();
   initWiFi(HOST_NAME, SSID, PASSWORD);
   initRTC(TIME_ZONE, NTP_SERVER_POOL);
+  initCamera();
+  initSDCard();
+  initRecorder();
+  initEvents();
+  if (SPEEDUP > 1) StartStopTimer::setSpeedup(SPEEDUP);
+  photoSeq.init("photos");
+  if (! RAW_LOG) tiered.init(SD_MMC);
+  initSensorLog();
+  StartStopTimer::startWorkers(1, 8192);  // file system access of logSensors
   initTask1();
   initTask2();
   initTask3();
   initTask4();
+  initTask5();
+  initTask6();
   //log_i("stack 1 %d", uxTaskGetStackHighWaterMark(task1.getTaskHandle()));
   //log_i("stack 2 %d", uxTaskGetStackHighWaterMark(task2.getTaskHandle()));
   //log_i("stack 3 %d", uxTaskGetStackHighWaterMark(task3.getTaskHandle()));
@@ -86,7 +253,55 @@ void setup()
 
 void loop() 
 {
+  static uint32_t seconds = 0;
+
   vTaskDelay(pdMS_TO_TICKS(1000)); 
+  if (SPEEDUP > 1 && ++seconds % 10 == 0) printTimerStats();
+  if (SPEEDUP == 1 && ++seconds % 600 == 0) printTimers();
+}
+
+
+/**
+ * Overview of all timers from their snapshots, taken without
+ * stopping them, e.g. every 10 minutes
+*/
+void printTimers()
+{
+  TimerSnapshot snaps[8];
+  int           n = StartStopTimer::getSnapshots(snaps, 8);
+
+  for (int i = 0; i < n; i++)
+  {
+    TimerSnapshot &s = snaps[i];
+    time_t t = s.nextFireMs / 1000;
+    char   buf[20] = "-";
+
+    if (s.phase != FINISHED) strftime(buf, sizeof(buf), "%F %T", localtime(&t));
+    log_i("timer %d: %s, cycle %u/%u, %u firings, %u remaining, next %s, late mean %lld ms",
+          s.id, StartStopTimer::phaseName(s.phase), min(s.cycle + 1, s.nbrOfCycles), s.nbrOfCycles, s.firings, s.remaining, buf,
+          s.stats.firings ? s.stats.sumLateMs / s.stats.firings : 0);
+  }
+}
+
+
+/**
+ * Acceptance report of the timers on the accelerated timeline: where
+ * the callbacks take longer than the interval (overruns) and how many
+ * firings did not fit into the windows (lost)
+*/
+void printTimerStats()
+{
+  time_t t = StartStopTimer::getNowMs() / 1000;
+  char   buf[20];
+
+  strftime(buf, sizeof(buf), "%F %H:%M", localtime(&t));
+  log_i("virtual time %s, speedup %u, resolution %u ms", buf, SPEEDUP, StartStopTimer::getResolutionMs());
+  task1.printStats("task1");
+  task2.printStats("task2");
+  task3.printStats("task3");
+  task4.printStats("task4");
+  task5.printStats("task5");
+  task6.printStats("task6");
 }
 
 
@@ -137,6 +352,437 @@ void initRTC(const char timezone[], const char ntpserver[])
 }
 
 
+/**
+ * Initialize the camera driver for the given pixel format and framesize
+*/
+bool startCamera(pixformat_t format, framesize_t framesize)
+{
+  camera_config_t config;
+
+  // Camera pins of the AI-Thinker ESP32-CAM
+  config.pin_pwdn     = 32;
+  config.pin_reset    = -1;
+  config.pin_xclk     = 0;
+  config.pin_sscb_sda = 26;
+  config.pin_sscb_scl = 27;
+  config.pin_d7       = 35;
+  config.pin_d6       = 34;
+  config.pin_d5       = 39;
+  config.pin_d4       = 36;
+  config.pin_d3       = 21;
+  config.pin_d2       = 19;
+  config.pin_d1       = 18;
+  config.pin_d0       = 5;
+  config.pin_vsync    = 25;
+  config.pin_href     = 23;
+  config.pin_pclk     = 22;
+  config.xclk_freq_hz = 20000000;
+  config.ledc_timer   = LEDC_TIMER_0;
+  config.ledc_channel = LEDC_CHANNEL_0;
+  config.pixel_format = format;
+  config.frame_size   = framesize;
+  config.jpeg_quality = JPEG_QUALITY;
+  config.fb_count     = 2;  // hold the sharpest frame while the next is captured
+  config.fb_location  = CAMERA_FB_IN_PSRAM;
+  config.grab_mode    = CAMERA_GRAB_LATEST;
+
+  return esp_camera_init(&config) == ESP_OK;
+}
+
+
+/**
+ * Switch the camera to another pixel format. The sensor instance
+ * changes, so the controllers are handed the new one and the JPEG
+ * settings are restored when switching back to JPEG.
+*/
+void restartCamera(pixformat_t format, framesize_t framesize)
+{
+  esp_camera_deinit();
+  if (! startCamera(format, framesize))
+  {
+    Serial.println("Camera restart failed. Restarting ESP32 in 5 seconds");
+    delay(5000);
+    ESP.restart();
+  }
+  exposure.setSensor(esp_camera_sensor_get());
+  if (format == PIXFORMAT_JPEG)
+  {
+    budget.setSensor(esp_camera_sensor_get());
+    applyExposureTarget(deflicker.getTarget());
+  }
+}
+
+
+/**
+ * Initialize the camera and let the storage budget
+ * controller take over JPEG quality and framesize
+*/
+void initCamera()
+{
+  if (! startCamera(PIXFORMAT_JPEG, FRAMESIZE))
+  {
+    Serial.println("Camera init failed. Restarting ESP32 in 5 seconds");
+    delay(5000);
+    ESP.restart();
+  }
+  budget.setReserve(SD_RESERVE);
+  budget.init(esp_camera_sensor_get(), FRAMESIZE, JPEG_QUALITY);
+  exposure.init(esp_camera_sensor_get());
+  deflicker.init();
+  bracket.init(BRACKET_EV, sizeof(BRACKET_EV) / sizeof(BRACKET_EV[0]));
+  gate.init(GATE_ROI[0], GATE_ROI[1], GATE_ROI[2], GATE_ROI[3]);
+  cameraMutex = xSemaphoreCreateMutex();
+  log_i("==> done");
+}
+
+
+/**
+ * Scale the AE target window of the OV2640 relative to its nominal
+ * position, so the next photo is exposed brighter or darker
+*/
+void applyExposureTarget(float target)
+{
+  sensor_t *s = esp_camera_sensor_get();
+
+  s->set_reg(s, 0x124, 0xFF, constrain(lroundf(AEW_NOMINAL * target), 1, 255));
+  s->set_reg(s, 0x125, 0xFF, constrain(lroundf(AEB_NOMINAL * target), 1, 255));
+}
+
+
+/**
+ * Variance of the Laplacian of the frame decoded at reduced size
+*/
+float sharpnessScore(camera_fb_t *fb)
+{
+  static uint8_t *rgb  = nullptr;
+  static uint8_t *gray = nullptr;
+  static size_t   maxPixels = 0;
+  int    w = fb->width / SCORE_SCALE;
+  int    h = fb->height / SCORE_SCALE;
+  size_t nbrOfPixels = w * h;
+
+  if (nbrOfPixels > maxPixels)
+  {
+    free(rgb);
+    free(gray);
+    rgb  = static_cast<uint8_t *>(ps_malloc(2 * nbrOfPixels));
+    gray = static_cast<uint8_t *>(ps_malloc(nbrOfPixels));
+    maxPixels = rgb && gray ? nbrOfPixels : 0;
+  }
+  if (maxPixels == 0 || ! jpg2rgb565(fb->buf, fb->len, rgb, JPG_SCALE_4X)) return 0.0f;
+  Sharpness::rgb565ToGray(rgb, gray, nbrOfPixels);
+  return Sharpness::laplacianVariance(gray, w, h, w);
+}
+
+
+/**
+ * Take a burst of photos and return the sharpest one. The first
+ * frame is taken with the cached exposure settings, the others 
+ * follow immediately. The frame must be returned by the caller.
+*/
+camera_fb_t *takeSharpest(int burstSize)
+{
+  camera_fb_t *best = exposure.capture();
+  if (! best) return nullptr;
+
+  float bestScore = sharpnessScore(best);
+  int   bestIndex = 0;
+  for (int i = 1; i < burstSize; i++)
+  {
+    camera_fb_t *fb = esp_camera_fb_get();
+    if (! fb) break;
+    float score = sharpnessScore(fb);
+    if (score > bestScore)
+    {
+      esp_camera_fb_return(best);
+      best      = fb;
+      bestScore = score;
+      bestIndex = i;
+    }
+    else
+    {
+      esp_camera_fb_return(fb);
+    }
+  }
+  log_i("sharpest frame: %d of %d, score: %.1f", bestIndex + 1, burstSize, bestScore);
+  return best;
+}
+
+
+/**
+ * Average several grayscale frames into one JPEG to reduce the noise
+ * of night photos. The camera is switched to grayscale for the frames
+ * and back to JPEG afterwards. The JPEG must be freed by the caller.
+*/
+bool takeStacked(int nbrOfFrames, uint8_t **jpg, size_t *jpgLen)
+{
+  static uint8_t *gray = nullptr;
+  int  w = 0;
+  int  h = 0;
+  bool ok;
+
+  restartCamera(PIXFORMAT_GRAYSCALE, NIGHT_FRAMESIZE);
+  camera_fb_t *fb = exposure.capture();    // drops the frames until exposure has settled
+  if (fb && ! gray)
+  {
+    void *acc = ps_malloc(2 * ((fb->len + 3) & ~3));
+    gray = static_cast<uint8_t *>(ps_malloc(fb->len));
+    if (! gray || ! nightStack.init(acc, fb->len))
+    {
+      log_e("no memory for the night stack");
+      free(acc);
+      free(gray);
+      gray = nullptr;
+      esp_camera_fb_return(fb);
+      fb = nullptr;
+    }
+  }
+  nightStack.clear();
+  for (int i = 0; fb && i < nbrOfFrames; i++)
+  {
+    w = fb->width;
+    h = fb->height;
+    if (fb->len == nightStack.getNbrOfPixels()) nightStack.add(fb->buf);
+    esp_camera_fb_return(fb);
+    fb = i + 1 < nbrOfFrames ? esp_camera_fb_get() : nullptr;
+  }
+  if (fb) esp_camera_fb_return(fb);
+
+  ok = nightStack.getCount() > 0;
+  if (ok)
+  {
+    nightStack.average(gray);
+    ok = fmt2jpg(gray, nightStack.getNbrOfPixels(), w, h, PIXFORMAT_GRAYSCALE, 100 - 2 * budget.getQuality(), jpg, jpgLen);
+  }
+  log_i("stacked %d frames of %dx%d", nightStack.getCount(), w, h);
+  restartCamera(PIXFORMAT_JPEG, FRAMESIZE);
+  return ok;
+}
+
+
+/**
+ * Stage the photo for the SD card and tell the storage budget controller
+ * how big it was, so that quality and framesize of the next photo can
+ * be adapted to the remaining capacity and firings.
+*/
+void savePhoto(uint32_t nbr, const uint8_t *buf, size_t len)
+{
+  char path[32];
+
+  snprintf(path, sizeof(path), "/photo%05u.jpg", nbr);
+  bool saved = storePhoto(path, buf, len);
+  publishEvent(saved ? EV_PHOTO : EV_STORE_FAILED, 4, len, nbr);
+  if (RAW_LOG && saved)
+  {
+    budget.update(len, rawLog.getFree(), task4.getRemainingFirings());
+  }
+  else if (! saved || SD_MMC.cardType() == CARD_NONE)
+  {
+    Serial.printf("Photo taken: %u, %u bytes, %s\n", nbr, len, saved ? "staged" : "not saved");
+    return;
+  }
+  else
+  {
+    budget.update(len, SD_MMC.totalBytes() - SD_MMC.usedBytes(), task4.getRemainingFirings());
+  }
+  Serial.printf("Photo taken: %u, %u bytes, budget %u bytes, quality %d\n", 
+                nbr, len, budget.getBudget(), budget.getQuality());
+}
+
+
+/**
+ * Write a photo to the raw log or stage it for the SD card
+*/
+bool storePhoto(const char path[], const uint8_t *buf, size_t len)
+{
+  if (! RAW_LOG) return tiered.store(path, buf, len);
+
+  xSemaphoreTake(rawLogMutex, portMAX_DELAY);
+  bool ok = rawLog.append(path, buf, len);
+  xSemaphoreGive(rawLogMutex);
+  return ok;
+}
+
+
+/**
+ * Mount the SD card in 1-bit mode, so GPIO 4 
+ * remains free for the white flash led.
+ * With RAW_LOG the log partition is opened instead.
+*/
+void initSDCard()
+{
+  if (RAW_LOG)
+  {
+    rawLogMutex = xSemaphoreCreateMutex();
+    if (! rawCard.begin() || (! rawLog.mount(&rawCard) && ! rawLog.format(&rawCard)))
+    {
+      Serial.println("No raw log partition, photos are not saved");
+      return;
+    }
+    log_i("raw log: %u photos, %llu MB free", rawLog.getNbrOfRecords(), rawLog.getFree() / (1024 * 1024));
+    log_i("==> done");
+    return;
+  }
+  if (! SD_MMC.begin("/sdcard", true) || SD_MMC.cardType() == CARD_NONE)
+  {
+    Serial.println("No SD card mounted, photos are not saved");
+    return;
+  }
+  log_i("SD card: %llu MB free", (SD_MMC.totalBytes() - SD_MMC.usedBytes()) / (1024 * 1024));
+  log_i("==> done");
+}
+
+
+/**
+ * Record the inputs of the timers (clock readings, API calls, clock
+ * steps) into RTC memory, which survives a crash or watchdog reset.
+ * The recording of the previous run is saved to the SD card first,
+ * for the replay on the host with tools/scheduleReplay.cpp.
+*/
+void initRecorder()
+{
+  if (! RECORD_SCHEDULE) return;
+  if (scheduleRecorder.load(scheduleLog, sizeof(scheduleLog)) && ! RAW_LOG && SD_MMC.cardType() != CARD_NONE)
+  {
+    File file = SD_MMC.open("/schedule.rec", FILE_WRITE);
+    if (file)
+    {
+      file.write(static_cast<const uint8_t *>(scheduleRecorder.data()), scheduleRecorder.size());
+      file.close();
+      log_i("recording of the previous run saved: %u records", scheduleRecorder.getNbrOfRecords());
+    }
+  }
+  scheduleRecorder.init(scheduleLog, sizeof(scheduleLog));
+  StartStopTimer::setRecorder(&scheduleRecorder);
+  log_i("==> done");
+}
+
+
+/**
+ * Subscribe the counters to all events and the log to the failures.
+ * The bus is sealed before the tasks start publishing.
+*/
+void initEvents()
+{
+  events.subscribe((1 << NBR_OF_EVENTS) - 1, countEvent, eventCounts);
+  events.subscribe((1 << EV_CAPTURE_FAILED) | (1 << EV_STORE_FAILED), logEvent);
+  events.seal();
+  log_i("==> done");
+}
+
+
+void publishEvent(AppEvent type, int task, int64_t value, uint32_t arg)
+{
+  events.publish(type, task, value, arg, StartStopTimer::getNowMs());
+}
+
+
+/**
+ * Called by the publishing task, several tasks publish at once
+*/
+void countEvent(const Event &event, void *ctx)
+{
+  __atomic_add_fetch(&static_cast<uint32_t *>(ctx)[event.type], 1, __ATOMIC_RELAXED);
+}
+
+
+void logEvent(const Event &event, void *)
+{
+  log_e("task%u: %s (event %u)", event.source, EVENT_NAMES[event.type], event.seq);
+}
+
+
+void printEventCounts()
+{
+  log_i("events: %u photos, %u gate photos, %u brackets, %u capture failed, %u store failed",
+        eventCounts[EV_PHOTO], eventCounts[EV_GATE_PHOTO], eventCounts[EV_BRACKET],
+        eventCounts[EV_CAPTURE_FAILED], eventCounts[EV_STORE_FAILED]);
+}
+
+
+/**
+ * Open the sensor log in its file on the SD card, a new one
+ * if there is none or it has other series
+*/
+void initSensorLog()
+{
+  if (! SENSOR_LOG || RAW_LOG || SD_MMC.cardType() == CARD_NONE) return;
+  if (! sensorFile.begin(SD_MMC, "/sensors.ts", SENSOR_LOG_BLOCKS)
+      || ((! sensorLog.mount(&sensorFile) || sensorLog.getNbrOfSeries() != NBR_OF_SENSORS)
+          && ! sensorLog.format(&sensorFile, NBR_OF_SENSORS)))
+  {
+    log_e("no sensor log");
+    return;
+  }
+  log_i("sensor log: %u readings, %u blocks free", sensorLog.getNbrOfPoints(), sensorLog.getFreeBlocks());
+  log_i("==> done");
+}
+
+
+/**
+ * Append the readings of the sensors to the log, an action of task4
+ * on the worker. The readings are rounded to their resolution, so an
+ * unchanged reading takes a single bit. The block is flushed each time,
+ * so a reset loses nothing.
+*/
+void logSensors()
+{
+  float values[NBR_OF_SENSORS];
+
+  if (sensorLog.getNbrOfSeries() != NBR_OF_SENSORS) return;
+  xSemaphoreTake(cameraMutex, portMAX_DELAY);
+  sensor_t *sensor = esp_camera_sensor_get();
+  values[SENSOR_EXPOSURE] = sensor ? roundf(Ov2640Exposure::exposureIndex(Ov2640Exposure::readAec(sensor),
+                                                                          Ov2640Exposure::readGain(sensor))) : 0.0f;
+  xSemaphoreGive(cameraMutex);
+  values[SENSOR_TEMPERATURE] = roundf(10 * temperatureRead()) / 10;
+  values[SENSOR_BATTERY]     = BATTERY_PIN < 0 ? 0.0f : roundf(analogReadMilliVolts(BATTERY_PIN) * BATTERY_DIVIDER) / 1000;
+  if (! sensorLog.append(StartStopTimer::getNowMs(), values) || ! sensorLog.flush())
+  {
+    log_e("sensor log full or not written");
+    return;
+  }
+  if (sensorLog.getNbrOfPoints() % 12 == 0) printSensorLog();
+}
+
+
+bool addReadings(int64_t timeMs, const float values[], void *ctx)
+{
+  SensorSummary *summary = static_cast<SensorSummary *>(ctx);
+
+  for (int i = 0; i < NBR_OF_SENSORS; i++)
+  {
+    summary->min[i]  = summary->n ? min(summary->min[i], values[i]) : values[i];
+    summary->max[i]  = summary->n ? max(summary->max[i], values[i]) : values[i];
+    summary->sum[i] += values[i];
+  }
+  summary->n++;
+  return true;
+}
+
+
+/**
+ * Min, mean and max of the readings of the last day, only
+ * the blocks of the day are read and decompressed
+*/
+void printSensorLog()
+{
+  SensorSummary summary = {};
+  int64_t       nowMs   = StartStopTimer::getNowMs();
+  int64_t       t0      = esp_timer_get_time();
+
+  sensorLog.query(nowMs - 86400000LL, nowMs, addReadings, &summary);
+  log_i("sensor log: %u readings, ratio %.1f, %u blocks free, last day %u readings from %u blocks in %lld us",
+        sensorLog.getNbrOfPoints(), sensorLog.getCompressionRatio(), sensorLog.getFreeBlocks(), summary.n,
+        sensorLog.getBlocksRead(), esp_timer_get_time() - t0);
+  for (int i = 0; i < NBR_OF_SENSORS && summary.n; i++)
+  {
+    log_i("  %-16s min %.3f, mean %.3f, max %.3f", SENSOR_NAMES[i], summary.min[i], summary.sum[i] / summary.n,
+          summary.max[i]);
+  }
+}
+
+
 /**
  * Blink the red builtin led every second during 10 minutes
  * The on-time of the led is defined in the taskfunction blinkLed
@@ -200,12 +846,61 @@ void initTask3()
 */
 void initTask4()
 {
+  if (PHOTO_PIPELINE) initPhotoPipeline();
   task4.setCycleStartStop("2023-06-13 22:40", "2023-06-14 06:15", "00:05"); 
-  task4.init(takePhoto, 2000);
+  task4.init(takePhoto, 8192); // file system access needs a bigger stack
+  task4.addAction(blinkLed);        // in phase with the photo
+  task4.addAction(logMemory, true); // on a worker, the timer goes on
+  if (SENSOR_LOG) task4.addAction(logSensors, true);
   task4.resume(); 
 }
 
 
+/**
+ * The photos of task4 as a graph of stages: the camera worker captures
+ * and corrects the exposure, the storage worker stores the photo and
+ * frees it. Two photos can be in flight, e.g. one is written to the
+ * card while the next is captured. capture copies the frame out of the
+ * frame buffer of the camera, so the camera is free for the next photo.
+ *
+ *      capture --+--> deflicker --+--> release
+ *                +--> store ------+
+*/
+void initPhotoPipeline()
+{
+  if (! photoPipeline.init(2, sizeof(PhotoJob))) return;
+  int camera    = photoPipeline.addWorker("camera", 8192, 2);
+  int storage   = photoPipeline.addWorker("storage", 8192, 1);
+  int capture   = photoPipeline.addStage("capture", captureStage, camera);
+  int deflicker = photoPipeline.addStage("deflicker", deflickerStage, camera, 1 << capture);
+  int store     = photoPipeline.addStage("store", storeStage, storage, 1 << capture);
+  photoPipeline.addStage("release", releaseStage, storage, (1 << deflicker) | (1 << store), true);
+  photoPipeline.begin();
+}
+
+
+/**
+ * Take an exposure bracket every hour from 10:00 until 16:00
+*/
+void initTask5()
+{
+  task5.setCycleStartStop("2023-06-14 10:00", "2023-06-14 16:00", "01:00"); 
+  task5.init(takeBracket, 8192);
+  task5.resume(); 
+}
+
+
+/**
+ * Take a photo of the gate every 10 minutes from 07:00 until 19:00
+*/
+void initTask6()
+{
+  task6.setCycleStartStop("2023-06-14 07:00", "2023-06-14 19:00", "00:10"); 
+  task6.init(takeGatePhoto, 8192);
+  task6.resume(); 
+}
+
+
 void blinkLed()
 {
   digitalWrite(LED_BUILTIN, LOW);  // Turn the LED on
@@ -214,6 +909,13 @@ void blinkLed()
 }
 
 
+void logMemory()
+{
+  log_i("free heap: %u, largest block: %u, free psram: %u", 
+        ESP.getFreeHeap(), ESP.getMaxAllocHeap(), ESP.getFreePsram());
+}
+
+
 void showTime()
 {
   tm   rtcTime;
@@ -254,8 +956,213 @@ void flashSOS()
 }
 
 
+/**
+ * Take a burst of photos and save the sharpest one, or at night a 
+ * stack of averaged grayscale frames. The luminance of the photo 
+ * is used to correct the exposure of the next photo against flicker.
+*/
 void takePhoto()
 {
-  static int cntPhoto = 0;
-  Serial.printf("Photo taken: %d\n", ++cntPhoto);
+  if (PHOTO_PIPELINE)
+  {
+    if (! photoPipeline.fire()) log_w("photo dropped, the pipeline is busy");
+    return;
+  }
+
+  uint32_t nbr = photoSeq.next();
+  uint8_t *jpg = nullptr;
+  size_t   len = 0;
+
+  xSemaphoreTake(cameraMutex, portMAX_DELAY);
+  if (exposure.getLightLevel() >= NIGHT_LIGHT_LEVEL && takeStacked(STACK_SIZE, &jpg, &len))
+  {
+    xSemaphoreGive(cameraMutex);
+    savePhoto(nbr, jpg, len);
+    free(jpg);
+    return;
+  }
+
+  camera_fb_t *fb = takeSharpest(BURST_SIZE);
+  if (! fb)
+  {
+    xSemaphoreGive(cameraMutex);
+    publishEvent(EV_CAPTURE_FAILED, 4);
+    return;
+  }
+  savePhoto(nbr, fb->buf, fb->len);
+
+  float luma;
+  if (lumaScan.parse(fb->buf, fb->len) && lumaScan.meanLuma(luma))
+  {
+    applyExposureTarget(deflicker.update(luma));
+    log_i("luma: %.1f, mean: %.1f, target: %.3f", luma, deflicker.getMean(), deflicker.getTarget());
+  }
+  esp_camera_fb_return(fb);
+  xSemaphoreGive(cameraMutex);
+  if (nbr % 10 == 0)
+  {
+    exposure.printStats();
+    photoSeq.printStats();
+    if (! RAW_LOG) tiered.printStats();
+    printEventCounts();
+  }
+}
+
+
+/**
+ * Take an exposure bracket and save it as a group of photos
+ * with a shared metadata file, with RAW_LOG to the raw log
+*/
+void takeBracket()
+{
+  xSemaphoreTake(cameraMutex, portMAX_DELAY);
+  bool ok = bracket.capture(esp_camera_sensor_get());
+  xSemaphoreGive(cameraMutex);
+  if (! ok)
+  {
+    publishEvent(EV_CAPTURE_FAILED, 5, bracket.getNbrOfFrames(), bracket.getMaxGap());
+    return;
+  }
+  uint32_t nbr    = photoSeq.next();
+  bool     stored = RAW_LOG ? storeBracket(nbr) : SD_MMC.cardType() != CARD_NONE && bracket.save(SD_MMC, nbr);
+  publishEvent(stored ? EV_BRACKET : EV_STORE_FAILED, 5, bracket.getNbrOfFrames(), bracket.getMaxGap());
+  Serial.printf("Bracket taken: %d frames, max gap %u us, %s\n", bracket.getNbrOfFrames(), bracket.getMaxGap(),
+                stored ? "saved" : "not saved");
+}
+
+
+/**
+ * Append the frames and the metadata of the bracket to the raw log,
+ * named as bracket.save() names the files
+*/
+bool storeBracket(uint32_t nbr)
+{
+  char path[32];
+  char meta[ExposureBracket::META_SIZE];
+  bool ok = true;
+
+  for (int i = 0; i < bracket.getNbrOfFrames(); i++)
+  {
+    snprintf(path, sizeof(path), "/brk%05u_%d.jpg", nbr, i);
+    ok &= storePhoto(path, bracket.getBuf(i), bracket.getLen(i));
+  }
+  snprintf(path, sizeof(path), "/brk%05u.txt", nbr);
+  size_t len = bracket.printMeta(meta, sizeof(meta), nbr);
+  return storePhoto(path, reinterpret_cast<uint8_t *>(meta), len) && ok;
+}
+
+
+/**
+ * Take a photo of the region of interest only. The sensor window
+ * cuts readout time and JPEG size, else the frame is cropped.
+ * If the photo cannot be stored (card full or missing), the timer
+ * skips the next GATE_BACKOFF firings instead of failing again.
+*/
+Control takeGatePhoto()
+{
+  char path[32];
+
+  xSemaphoreTake(cameraMutex, portMAX_DELAY);
+  bool ok = gate.capture(esp_camera_sensor_get(), budget.getFramesize());
+  xSemaphoreGive(cameraMutex);
+  if (! ok) 
+  {
+    publishEvent(EV_CAPTURE_FAILED, 6);
+    return StartStopTimer::control(StartStopTimer::CONTINUE);
+  }
+  uint32_t nbr = photoSeq.next();
+  snprintf(path, sizeof(path), "/roi%05u.jpg", nbr);
+  bool stored = storePhoto(path, gate.getBuf(), gate.getLen());
+  publishEvent(stored ? EV_GATE_PHOTO : EV_STORE_FAILED, 6, gate.getLen(), nbr);
+  if (! stored)
+  {
+    log_w("gate photo not stored, skipping %d firings", GATE_BACKOFF);
+    return StartStopTimer::control(StartStopTimer::SKIP, GATE_BACKOFF);
+  }
+  gate.printStats();
+  return StartStopTimer::control(StartStopTimer::CONTINUE);
+}
+
+
+/**
+ * Take the sharpest photo of a burst, or at night a stack of frames,
+ * and copy it out of the frame buffer
+*/
+bool captureStage(PipelineJob &job)
+{
+  PhotoJob *photo = static_cast<PhotoJob *>(job.ctx);
+
+  photo->nbr = photoSeq.next();
+  xSemaphoreTake(cameraMutex, portMAX_DELAY);
+  if (exposure.getLightLevel() >= NIGHT_LIGHT_LEVEL && takeStacked(STACK_SIZE, &photo->jpg, &photo->len))
+  {
+    xSemaphoreGive(cameraMutex);
+    photo->stacked = true;
+    return true;
+  }
+  camera_fb_t *fb = takeSharpest(BURST_SIZE);
+  if (fb)
+  {
+    photo->jpg = static_cast<uint8_t *>(ps_malloc(fb->len));
+    if (photo->jpg)
+    {
+      memcpy(photo->jpg, fb->buf, fb->len);
+      photo->len = fb->len;
+    }
+    esp_camera_fb_return(fb);
+  }
+  xSemaphoreGive(cameraMutex);
+  if (! photo->jpg) publishEvent(EV_CAPTURE_FAILED, 4);
+  return photo->jpg != nullptr;
+}
+
+
+/**
+ * Correct the exposure of the next photo from the luminance of this one
+*/
+bool deflickerStage(PipelineJob &job)
+{
+  PhotoJob *photo = static_cast<PhotoJob *>(job.ctx);
+  float     luma;
+
+  if (photo->stacked) return true;
+  xSemaphoreTake(cameraMutex, portMAX_DELAY);   // also for the shared scanner
+  if (! lumaScan.parse(photo->jpg, photo->len) || ! lumaScan.meanLuma(luma))
+  {
+    xSemaphoreGive(cameraMutex);
+    return true;
+  }
+  applyExposureTarget(deflicker.update(luma));
+  xSemaphoreGive(cameraMutex);
+  log_i("luma: %.1f, mean: %.1f, target: %.3f", luma, deflicker.getMean(), deflicker.getTarget());
+  return true;
+}
+
+
+bool storeStage(PipelineJob &job)
+{
+  PhotoJob *photo = static_cast<PhotoJob *>(job.ctx);
+
+  savePhoto(photo->nbr, photo->jpg, photo->len);
+  return true;
+}
+
+
+/**
+ * Free the photo, runs also if the capture failed
+*/
+bool releaseStage(PipelineJob &job)
+{
+  PhotoJob *photo = static_cast<PhotoJob *>(job.ctx);
+
+  free(photo->jpg);
+  if (photo->nbr % 10 == 0)
+  {
+    exposure.printStats();
+    photoSeq.printStats();
+    if (! RAW_LOG) tiered.printStats();
+    printEventCounts();
+    photoPipeline.printStats("photo pipeline");
+  }
+  return true;
 }
@@ -0,0 +1,83 @@
+/**
+ * Program      deflickerEval.cpp
+ * 
+ * Purpose      Host evaluation of the deflicker controller on a recorded
+ *              time-lapse sequence, e.g. the photos copied from the SD card.
+ *              The mean luminance of each photo is computed from the DC
+ *              coefficients exactly as on the ESP32-CAM. The closed loop is
+ *              simulated by scaling the recorded luminance with the exposure
+ *              target the controller has computed for that frame.
+ * 
+ * Build        pio run -e deflicker_eval
+ * 
+ * Usage        .pio/build/deflicker_eval/program [-a alpha] [-g gain] photo*.jpg
+ *              Prints one CSV line per frame and a summary (lines beginning with #)
+ *              with the flicker of the recorded and the corrected sequence.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "JpegScan.hpp"
+#include "Deflicker.hpp"
+
+static bool readFile(const char path[], std::vector<uint8_t> &data)
+{
+    FILE *f = fopen(path, "rb");
+    if (! f) return false;
+    fseek(f, 0, SEEK_END);
+    data.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    bool ok = fread(data.data(), 1, data.size(), f) == data.size();
+    fclose(f);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    float alpha = 0.2f;
+    float gain  = 0.5f;
+    int   first = 1;
+
+    while (first + 1 < argc && argv[first][0] == '-')
+    {
+        if (strcmp(argv[first], "-a") == 0) alpha = atof(argv[first + 1]);
+        else if (strcmp(argv[first], "-g") == 0) gain = atof(argv[first + 1]);
+        else break;
+        first += 2;
+    }
+    if (first >= argc)
+    {
+        fprintf(stderr, "usage: %s [-a alpha] [-g gain] photo*.jpg\n", argv[0]);
+        return 1;
+    }
+
+    Deflicker recorded;     // statistics of the sequence as recorded
+    Deflicker corrected;    // closed loop with the correction applied
+    std::vector<uint8_t> data;
+    JpegScan scan;
+    float    target = 1.0f;
+    float    luma;
+
+    recorded.init(alpha, 0.0f);
+    corrected.init(alpha, gain);
+    printf("frame,file,luma,corrected,mean,target\n");
+    for (int i = first; i < argc; i++)
+    {
+        if (! readFile(argv[i], data) || ! scan.parse(data.data(), data.size()) || ! scan.meanLuma(luma))
+        {
+            fprintf(stderr, "%s: not a baseline JPEG, skipped\n", argv[i]);
+            continue;
+        }
+        float lumaCorrected = luma * target;
+        recorded.update(luma);
+        target = corrected.update(lumaCorrected);
+        printf("%u,%s,%.2f,%.2f,%.2f,%.3f\n", recorded.getNbrOfFrames(), argv[i], luma, 
+               lumaCorrected, corrected.getMean(), target);
+    }
+    printf("# frames: %u, alpha: %.2f, gain: %.2f\n", recorded.getNbrOfFrames(), alpha, gain);
+    printf("# flicker recorded:  %.2f\n", recorded.getFlicker());
+    printf("# flicker corrected: %.2f\n", corrected.getFlicker());
+    return 0;
+}
@@ -0,0 +1,130 @@
+/**
+ * Program      logExtract.cpp
+ * 
+ * Purpose      Export the photos of a raw block log (BlockLog) from an image
+ *              of the SD card, e.g. made with dd. The image is memory-mapped
+ *              and the data of the records is written straight from the map.
+ *              If the image starts with a master boot record, the log is
+ *              taken from the first partition of type 0xDA, else the image
+ *              is taken as the log partition itself. The CRC of every record
+ *              is checked, damaged records are reported and skipped.
+ * 
+ * Build        pio run -e log_extract
+ * 
+ * Usage        .pio/build/log_extract/program [-l] card.img [outdir]
+ *              -l only lists the records (seq,name,bytes,crc_ok)
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "BlockLog.hpp"
+#include "Crc32.hpp"
+
+/**
+ * Read-only block device on the memory-mapped image
+*/
+class MappedImage : public BlockDevice
+{
+    public:
+        MappedImage(const uint8_t *base, uint32_t nbrOfBlocks) : _base(base), _nbrOfBlocks(nbrOfBlocks) {}
+
+        uint32_t getNbrOfBlocks() override { return _nbrOfBlocks; }
+
+        bool readBlocks(uint32_t lba, void *buf, uint32_t n) override
+        {
+            if (lba + n > _nbrOfBlocks) return false;
+            memcpy(buf, _base + static_cast<size_t>(lba) * BLOCK_SIZE, static_cast<size_t>(n) * BLOCK_SIZE);
+            return true;
+        }
+
+        bool writeBlocks(uint32_t, const void *, uint32_t) override { return false; }
+
+        const uint8_t *data(uint32_t lba) { return _base + static_cast<size_t>(lba) * BLOCK_SIZE; }
+
+    private:
+        const uint8_t *_base;
+        uint32_t       _nbrOfBlocks;
+};
+
+int main(int argc, char *argv[])
+{
+    bool        list = argc > 1 && strcmp(argv[1], "-l") == 0;
+    int         first = list ? 2 : 1;
+    struct stat st;
+
+    if (first >= argc)
+    {
+        fprintf(stderr, "usage: %s [-l] card.img [outdir]\n", argv[0]);
+        return 1;
+    }
+    std::string outdir = first + 1 < argc ? argv[first + 1] : ".";
+
+    int fd = open(argv[first], O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size < 2 * BlockDevice::BLOCK_SIZE)
+    {
+        fprintf(stderr, "%s: cannot open\n", argv[first]);
+        return 1;
+    }
+    const uint8_t *map = static_cast<const uint8_t *>(mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0));
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "%s: cannot map\n", argv[first]);
+        return 1;
+    }
+
+    uint32_t nbrOfBlocks = st.st_size / BlockDevice::BLOCK_SIZE;
+    uint32_t start = 0;
+    uint32_t count = nbrOfBlocks;
+    if (BlockLog::findPartition(map, start, count))
+    {
+        if (start >= nbrOfBlocks) { fprintf(stderr, "partition outside of the image\n"); return 1; }
+        if (start + count > nbrOfBlocks) count = nbrOfBlocks - start;
+        fprintf(stderr, "# log partition at block %u, %u blocks\n", start, count);
+    }
+
+    MappedImage image(map + static_cast<size_t>(start) * BlockDevice::BLOCK_SIZE, count);
+    BlockLog    log;
+    if (! log.mount(&image))
+    {
+        fprintf(stderr, "no log found\n");
+        return 1;
+    }
+    fprintf(stderr, "# %u records, %u after the last checkpoint\n", log.getNbrOfRecords(), log.getNbrOfRolledForward());
+
+    BlockLog::Record rec;
+    int exported = 0, damaged = 0;
+    for (bool ok = log.first(rec); ok; ok = log.next(rec))
+    {
+        const uint8_t *data = image.data(rec.lba + 1);
+        bool crcOk = Crc32::compute(data, rec.len) == rec.crc;
+        if (list)
+        {
+            printf("%u,%s,%u,%d\n", rec.seq, rec.name, rec.len, crcOk);
+            continue;
+        }
+        if (! crcOk)
+        {
+            fprintf(stderr, "%s: CRC error, skipped\n", rec.name);
+            damaged++;
+            continue;
+        }
+        std::string path = outdir + (rec.name[0] == '/' ? "" : "/") + rec.name;
+        FILE *f = fopen(path.c_str(), "wb");
+        if (! f || fwrite(data, 1, rec.len, f) != rec.len)
+        {
+            fprintf(stderr, "%s: cannot write\n", path.c_str());
+            return 1;
+        }
+        fclose(f);
+        exported++;
+    }
+    if (! list) fprintf(stderr, "# %d photos exported, %d damaged\n", exported, damaged);
+    munmap(const_cast<uint8_t *>(map), st.st_size);
+    close(fd);
+    return damaged ? 2 : 0;
+}
@@ -0,0 +1,224 @@
+/**
+ * Program      scheduleReplay.cpp
+ *
+ * Purpose      Replay a schedule recording (ScheduleRecorder) of the ESP32
+ *              against the same ScheduleCore code on the host. The recorded
+ *              clock readings and API calls are fed into the schedules in the
+ *              recorded order; each answer of next() is compared with the
+ *              recorded one and at each checkpoint the replayed state with the
+ *              recorded state. A difference means that the code has changed
+ *              since the recording or that the log is incomplete. The replay
+ *              is timed, so it can also be run under a profiler or debugger.
+ *
+ * Build        pio run -e schedule_replay
+ *
+ * Usage        .pio/build/schedule_replay/program [-v] schedule.rec
+ *              -v prints every record (local time of the host's TZ)
+ *
+ * Output       Trace and summary, exit code 1 if the replay diverged
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include "ScheduleCore.hpp"
+#include "ScheduleRecorder.hpp"
+
+using Replay = struct rply
+{
+    ScheduleCore schedule[ScheduleRecorder::MAX_TIMERS];
+    bool         known[ScheduleRecorder::MAX_TIMERS];
+    uint32_t     firings[ScheduleRecorder::MAX_TIMERS];
+    uint32_t     records;
+    uint32_t     checkpoints;
+    uint32_t     steps;
+    uint32_t     skipped;       // records of timers whose state is not in the log
+    uint32_t     diverged;
+};
+
+static const char *actionName(int action)
+{
+    static const char *names[] = { "WAIT_START", "WAIT", "FIRE", "DONE" };
+    return action >= 0 && action <= ScheduleCore::DONE ? names[action] : "?";
+}
+
+static bool sameState(const ScheduleCore::State &a, const ScheduleCore::State &b)
+{
+    return a.tStart == b.tStart && a.tStop == b.tStop && a.tInterval == b.tInterval
+        && a.intervalMultiplier == b.intervalMultiplier && a.tCyclePeriod == b.tCyclePeriod
+        && a.nbrOfCycles == b.nbrOfCycles && a.cycle == b.cycle && a.inWindow == b.inWindow
+        && a.nextFireMs == b.nextFireMs && a.firings == b.firings && a.tExtension == b.tExtension;
+}
+
+static void printTime(int64_t ms)
+{
+    time_t t = ms / 1000;
+    char   buf[24];
+
+    strftime(buf, sizeof(buf), "%F %T", localtime(&t));
+    printf("%s.%03d", buf, static_cast<int>(ms % 1000));
+}
+
+/**
+ * Feed the records into the schedules, with trace the records are printed
+*/
+static void replay(ScheduleRecorder &recorder, Replay &r, bool trace)
+{
+    ScheduleRecorder::Record rec;
+    bool inCheckpoint = false;
+    bool inCheckpointOf[ScheduleRecorder::MAX_TIMERS];
+
+    r = {};
+    for (bool ok = recorder.first(rec); ok; ok = recorder.next(rec))
+    {
+        r.records++;
+        int id = rec.timer;
+        if (trace)
+        {
+            printTime(rec.ms);
+            printf(" %2d %-13s", id, ScheduleRecorder::kindName(rec.kind));
+        }
+        if (rec.kind != ScheduleRecorder::STATE && inCheckpoint)
+        {
+            // timers not in the checkpoint were detached
+            for (int i = 0; i < ScheduleRecorder::MAX_TIMERS; i++) r.known[i] = r.known[i] && inCheckpointOf[i];
+            inCheckpoint = false;
+        }
+        if (id >= ScheduleRecorder::MAX_TIMERS || (id < 0 && rec.kind != ScheduleRecorder::CHECKPOINT
+                                                            && rec.kind != ScheduleRecorder::STEP))
+        {
+            if (trace) printf(" invalid timer\n");
+            r.diverged++;
+            continue;
+        }
+
+        switch (rec.kind)
+        {
+            case ScheduleRecorder::CHECKPOINT:
+                r.checkpoints++;
+                inCheckpoint = true;
+                for (int i = 0; i < ScheduleRecorder::MAX_TIMERS; i++) inCheckpointOf[i] = false;
+                break;
+
+            case ScheduleRecorder::STATE:
+                if (inCheckpoint) inCheckpointOf[id] = true;
+                if (inCheckpoint && r.known[id] && ! sameState(r.schedule[id].getState(), rec.state))
+                {
+                    if (trace) printf(" replayed state differs");
+                    r.diverged++;
+                }
+                r.schedule[id].setState(rec.state);
+                r.known[id] = true;
+                if (trace) printf(" start %lld, stop %lld, interval %lld x %u ms, cycle %u/%u, firings %u",
+                                  static_cast<long long>(rec.state.tStart), static_cast<long long>(rec.state.tStop),
+                                  static_cast<long long>(rec.state.tInterval), rec.state.intervalMultiplier,
+                                  rec.state.cycle, rec.state.nbrOfCycles, rec.state.firings);
+                break;
+
+            case ScheduleRecorder::CLOCK:
+            {
+                if (! r.known[id]) { r.skipped++; break; }
+                ScheduleCore::Step step = r.schedule[id].next(rec.ms, rec.value);
+                if (step.action == ScheduleCore::FIRE) r.firings[id]++;
+                if (trace) printf(" %s", actionName(step.action));
+                if (trace && rec.value) printf(" (lead %lld ms)", static_cast<long long>(rec.value));
+                if (step.action == ScheduleCore::WAIT || step.action == ScheduleCore::WAIT_START)
+                {
+                    if (trace) printf(" %lld ms", static_cast<long long>(step.waitMs));
+                }
+                if (step.action != rec.action)
+                {
+                    if (trace) printf(" recorded %s", actionName(rec.action));
+                    r.diverged++;
+                }
+                break;
+            }
+
+            case ScheduleRecorder::FIRED:
+                if (r.known[id]) r.schedule[id].fired(rec.ms);
+                else r.skipped++;
+                break;
+
+            case ScheduleRecorder::STEP:
+                r.steps++;
+                if (trace) printf(" %+lld ms", static_cast<long long>(rec.value));
+                break;
+
+            case ScheduleRecorder::SET_START:      r.schedule[id].setStart(rec.value); break;
+            case ScheduleRecorder::SET_STOP:       r.schedule[id].setStop(rec.value); break;
+            case ScheduleRecorder::SET_INTERVAL:   r.schedule[id].setInterval(rec.value); break;
+            case ScheduleRecorder::SET_PERIOD:     r.schedule[id].setCyclePeriod(rec.value); break;
+            case ScheduleRecorder::SET_CYCLES:     r.schedule[id].setNbrOfCycles(rec.value); break;
+            case ScheduleRecorder::SET_MULTIPLIER: r.schedule[id].setIntervalMultiplier(rec.value); break;
+            case ScheduleRecorder::EXTEND:         r.schedule[id].extendWindow(rec.value); break;
+            case ScheduleRecorder::SKIP:           r.schedule[id].skip(rec.value); break;
+            case ScheduleRecorder::RESET:          r.schedule[id].reset(); break;
+            case ScheduleRecorder::DELETE:         r.known[id] = false; break;
+            default:                               break;
+        }
+        if (trace && ((rec.kind >= ScheduleRecorder::SET_START && rec.kind <= ScheduleRecorder::EXTEND)
+                      || rec.kind == ScheduleRecorder::SKIP))
+        {
+            printf(" %lld", static_cast<long long>(rec.value));
+        }
+        if (trace) printf("\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    bool trace = argc > 1 && strcmp(argv[1], "-v") == 0;
+    int  first = trace ? 2 : 1;
+
+    if (first >= argc)
+    {
+        fprintf(stderr, "usage: %s [-v] schedule.rec\n", argv[0]);
+        return 1;
+    }
+    FILE *f = fopen(argv[first], "rb");
+    if (! f)
+    {
+        fprintf(stderr, "%s: cannot open\n", argv[first]);
+        return 1;
+    }
+    std::vector<uint8_t> buf;
+    uint8_t chunk[4096];
+    size_t  n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) buf.insert(buf.end(), chunk, chunk + n);
+    fclose(f);
+
+    ScheduleRecorder recorder;
+    if (! recorder.load(buf.data(), buf.size()))
+    {
+        fprintf(stderr, "%s: no schedule recording\n", argv[first]);
+        return 1;
+    }
+
+    Replay r;
+    replay(recorder, r, trace);
+
+    // timed replays without trace, at least 100 ms
+    uint32_t runs = 0;
+    double   ns   = 0;
+    Replay   timed;
+    auto t0 = std::chrono::steady_clock::now();
+    do
+    {
+        replay(recorder, timed, false);
+        runs++;
+        ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    } while (ns < 1e8);
+
+    printf("records: %u in %u segments, checkpoints: %u, clock steps: %u, skipped: %u\n",
+           r.records, recorder.getNbrOfSegments(), r.checkpoints, r.steps, r.skipped);
+    for (int id = 0; id < ScheduleRecorder::MAX_TIMERS; id++)
+    {
+        if (r.known[id] || r.firings[id]) printf("timer %d: %u firings replayed, %u in total\n",
+                                                  id, r.firings[id], r.schedule[id].getFiringCount());
+    }
+    printf("replay: %.1f ns per record\n", r.records ? ns / runs / r.records : 0.0);
+    printf("%s\n", r.diverged ? "DIVERGED" : "replay matches the recording");
+    return r.diverged ? 1 : 0;
+}
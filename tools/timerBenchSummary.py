@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+"""
+Program      timerBenchSummary.py
+
+Purpose      Summarizes the output of the timer latency benchmark firmware
+             (bench/timerLatencyBench.cpp) per scenario: the latency of the
+             firings (mean, median, 99% quantile, maximum) and the jitter,
+             the standard deviation of the period between two firings
+             measured with the cycle counter (only pairs on the same core).
+
+Usage        pio device monitor | tee timer.log
+             python3 tools/timerBenchSummary.py timer.log
+             Lines not belonging to the benchmark are ignored.
+
+Output       CSV lines (scenario,firings,mean_us,p50_us,p99_us,max_us,jitter_us)
+             and a comment line per scenario run with and without the
+             latency compensation (suffix _comp) comparing the two
+"""
+
+import math
+import sys
+
+
+def quantile(values, q):
+    s = sorted(values)
+    return s[min(len(s) - 1, max(0, math.ceil(q * len(s)) - 1))]
+
+
+def summarize(name, mhz, firings):
+    latencies = [f[1] for f in firings]
+    periods = []
+    for prev, cur in zip(firings, firings[1:]):
+        if prev[3] == cur[3] and cur[0] == prev[0] + 1:
+            periods.append(((cur[2] - prev[2]) & 0xFFFFFFFF) / mhz)
+    jitter = 0.0
+    if len(periods) > 1:
+        mean = sum(periods) / len(periods)
+        jitter = math.sqrt(sum((p - mean) ** 2 for p in periods) / (len(periods) - 1))
+    result = (sum(latencies) / len(latencies), quantile(latencies, 0.5), quantile(latencies, 0.99),
+              max(latencies), jitter)
+    print("%s,%d,%.1f,%d,%d,%d,%.1f" % ((name, len(latencies)) + result))
+    return result
+
+
+def main():
+    source = open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin
+    name, mhz, firings = None, 240, []
+    results = {}
+    print("scenario,firings,mean_us,p50_us,p99_us,max_us,jitter_us")
+    for line in source:
+        fields = line.strip().split(",")
+        try:
+            if fields[0] == "B" and len(fields) == 4:
+                name, mhz, firings = fields[1], int(fields[3]), []
+            elif fields[0] == "F" and len(fields) == 5 and name:
+                firings.append(tuple(int(f) for f in fields[1:]))
+            elif fields[0] == "E" and name and firings:
+                results[name] = summarize(name, mhz, firings)
+                name = None
+        except ValueError:
+            continue        # garbled line
+    for name in results:
+        if name + "_comp" in results:
+            before, after = results[name], results[name + "_comp"]
+            print("# %s compensated: mean %.1f -> %.1f us, p99 %d -> %d us, jitter %.1f -> %.1f us" %
+                  (name, before[0], after[0], before[2], after[2], before[4], after[4]))
+
+
+if __name__ == "__main__":
+    main()